@@ -0,0 +1,160 @@
+/*
+ *	atlas.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Glyph atlas for everything the built in font does not cover. The file
+ *	is mapped read only and only the pages of the glyphs we look up are
+ *	touched: binary search in the sorted index, PackBits decode on first
+ *	use, then the glyph stays in a small LRU of decoded glyphs.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logger.h"
+#include "rle.h"
+#include "atlas.h"
+
+const uint8_t		*atlasMap  = NULL;
+size_t				atlasSize  = 0;
+const atlasheader	*atlasHead = NULL;
+const atlasentry	*atlasIndex = NULL;
+
+atlasglyph		glyphCache[ATLAS_CACHE];
+unsigned long	glyphClock = 0;
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int openAtlas(const char *path) {
+	struct stat st;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		logERR(LS_DISPLAY, "Cannot open glyph atlas %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(atlasheader))) {
+		logERR(LS_DISPLAY, "Glyph atlas %s is too short\n", path);
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		logERR(LS_DISPLAY, "Cannot map glyph atlas %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	// lookups jump around, read ahead would only fill the page cache
+	madvise(map, st.st_size, MADV_RANDOM);
+
+	const atlasheader *h = (const atlasheader *)map;
+	if ((memcmp(h->magic, ATLAS_MAGIC, 4) != 0) || (h->version != ATLAS_VERSION) ||
+		(h->height == 0) || (h->height > ATLAS_MAXHEIGHT) || (h->pages != (h->height + 7) / 8) ||
+		(h->indexOffset + (uint64_t)h->count * sizeof(atlasentry) > (uint64_t)st.st_size) ||
+		(h->dataOffset > (uint64_t)st.st_size)) {
+		logERR(LS_DISPLAY, "Glyph atlas %s: bad header\n", path);
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	closeAtlas();
+	atlasMap   = (const uint8_t *)map;
+	atlasSize  = st.st_size;
+	atlasHead  = h;
+	atlasIndex = (const atlasentry *)(atlasMap + h->indexOffset);
+
+	logMSG(LS_DISPLAY, LL_INFO, "Glyph atlas %s: %u glyphs, %d pixel high\n", path, h->count, h->height);
+	return 0;
+}
+
+void closeAtlas(void) {
+	if (atlasMap != NULL) {
+		munmap((void *)atlasMap, atlasSize);
+	}
+	atlasMap   = NULL;
+	atlasHead  = NULL;
+	atlasIndex = NULL;
+	memset(glyphCache, 0, sizeof(glyphCache));
+}
+
+int atlasHeight(void) {
+	return (atlasHead == NULL) ? 0 : atlasHead->height;
+}
+
+const atlasentry *findEntry(int codepoint) {
+	int lo = 0;
+	int hi = (int)atlasHead->count - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int cp  = (int)atlasIndex[mid].codepoint;
+
+		if      (cp < codepoint)	{lo = mid + 1;}
+		else if (cp > codepoint)	{hi = mid - 1;}
+		else						{return &atlasIndex[mid];}
+	}
+	return NULL;
+}
+
+/*
+ * The decoded glyph, NULL if the atlas has none for the codepoint.
+ */
+const atlasglyph *atlasGlyph(int codepoint) {
+	uint8_t raw[ATLAS_MAXWIDTH * 2];
+	atlasglyph *victim = &glyphCache[0];
+
+	if (atlasHead == NULL)	{return NULL;}
+
+	for (int i = 0; i < ATLAS_CACHE; i++) {
+		atlasglyph *g = &glyphCache[i];
+		if ((g->used != 0) && (g->codepoint == codepoint)) {
+			g->used = ++glyphClock;
+			return g;
+		}
+		if (g->used < victim->used)	{victim = g;}
+	}
+
+	const atlasentry *e = findEntry(codepoint);
+	if ((e == NULL) || (e->width == 0) || (e->width > ATLAS_MAXWIDTH))	{return NULL;}
+	if (atlasHead->dataOffset + (uint64_t)e->offset + e->length > atlasSize)	{return NULL;}
+
+	int pages = atlasHead->pages;
+	int n = unpackBits(atlasMap + atlasHead->dataOffset + e->offset, e->length, raw, sizeof(raw));
+	if (n != e->width * pages) {
+		logMSG(LS_DISPLAY, LL_DEBUG, "Glyph atlas: broken glyph U+%04X\n", codepoint);
+		return NULL;
+	}
+
+	victim->codepoint = codepoint;
+	victim->width     = e->width;
+	for (int c = 0; c < e->width; c++) {
+		victim->cols[c] = raw[c * pages] | ((pages > 1) ? raw[c * pages + 1] << 8 : 0);
+	}
+	victim->used = ++glyphClock;
+	return victim;
+}
@@ -0,0 +1,68 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef ATLAS_H
+#define ATLAS_H 1
+
+#include <stdint.h>
+
+#define ATLAS_MAGIC		"LMSA"
+#define ATLAS_VERSION	1
+#define ATLAS_MAXWIDTH	16			// pixels, a glyph column is at most 2 pages
+#define ATLAS_MAXHEIGHT	16
+#define ATLAS_CACHE		64			// decoded glyphs kept in RAM
+
+/*
+ * File layout, little endian:
+ *   atlasheader
+ *   atlasentry[count]       sorted by codepoint
+ *   glyph data              PackBits compressed, per column page 0 then page 1
+ */
+typedef struct {
+	char		magic[4];
+	uint16_t	version;
+	uint8_t		height;
+	uint8_t		pages;
+	uint32_t	count;
+	uint32_t	indexOffset;
+	uint32_t	dataOffset;
+} atlasheader;
+
+typedef struct {
+	uint32_t	codepoint;
+	uint32_t	offset;				// from dataOffset
+	uint16_t	length;				// compressed bytes
+	uint8_t		width;
+	uint8_t		reserved;
+} atlasentry;
+
+typedef struct {
+	int				codepoint;
+	int				width;
+	uint16_t		cols[ATLAS_MAXWIDTH];
+	unsigned long	used;
+} atlasglyph;
+
+int   openAtlas(const char *path);
+void  closeAtlas(void);
+int   atlasHeight(void);
+const atlasglyph *atlasGlyph(int codepoint);
+
+#endif
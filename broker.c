@@ -0,0 +1,732 @@
+/*
+ *	broker.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Broker mode (-B): one connection to LMS for any number of monitors.
+ *	Downstream the broker speaks the CLI, a monitor is pointed at it with
+ *	-s like at a server. Identical commands of all monitors share one
+ *	cached answer, refreshed at most every BROKER_TTL, so a dozen displays
+ *	polling once a second cost LMS one poll a second. Notifications of the
+ *	upstream subscription invalidate the cache of their player and are
+ *	passed on to the subscribed monitors.
+ *
+ *	serverstatus answers carry broker:1. A monitor seeing it adds delta:1
+ *	to its status query and gets only the fields that changed since its
+ *	previous answer, with gone:name,... for the fields that disappeared.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+#include "tagUtils.h"
+#include "cliengine.h"
+#include "sliminfo.h"
+#include "reactor.h"
+#include "broker.h"
+
+#define BEV_LISTEN	0
+#define BEV_SIGNAL	1
+#define BEV_CLI		2
+#define BEV_CONNECT	3		// discovery or connect of a reconnect
+#define BEV_CLIENT	4		// BEV_CLIENT + client slot
+
+#define DELTA_FLAG	" delta:1"
+#define MAXTOKENS	256
+
+typedef struct {
+	char	cmd[CLI_CMDLEN];	// as the monitors send it, without delta:1 and newline
+	char	*answer;
+	int		ttl;				// ms, 0: not cached, every request goes to LMS
+	long	fetched;			// ns, 0: no valid answer
+	long	failed;				// ns of the last failed refresh
+	int		stale;				// a notification changed the player
+	int		req;				// upstream request in flight, -1 none
+	int		wanted;
+	int		waiting;			// client requests referring to the entry
+	long	used;
+} brokerentry;
+
+typedef struct {
+	int		entry;				// -1: answer is the echo of the command (subscribe)
+	int		delta;
+	long	asked;				// ns, the answer must be fetched after this
+	char	echo[CLI_CMDLEN];
+} brokerwait;
+
+typedef struct {
+	int			fd;
+	int			subscribed;
+	int			out;			// EPOLLOUT registered
+	char		rx[CLI_CMDLEN];
+	int			rxLen;
+	char		*tx;
+	int			txLen;
+	brokerwait	queue[BROKER_QUEUE];
+	int			qHead;
+	int			qCount;
+	char		*base;			// last delta:1 answer, the monitor holds its fields
+	int			baseEntry;
+} brokerclient;
+
+brokerentry		cache[BROKER_CACHE];
+brokerclient	clients[BROKER_MAXCLIENTS];
+
+int		bEpFD     = -1;
+int		bSignalFD = -1;
+int		bListenFD = -1;
+int		bCliReg   = -1;
+int		bCliOut   = false;
+int		bCliConn  = 0;		// the connection of bCliReg, a reconnect can take the same number
+
+long	servedAnswers  = 0;
+long	servedCached   = 0;
+long	upstreamFetches = 0;
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long brokerNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void brokerWatch(int fd, int op, uint32_t events, uint32_t id) {
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = events;
+	ev.data.u32 = id;
+	epoll_ctl(bEpFD, op, fd, &ev);
+}
+
+int brokerListen(const char *listenOn) {
+	struct sockaddr_in addr;
+	int enable = 1;
+	const char *port = strrchr(listenOn, ':');
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (port != NULL) {
+		char host[INET_ADDRSTRLEN] = {0};
+		int  len = port - listenOn;
+
+		if (len < INET_ADDRSTRLEN)	{memcpy(host, listenOn, len);}
+		// a mistyped address must not serve on every interface
+		if ((len >= INET_ADDRSTRLEN) || (inet_pton(AF_INET, host, &addr.sin_addr) != 1)) {
+			errno = EINVAL;
+			return -1;
+		}
+		port++;
+	} else {
+		port = listenOn;
+	}
+	addr.sin_port = htons(atoi(port));
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)	{return -1;}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, BROKER_MAXCLIENTS) < 0)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*******************************************************************************
+ * Cache
+ ******************************************************************************/
+int commandTTL(const char *cmd) {
+	char t0[CLI_CMDLEN], t1[CLI_CMDLEN] = "";
+
+	if (sscanf(cmd, "%511s %511s", t0, t1) < 1)	{return 0;}
+	if ((strcmp(t0, "players") == 0) || (strcmp(t0, "serverstatus") == 0))	{return BROKER_LISTTTL;}
+	if ((strcmp(t1, "status") == 0) || (strcmp(t1, "mixer") == 0))			{return BROKER_TTL;}
+	return 0;
+}
+
+void dropBase(brokerclient *c) {
+	free(c->base);
+	c->base      = NULL;
+	c->baseEntry = -1;
+}
+
+/*
+ * The entry of a command, a new one replaces the least recently used
+ * entry nobody waits for; -1 if all are busy.
+ */
+int findEntry(const char *cmd, long now) {
+	int victim = -1;
+
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		brokerentry *b = &cache[e];
+
+		if ((b->ttl > 0) && (strcmp(b->cmd, cmd) == 0)) {
+			b->used = now;
+			return e;
+		}
+		if ((b->req < 0) && (b->waiting == 0) && ((victim < 0) || (b->used < cache[victim].used))) {
+			victim = e;
+		}
+	}
+	if (victim < 0)	{return -1;}
+
+	brokerentry *b = &cache[victim];
+	strncpy(b->cmd, cmd, CLI_CMDLEN - 1);
+	b->ttl     = commandTTL(cmd);
+	b->fetched = 0;
+	b->failed  = 0;
+	b->stale   = false;
+	b->wanted  = false;
+	b->used    = now;
+	b->answer[0] = 0;
+	for (int c = 0; c < BROKER_MAXCLIENTS; c++) {
+		if (clients[c].baseEntry == victim)	{dropBase(&clients[c]);}
+	}
+	return victim;
+}
+
+// notifications of a player make its cached answers stale
+void invalidate(const char *line) {
+	char t0[CLI_CMDLEN], t1[CLI_CMDLEN] = "";
+
+	if (sscanf(line, "%511s %511s", t0, t1) < 1)	{return;}
+	int client = (strcmp(t1, "client") == 0);
+
+	char who[CLI_CMDLEN];
+	decode(t0, who);
+
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		brokerentry *b = &cache[e];
+		char c0[CLI_CMDLEN], dec[CLI_CMDLEN];
+
+		if ((b->ttl == 0) || (sscanf(b->cmd, "%511s", c0) != 1))	{continue;}
+		decode(c0, dec);
+		if ((strcmp(dec, who) == 0) ||
+			(client && ((strncmp(b->cmd, "players", 7) == 0) || (strncmp(b->cmd, "serverstatus", 12) == 0)))) {
+			b->stale = true;
+		}
+	}
+}
+
+/*
+ * Upstream: every wanted entry gets a request, as many as the CLI engine
+ * takes; the rest follow when those are answered.
+ */
+void fetchWanted(long now) {
+	int queued = 0;
+
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		brokerentry *b = &cache[e];
+		if (!b->wanted || (b->req >= 0))	{continue;}
+
+		if (!cliConnected()) {
+			// without LMS the waiting monitors get the last good answer
+			b->wanted = false;
+			b->failed = now;
+			continue;
+		}
+
+		if ((b->req = cliQueue(b->cmd, b->answer, CLI_RXSIZE, CLI_DEADLINE)) < 0)	{break;}
+		b->wanted = false;
+		b->used   = now;
+		upstreamFetches++;
+		queued++;
+	}
+	if (queued > 0)	{cliFlush();}
+}
+
+void collectAnswers(long now) {
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		brokerentry *b = &cache[e];
+		if (b->req < 0)	{continue;}
+
+		clistate_t st = cliState(b->req);
+		if ((st == CR_QUEUED) || (st == CR_SENT))	{continue;}
+
+		if (st == CR_DONE) {
+			b->fetched = now;
+			b->stale   = false;
+		} else {
+			b->failed  = now;
+		}
+		cliRelease(b->req);
+		b->req = -1;
+	}
+}
+
+/*******************************************************************************
+ * Downstream
+ ******************************************************************************/
+void closeClient(brokerclient *c) {
+	for (int i = 0; i < c->qCount; i++) {
+		brokerwait *w = &c->queue[(c->qHead + i) % BROKER_QUEUE];
+		if (w->entry >= 0)	{cache[w->entry].waiting--;}
+	}
+	dropBase(c);
+	close(c->fd);
+	free(c->tx);
+	c->tx = NULL;
+	c->fd = -1;
+	logMSG(LS_SLIM, LL_INFO, "Broker: monitor disconnected\n");
+}
+
+int sendClient(brokerclient *c, const char *data, int len) {
+	if (c->txLen + len > BROKER_TXSIZE) {
+		logMSG(LS_SLIM, LL_INFO, "Broker: monitor does not read, dropped\n");
+		closeClient(c);
+		return -1;
+	}
+	memcpy(c->tx + c->txLen, data, len);
+	c->txLen += len;
+	return 0;
+}
+
+void flushClient(brokerclient *c, int slot) {
+	if (c->txLen > 0) {
+		int n = write(c->fd, c->tx, c->txLen);
+		if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+			closeClient(c);
+			return;
+		}
+		if (n > 0) {
+			memmove(c->tx, c->tx + n, c->txLen - n);
+			c->txLen -= n;
+		}
+	}
+
+	int out = (c->txLen > 0);
+	if (out != c->out) {
+		brokerWatch(c->fd, EPOLL_CTL_MOD, EPOLLIN | (out ? EPOLLOUT : 0), BEV_CLIENT + slot);
+		c->out = out;
+	}
+}
+
+// -1 with more than MAXTOKENS
+int splitTokens(char *s, char **tok) {
+	int n = 0;
+	for (char *p = strtok(s, " "); p != NULL; p = strtok(NULL, " ")) {
+		if (n == MAXTOKENS)	{return -1;}
+		tok[n++] = p;
+	}
+	return n;
+}
+
+int tokenKeyLen(const char *t) {
+	const char *colon = strstr(t, "%3A");
+	return (colon == NULL) ? (int)strlen(t) : colon - t;
+}
+
+/*
+ * The echo of the command, then only the fields that are not in the
+ * previous answer, and the names of the fields that are gone. -1 when
+ * either answer has too many fields to compare, the whole one goes out.
+ */
+int buildDelta(const char *cmd, const char *answer, const char *prev, char *out) {
+	static char cur[CLI_RXSIZE], old[CLI_RXSIZE];
+	char *ct[MAXTOKENS], *ot[MAXTOKENS];
+	char *o = out;
+	int  gone = 0;
+
+	strcpy(cur, answer);
+	strcpy(old, prev);
+	int cn = splitTokens(cur, ct);
+	int on = splitTokens(old, ot);
+	if ((cn < 0) || (on < 0))	{return -1;}
+
+	// the answer starts with the command, encoded
+	int echo = 0;
+	for (const char *p = cmd; *p; echo++) {
+		while (*p == ' ')			{p++;}
+		if (*p == 0)				{break;}
+		while (*p && (*p != ' '))	{p++;}
+	}
+	if (echo > cn)	{echo = cn;}
+
+	for (int i = 0; i < echo; i++) {
+		o += sprintf(o, "%s%s", i ? " " : "", ct[i]);
+	}
+	o += sprintf(o, " delta%%3A1");
+
+	for (int i = echo; i < cn; i++) {
+		int same = false;
+		for (int j = echo; (j < on) && !same; j++) {
+			same = (strcmp(ct[i], ot[j]) == 0);
+		}
+		if (!same)	{o += sprintf(o, " %s", ct[i]);}
+	}
+
+	for (int j = echo; j < on; j++) {
+		int klen = tokenKeyLen(ot[j]);
+		int kept = false;
+		for (int i = echo; (i < cn) && !kept; i++) {
+			kept = (tokenKeyLen(ct[i]) == klen) && (strncmp(ct[i], ot[j], klen) == 0);
+		}
+		if (!kept) {
+			o += sprintf(o, "%s%.*s", gone++ ? "%2C" : " gone%3A", klen, ot[j]);
+		}
+	}
+	*o++ = '\n';
+	return o - out;
+}
+
+int answerWait(brokerclient *c, brokerwait *w, int e) {
+	static char out[CLI_RXSIZE * 2 + 64];
+	int len;
+
+	if (e < 0) {
+		len = sprintf(out, "%s\n", w->echo);
+		return sendClient(c, out, len);
+	}
+
+	brokerentry *b = &cache[e];
+	// a delta only against the answer the monitor parsed last, of the same player
+	if (!w->delta || (c->baseEntry != e) || ((len = buildDelta(b->cmd, b->answer, c->base, out)) < 0)) {
+		if (strncmp(b->cmd, "serverstatus", 12) == 0) {
+			len = sprintf(out, "%s broker%%3A1\n", b->answer);
+		} else {
+			len = sprintf(out, "%s\n", b->answer);
+		}
+	}
+
+	if (w->delta) {
+		dropBase(c);
+		if ((c->base = strdup(b->answer)) != NULL)	{c->baseEntry = e;}
+	}
+	servedAnswers++;
+	return sendClient(c, out, len);
+}
+
+/*
+ * Answers go out in the order of the requests, the monitors match them
+ * by position. A failed refresh is answered with the last good answer;
+ * without one the monitor is dropped, as LMS would drop it.
+ */
+void serveClient(brokerclient *c, int slot) {
+	while (c->qCount > 0) {
+		brokerwait *w = &c->queue[c->qHead];
+		int e = w->entry;
+
+		if (e >= 0) {
+			brokerentry *b = &cache[e];
+			if (b->fetched < w->asked) {
+				if (b->failed < w->asked)	{break;}
+				if (b->fetched == 0) {
+					closeClient(c);
+					return;
+				}
+			}
+			b->waiting--;
+			if (b->ttl == 0)	{b->fetched = 0;}
+		}
+
+		c->qHead = (c->qHead + 1) % BROKER_QUEUE;
+		c->qCount--;
+		if (answerWait(c, w, e) < 0)	{return;}
+	}
+	flushClient(c, slot);
+}
+
+void clientCommand(brokerclient *c, char *line, long now) {
+	char cmd[CLI_CMDLEN];
+	char *flag;
+
+	if (c->qCount == BROKER_QUEUE) {
+		logMSG(LS_SLIM, LL_INFO, "Broker: too many requests of a monitor\n");
+		closeClient(c);
+		return;
+	}
+
+	brokerwait *w = &c->queue[(c->qHead + c->qCount) % BROKER_QUEUE];
+	strncpy(w->echo, line, CLI_CMDLEN - 1);
+	w->echo[CLI_CMDLEN - 1] = 0;
+	strcpy(cmd, w->echo);
+
+	w->delta = false;
+	if (((flag = strstr(cmd, DELTA_FLAG)) != NULL) && (flag[strlen(DELTA_FLAG)] == 0)) {
+		*flag    = 0;
+		w->delta = true;
+	}
+
+	if (strncmp(cmd, "subscribe", 9) == 0) {
+		// the broker holds the subscription, the monitor gets the notifications
+		c->subscribed = true;
+		w->entry = -1;
+		w->asked = 0;
+	} else {
+		int e = findEntry(cmd, now);
+		if (e < 0) {
+			logMSG(LS_SLIM, LL_INFO, "Broker: cache full\n");
+			closeClient(c);
+			return;
+		}
+		brokerentry *b = &cache[e];
+
+		if ((b->ttl > 0) && (b->fetched > 0) && !b->stale && (now - b->fetched < b->ttl * 1000000L)) {
+			w->asked = 0;
+			servedCached++;
+		} else {
+			// a refresh in flight is answered after this request, it will do
+			w->asked  = now;
+			b->wanted = (b->req < 0);
+		}
+		b->waiting++;
+		w->entry = e;
+	}
+	c->qCount++;
+}
+
+void clientReadable(brokerclient *c, long now) {
+	char buff[BSIZE];
+	int  n;
+
+	while ((c->fd >= 0) && ((n = read(c->fd, buff, sizeof(buff))) > 0)) {
+		for (int i = 0; (i < n) && (c->fd >= 0); i++) {
+			if ((buff[i] == '\n') || (buff[i] == '\r')) {
+				c->rx[c->rxLen] = 0;
+				if (c->rxLen > 0)	{clientCommand(c, c->rx, now);}
+				c->rxLen = 0;
+			} else if (c->rxLen < CLI_CMDLEN - 1) {
+				c->rx[c->rxLen++] = buff[i];
+			}
+		}
+	}
+	if ((c->fd >= 0) && ((n == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))) {
+		closeClient(c);
+	}
+}
+
+void acceptClients(void) {
+	int enable = 1;
+
+	for (int fd; (fd = accept4(bListenFD, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0; ) {
+		int slot = 0;
+		while ((slot < BROKER_MAXCLIENTS) && (clients[slot].fd >= 0))	{slot++;}
+		if (slot == BROKER_MAXCLIENTS) {
+			logMSG(LS_SLIM, LL_INFO, "Broker: no room for another monitor\n");
+			close(fd);
+			continue;
+		}
+
+		brokerclient *c = &clients[slot];
+		if ((c->tx = (char *)malloc(BROKER_TXSIZE)) == NULL) {
+			close(fd);
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		c->fd = fd;
+		c->subscribed = false;
+		c->out   = false;
+		c->rxLen = c->txLen = 0;
+		c->qHead = c->qCount = 0;
+		brokerWatch(fd, EPOLL_CTL_ADD, EPOLLIN, BEV_CLIENT + slot);
+		logMSG(LS_SLIM, LL_INFO, "Broker: monitor connected\n");
+	}
+}
+
+// unsolicited lines of the upstream connection
+void brokerNotify(char *line, int len) {
+	invalidate(line);
+
+	for (int i = 0; i < BROKER_MAXCLIENTS; i++) {
+		brokerclient *c = &clients[i];
+		if ((c->fd < 0) || !c->subscribed)	{continue;}
+		if (sendClient(c, line, len) == 0) {
+			sendClient(c, "\n", 1);
+		}
+	}
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+void syncUpstream(void) {
+	int fd   = cliFD();
+	int out  = cliWantWrite();
+	int conn = cliConnection();
+	int same = (fd == bCliReg) && (conn == bCliConn);
+
+	if (same && (out == bCliOut))	{return;}
+	if (fd >= 0) {
+		// a closed descriptor left the epoll set, a new connection is added again
+		brokerWatch(fd, same ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, EPOLLIN | (out ? EPOLLOUT : 0), BEV_CLI);
+	}
+	bCliReg  = fd;
+	bCliOut  = out;
+	bCliConn = conn;
+}
+
+int openBroker(const char *listenOn) {
+	sigset_t mask;
+
+	reactorSignals(&mask);
+
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		if ((cache[e].answer = (char *)malloc(CLI_RXSIZE)) == NULL)	{return -1;}
+		cache[e].req = -1;
+	}
+	for (int i = 0; i < BROKER_MAXCLIENTS; i++) {
+		clients[i].fd        = -1;
+		clients[i].baseEntry = -1;
+	}
+
+	if ((bListenFD = brokerListen(listenOn)) < 0) {
+		logERR(LS_MAIN, "Broker cannot listen on %s: %s\n", listenOn, strerror(errno));
+		return -1;
+	}
+	if ((bEpFD     = epoll_create1(EPOLL_CLOEXEC)) < 0)						{return -1;}
+	if ((bSignalFD = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)	{return -1;}
+
+	brokerWatch(bListenFD, EPOLL_CTL_ADD, EPOLLIN, BEV_LISTEN);
+	brokerWatch(bSignalFD, EPOLL_CTL_ADD, EPOLLIN, BEV_SIGNAL);
+	return 0;
+}
+
+void closeBroker(void) {
+	for (int i = 0; i < BROKER_MAXCLIENTS; i++) {
+		if (clients[i].fd >= 0)	{closeClient(&clients[i]);}
+	}
+	for (int e = 0; e < BROKER_CACHE; e++) {
+		free(cache[e].answer);
+		cache[e].answer = NULL;
+	}
+	cliClose();
+	if (bListenFD >= 0)	{close(bListenFD);}
+	if (bSignalFD >= 0)	{close(bSignalFD);}
+	if (bEpFD     >= 0)	{close(bEpFD);}
+	bListenFD = bSignalFD = bEpFD = bCliReg = -1;
+}
+
+/*
+ * listenOn: "9090" or "addr:port"
+ */
+int runBroker(const char *listenOn) {
+	struct epoll_event events[16];
+	int  running   = true;
+	int  backoff   = 1;
+	long reconnect = 0;
+
+	if (openBroker(listenOn) < 0) {
+		closeBroker();
+		return -1;
+	}
+
+	cliSetNotify(brokerNotify);
+	logMSG(LS_MAIN, LL_INFO, "Broker listening on %s\n", listenOn);
+
+	while (running) {
+		long now  = brokerNow();
+		int  step = 0;
+
+		// the same steps as the reactor, the monitors are served meanwhile
+		if (!cliConnected() && !connectPending() && (now >= reconnect)) {
+			step = connectBegin(now);
+		}
+		if (connectPending()) {
+			step = reconnectStep(bEpFD, BEV_CONNECT, now);
+		}
+		if (step < 0) {
+			reconnect = now + backoff * 1000000000L;
+			backoff   = (backoff < 30) ? backoff * 2 : 30;
+		} else if ((step > 0) && cliIsJSON()) {
+			// the monitors get CLI lines, passed on as they come
+			logERR(LS_MAIN, "The broker needs the CLI of the server, not JSON-RPC\n");
+			closeBroker();
+			return -1;
+		} else if (step > 0) {
+			backoff = 1;
+		}
+
+		fetchWanted(now);
+		syncUpstream();
+
+		long next = cliNextDeadline();
+		if (!cliConnected())	{next = reconnect;}
+		if (connectPending())	{next = connectDeadline();}
+		int timeout = (next == 0) ? -1 : (int)((next - now) / 1000000L) + 1;
+		if (timeout < 0)		{timeout = 0;}
+
+		int n = epoll_wait(bEpFD, events, 16, timeout);
+		if ((n < 0) && (errno != EINTR)) {
+			logERR(LS_MAIN, "epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+
+		now = brokerNow();
+		for (int i = 0; i < n; i++) {
+			uint32_t id = events[i].data.u32;
+			struct signalfd_siginfo si;
+
+			if (id == BEV_SIGNAL) {
+				if (read(bSignalFD, &si, sizeof(si)) == sizeof(si)) {
+					logMSG(LS_MAIN, LL_INFO, "Signal %d, leaving\n", si.ssi_signo);
+					running = false;
+				}
+			} else if (id == BEV_LISTEN) {
+				acceptClients();
+			} else if (id == BEV_CONNECT) {
+				// connectStep() at the top of the loop
+			} else if (id == BEV_CLI) {
+				if (events[i].events & EPOLLOUT) {
+					cliFlush();
+				}
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					cliOnReadable();
+				}
+			} else if (id - BEV_CLIENT < BROKER_MAXCLIENTS) {
+				brokerclient *c = &clients[id - BEV_CLIENT];
+				if (c->fd < 0)	{continue;}
+				if (events[i].events & EPOLLOUT) {
+					flushClient(c, id - BEV_CLIENT);
+				}
+				if ((c->fd >= 0) && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+					clientReadable(c, now);
+				}
+			}
+		}
+
+		cliExpire(now);
+		collectAnswers(now);
+
+		for (int i = 0; i < BROKER_MAXCLIENTS; i++) {
+			if (clients[i].fd >= 0)	{serveClient(&clients[i], i);}
+		}
+	}
+
+	logMSG(LS_MAIN, LL_INFO, "Broker: %ld answers, %ld from the cache, %ld requests to LMS\n",
+		servedAnswers, servedCached, upstreamFetches);
+	closeBroker();
+	return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef BROKER_H
+#define BROKER_H 1
+
+#define BROKER_MAXCLIENTS	16
+#define BROKER_CACHE		32			// distinct commands cached
+#define BROKER_QUEUE		16			// outstanding requests of one client
+#define BROKER_TXSIZE		(4 * CLI_RXSIZE)
+#define BROKER_TTL			900			// ms a status or mixer answer is shared
+#define BROKER_LISTTTL		10000		// ms for the player list and server status
+
+int   runBroker(const char *listenOn);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ *	carousel.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The pages taking turns on the screen. Every page draws into a frame
+ *	buffer and a grid of terminal cells of its own, the screen shows the
+ *	ones of the current page: a turn is a switch of the buffers, after
+ *	which the display sends the spans that differ from what it shows and
+ *	the terminal the cells that changed. A page coming back is shown as
+ *	it was left unless its inputs changed while it was away; the pages
+ *	that do not follow their inputs on their own (quality, clock) are
+ *	drawn again only when the inputs change.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "logger.h"
+#include "display.h"
+#include "termscreen.h"
+#include "carousel.h"
+
+typedef struct {
+	uint8_t		frame[DISPLAY_PAGES][DISPLAY_WIDTH] __attribute__((aligned(16)));
+	uint32_t	cells[TERM_ROWS][TERM_COLS];
+	uint64_t	inputs;					// the frame is drawn for
+	int			drawn;
+} pageframe;
+
+const char *pageNames[MAXPAGES] = {"playing", "upnext", "system", "quality", "clock"};
+
+// drawing their changes while shown; the others are drawn in full or not at all
+const int pageLive[MAXPAGES] = {true, true, true, false, false};
+
+pageframe		pageFrames[MAXPAGES];
+pageturn		turns[MAXPAGES] = {{PAGE_PLAYING, 0}};
+int				turnCount = 1;
+int				turnAt    = 0;
+int				turnDwell = CAROUSEL_DWELL;		// s
+long			turnSince = 0;					// ns
+page_t			shownPage = MAXPAGES;			// of the last frame, MAXPAGES none yet
+carouselstats	turnStats = {0, 0, 0};
+
+const char *pageName(page_t page) {
+	return (page < MAXPAGES) ? pageNames[page] : "none";
+}
+
+const carouselstats *getCarouselStats(void) {
+	return &turnStats;
+}
+
+/*
+ * playing:15,quality,clock:5 - the pages in turn, each with its own
+ * seconds or the common ones. The count, -1 for a bad list.
+ */
+int parsePages(const char *spec, pageturn *list, int max) {
+	char buf[CAROUSEL_SPEC];
+	char *save;
+	int  count = 0;
+
+	if (strlen(spec) >= sizeof(buf))	{return -1;}
+	strcpy(buf, spec);
+
+	for (char *item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char *dwell = strchr(item, ':');
+		int  page;
+
+		while (*item == ' ')	{item++;}
+		if (dwell != NULL)		{*dwell++ = 0;}
+		for (int n = strlen(item); (n > 0) && (item[n - 1] == ' '); n--)	{item[n - 1] = 0;}
+
+		for (page = 0; (page < MAXPAGES) && (strcmp(item, pageNames[page]) != 0); page++);
+		if ((page == MAXPAGES) || (count == max))	{return -1;}
+		for (int i = 0; i < count; i++) {
+			if (list[i].page == page)	{return -1;}
+		}
+
+		list[count].page  = (page_t)page;
+		list[count].dwell = (dwell != NULL) ? atoi(dwell) : 0;
+		if ((dwell != NULL) && (list[count].dwell <= 0))	{return -1;}
+		count++;
+	}
+	return (count > 0) ? count : -1;
+}
+
+// the next frame enters the first page, every page drawn in full
+void setCarousel(const pageturn *list, int count, int dwell) {
+	memcpy(turns, list, count * sizeof(pageturn));
+	turnCount = count;
+	turnAt    = 0;
+	turnSince = 0;
+	if (dwell > 0)	{turnDwell = dwell;}
+	shownPage = MAXPAGES;
+	invalidatePages();
+}
+
+void invalidatePages(void) {
+	for (int i = 0; i < MAXPAGES; i++) {
+		pageFrames[i].drawn = false;
+	}
+}
+
+void carouselTurn(long now) {
+	if (turnCount < 2)	{return;}
+	if (turnSince == 0)	{turnSince = now;}
+
+	int dwell = (turns[turnAt].dwell > 0) ? turns[turnAt].dwell : turnDwell;
+	if (now - turnSince < dwell * 1000000000L)	{return;}
+
+	turnSince = now;
+	turnAt    = (turnAt + 1) % turnCount;
+}
+
+page_t carouselPage(void) {
+	return turns[turnAt].page;
+}
+
+page_t carouselShown(void) {
+	return shownPage;
+}
+
+// the buffers of page drawn to, shown by the next refresh; MAXPAGES the screen's own
+void drawPage(page_t page) {
+	if (page >= MAXPAGES) {
+		drawInto(NULL);
+		termInto(NULL);
+		return;
+	}
+	drawInto(&pageFrames[page].frame[0][0]);
+	termInto(&pageFrames[page].cells[0][0]);
+}
+
+/*
+ * The page of this frame, with the inputs it is drawn for. True when it
+ * has to be drawn in full: never drawn yet, coming in with other inputs
+ * than it was left with, or not a live page and its inputs changed.
+ */
+int showPage(page_t page, uint64_t inputs) {
+	pageframe *pf = &pageFrames[page];
+	int entering  = (page != shownPage);
+	int redraw    = !pf->drawn || ((inputs != pf->inputs) && (entering || !pageLive[page]));
+
+	drawPage(page);
+	shownPage  = page;
+	pf->drawn  = true;
+	pf->inputs = inputs;
+
+	if (entering) {
+		turnStats.turns++;
+		if (!redraw)	{turnStats.kept++;}
+		logMSG(LS_MAIN, LL_DEBUG, "Page %s%s\n", pageNames[page], redraw ? "" : ", as it was left");
+	}
+	if (redraw)	{turnStats.drawn++;}
+	return redraw;
+}
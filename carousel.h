@@ -0,0 +1,53 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef CAROUSEL_H
+#define CAROUSEL_H 1
+
+#include <stdint.h>
+
+#define CAROUSEL_DWELL	10			// s per page without -p or its own
+#define CAROUSEL_SPEC	128			// longest page list
+
+typedef enum {PAGE_PLAYING, PAGE_UPNEXT, PAGE_SYSTEM, PAGE_QUALITY, PAGE_CLOCK, MAXPAGES} page_t;
+
+typedef struct {
+	page_t	page;
+	int		dwell;					// s, 0 the common one
+} pageturn;
+
+typedef struct {
+	unsigned long	turns;
+	unsigned long	kept;			// shown from the frame they were left with
+	unsigned long	drawn;			// drawn in full
+} carouselstats;
+
+const char *pageName(page_t page);
+int    parsePages(const char *spec, pageturn *list, int max);
+void   setCarousel(const pageturn *list, int count, int dwell);
+void   carouselTurn(long now);
+page_t carouselPage(void);
+page_t carouselShown(void);
+int    showPage(page_t page, uint64_t inputs);
+void   drawPage(page_t page);
+void   invalidatePages(void);
+const carouselstats *getCarouselStats(void);
+
+#endif
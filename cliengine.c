@@ -0,0 +1,619 @@
+/*
+ *	cliengine.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Pipelined LMS CLI requests on a non-blocking socket.
+ *
+ *	Requests are queued, then written to the server with one syscall.
+ *	The CLI answers in order and every answer starts with the (encoded)
+ *	echo of its command, so a line is matched against the oldest request
+ *	in flight by its first two terms. Lines that do not match are
+ *	notifications (listen / subscribe) and go to the notify callback.
+ *	A request that misses its deadline breaks the ordering, so it fails
+ *	everything behind it and drops the connection.
+ *
+ *	With cliSetJSON() the same queue carries JSON-RPC requests over HTTP
+ *	instead (jsonrpc.c): the answers come in order too, each is scanned
+ *	into the sink of its request while it arrives, there is no echo to
+ *	match and no notification.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+#include "tagUtils.h"
+#include "cliengine.h"
+#include "trace.h"
+#include "jsonscan.h"
+#include "jsonrpc.h"
+
+#define MATCHLEN	64
+
+typedef struct CliRequest {
+	clistate_t	state;
+	char		term[2][MATCHLEN];	// first two terms of the command
+	long		deadline;			// ns, CLOCK_MONOTONIC
+	int			txEnd;				// its last byte in txBuff, sent once txOff is past it
+	char		*answer;
+	int			answerSize;
+	jsonfield_t	field;				// JSON-RPC: where the answer is scanned to
+	jsonvalue_t	value;
+	void		*ctx;
+} clireq;
+
+clireq		cliReq[CLI_MAXREQ];
+int			inFlight[CLI_MAXREQ];	// FIFO of request slots, oldest first
+int			flightHead  = 0;
+int			flightCount = 0;
+
+int			cliSock = -1;
+int			cliConnects = 0;		// a reconnect can get the same descriptor number
+int			connSock = -1;			// connect in progress
+struct sockaddr_in connAddr;
+char		txBuff[CLI_MAXREQ * CLI_CMDLEN];
+int			txLen = 0;
+int			txOff = 0;
+char		rxBuff[CLI_RXSIZE];
+int			rxLen  = 0;
+int			rxSkip = false;
+int			cliOffline = false;		// replay: requests go nowhere, answers come from cliFeed()
+clinotify_t	cliNotify = NULL;
+
+int			cliJSON = false;		// JSON-RPC over HTTP instead of the CLI
+char		cliHost[32];			// Host: of the requests
+httpres		httpRx;					// the answer coming in
+jsonscan	jsonRx;
+int			rxStarted = false;		// jsonRx set up for the oldest request
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long cliNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void failPending(clistate_t state) {
+	while (flightCount > 0) {
+		cliReq[inFlight[flightHead]].state = state;
+		flightHead = (flightHead + 1) % CLI_MAXREQ;
+		flightCount--;
+	}
+	flightHead = 0;
+	txLen = txOff = 0;
+}
+
+/*
+ * The connect goes on while the caller waits for the descriptor returned
+ * to become writable, cliConnectDone() then takes it as the CLI socket
+ */
+int cliConnectStart(in_addr_t addr, int port) {
+	int enable = 1;
+
+	cliClose();
+
+	if ((connSock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {return -1;}
+
+	setsockopt(connSock, IPPROTO_TCP, TCP_NODELAY,  &enable, sizeof(enable));
+	setsockopt(connSock, SOL_SOCKET,  SO_KEEPALIVE, &enable, sizeof(enable));
+#ifdef TCP_KEEPIDLE
+	int idle = 10, intvl = 5, cnt = 3;
+	setsockopt(connSock, IPPROTO_TCP, TCP_KEEPIDLE,  &idle,  sizeof(idle));
+	setsockopt(connSock, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+	setsockopt(connSock, IPPROTO_TCP, TCP_KEEPCNT,   &cnt,   sizeof(cnt));
+#endif
+
+	memset(&connAddr, 0, sizeof(connAddr));
+	connAddr.sin_family      = AF_INET;
+	connAddr.sin_addr.s_addr = addr;
+	connAddr.sin_port        = htons(port);
+
+	if ((connect(connSock, (struct sockaddr *)&connAddr, sizeof(connAddr)) < 0) && (errno != EINPROGRESS)) {
+		logMSG(LS_SLIM, LL_INFO, "Connect to %s:%d failed: %s\n", inet_ntoa(connAddr.sin_addr), port, strerror(errno));
+		cliClose();
+		return -1;
+	}
+	return connSock;
+}
+
+int cliConnectFD(void) {
+	return connSock;
+}
+
+/*
+ * 1 connected, 0 still going on, -1 failed
+ */
+int cliConnectDone(void) {
+	struct pollfd pfd = {connSock, POLLOUT, 0};
+	int    err  = 0;
+	socklen_t elen = sizeof(err);
+
+	if (connSock < 0)				{return -1;}
+	if (poll(&pfd, 1, 0) == 0)		{return 0;}
+
+	if ((getsockopt(connSock, SOL_SOCKET, SO_ERROR, &err, &elen) < 0) || (err != 0)) {
+		logMSG(LS_SLIM, LL_INFO, "Connect to %s:%d failed: %s\n",
+			inet_ntoa(connAddr.sin_addr), ntohs(connAddr.sin_port), strerror(err ? err : errno));
+		cliClose();
+		return -1;
+	}
+
+	cliSock  = connSock;
+	connSock = -1;
+	rxLen  = 0;
+	rxSkip = false;
+	snprintf(cliHost, sizeof(cliHost), "%s:%d", inet_ntoa(connAddr.sin_addr), ntohs(connAddr.sin_port));
+	cliConnects++;
+	return 1;
+}
+
+int cliConnect(in_addr_t addr, int port, int timeoutMS) {
+	struct pollfd pfd;
+	int    rc;
+
+	if ((pfd.fd = cliConnectStart(addr, port)) < 0)	{return -1;}
+	pfd.events = POLLOUT;
+	poll(&pfd, 1, timeoutMS);
+
+	if ((rc = cliConnectDone()) == 0) {
+		logMSG(LS_SLIM, LL_INFO, "Connect to %s:%d failed: timeout\n", inet_ntoa(connAddr.sin_addr), port);
+		cliClose();
+	}
+	return (rc > 0) ? cliSock : -1;
+}
+
+void cliClose(void) {
+	if (cliSock >= 0) {
+		close(cliSock);
+		cliSock = -1;
+	}
+	if (connSock >= 0) {
+		close(connSock);
+		connSock = -1;
+	}
+	failPending(CR_ERROR);
+	rxLen = 0;
+	httpReset(&httpRx);
+	rxStarted = false;
+}
+
+int cliFD(void) {
+	return cliSock;
+}
+
+// the connection cliFD() is of, a new one has to be watched again
+int cliConnection(void) {
+	return cliConnects;
+}
+
+int cliConnected(void) {
+	return (cliSock >= 0) || cliOffline;
+}
+
+void cliSetOffline(void) {
+	cliClose();
+	cliOffline = true;
+}
+
+void cliSetNotify(clinotify_t notify) {
+	cliNotify = notify;
+}
+
+// before cliConnect(): the wire of the next connection
+void cliSetJSON(int json) {
+	cliJSON = json;
+}
+
+int cliIsJSON(void) {
+	return cliJSON;
+}
+
+/*******************************************************************************
+ * Request side
+ ******************************************************************************/
+int cliQueue(const char *cmd, char *answer, int answerSize, int timeoutMS) {
+	int req;
+	int len = strlen(cmd);
+
+	if ((cliSock < 0) && !cliOffline)						{return -1;}
+	if (cliJSON)											{return -1;}
+	if (flightCount == CLI_MAXREQ)							{return -1;}
+	if ((len == 0) || (len + 1 > CLI_CMDLEN))				{return -1;}
+	if (txLen + len + 1 > (int)sizeof(txBuff))				{return -1;}
+
+	for (req = 0; (req < CLI_MAXREQ) && (cliReq[req].state != CR_FREE); req++);
+	if (req == CLI_MAXREQ)									{return -1;}
+
+	clireq *r = &cliReq[req];
+	r->term[0][0] = r->term[1][0] = 0;
+	sscanf(cmd, "%63s %63s", r->term[0], r->term[1]);
+	r->deadline   = cliNow() + timeoutMS * 1000000L;
+	r->answer     = answer;
+	r->answerSize = answerSize;
+	r->state      = CR_QUEUED;
+
+	memcpy(txBuff + txLen, cmd, len);
+	txLen += len;
+	if (cmd[len - 1] != '\n') {
+		txBuff[txLen++] = '\n';
+	}
+	r->txEnd = txLen;
+
+	r->field      = NULL;
+	r->value      = NULL;
+	r->ctx        = NULL;
+
+	inFlight[(flightHead + flightCount) % CLI_MAXREQ] = req;
+	flightCount++;
+
+	return req;
+}
+
+/*
+ * The command for player ("" for the server) as a JSON-RPC request, its
+ * answer scanned to field / value as it arrives
+ */
+int cliQueueJSON(const char *player, const char *cmd, jsonfield_t field, jsonvalue_t value, void *ctx, int timeoutMS) {
+	int req, len;
+
+	if (!cliJSON || (cliSock < 0))							{return -1;}
+	if (flightCount == CLI_MAXREQ)							{return -1;}
+
+	for (req = 0; (req < CLI_MAXREQ) && (cliReq[req].state != CR_FREE); req++);
+	if (req == CLI_MAXREQ)									{return -1;}
+
+	if ((len = rpcRequest(txBuff + txLen, sizeof(txBuff) - txLen, cliHost, player, cmd)) < 0)	{return -1;}
+	txLen += len;
+
+	clireq *r = &cliReq[req];
+	r->term[0][0] = r->term[1][0] = 0;
+	sscanf(cmd, "%63s %63s", r->term[0], r->term[1]);
+	r->deadline   = cliNow() + timeoutMS * 1000000L;
+	r->answer     = NULL;
+	r->answerSize = 0;
+	r->field      = field;
+	r->value      = value;
+	r->ctx        = ctx;
+	r->txEnd      = txLen;
+	r->state      = CR_QUEUED;
+
+	inFlight[(flightHead + flightCount) % CLI_MAXREQ] = req;
+	flightCount++;
+
+	return req;
+}
+
+/*
+ * Everything queued goes out in one write, a short write is finished when
+ * the socket becomes writable again. A request is sent once its own bytes
+ * are out: the server can answer it while the rest still waits.
+ */
+int cliFlush(void) {
+	int sent;
+
+	if (cliOffline) {
+		sent = txLen - txOff;
+	} else {
+		if (cliSock < 0)		{return -1;}
+		if (txOff == txLen)		{return 0;}
+
+		sent = write(cliSock, txBuff + txOff, txLen - txOff);
+	}
+	if (sent < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))	{return 0;}
+		logMSG(LS_SLIM, LL_INFO, "CLI write failed: %s\n", strerror(errno));
+		cliClose();
+		return -1;
+	}
+
+	txOff += sent;
+	for (int i = 0; i < flightCount; i++) {
+		clireq *r = &cliReq[inFlight[(flightHead + i) % CLI_MAXREQ]];
+		if ((r->state == CR_QUEUED) && (r->txEnd <= txOff)) {r->state = CR_SENT;}
+	}
+	if (txOff == txLen) {
+		txOff = txLen = 0;
+	}
+	return sent;
+}
+
+int cliWantWrite(void) {
+	return txOff < txLen;
+}
+
+clistate_t cliState(int req) {
+	if ((req < 0) || (req >= CLI_MAXREQ))	{return CR_ERROR;}
+	return cliReq[req].state;
+}
+
+void cliRelease(int req) {
+	if ((req < 0) || (req >= CLI_MAXREQ))	{return;}
+	if ((cliReq[req].state == CR_QUEUED) || (cliReq[req].state == CR_SENT))	{return;}
+	cliReq[req].state = CR_FREE;
+}
+
+int cliPending(void) {
+	return flightCount;
+}
+
+/*******************************************************************************
+ * Answer side
+ ******************************************************************************/
+int matchTerm(const char *line, const char *term, const char **next) {
+	char dec[MATCHLEN];
+	const char *end = strchr(line, ' ');
+	int  len = (end == NULL) ? (int)strlen(line) : end - line;
+
+	if (len >= MATCHLEN)	{return false;}
+	if (len == 0)			{return term[0] == 0;}
+
+	decode(line, dec);
+	*next = (end == NULL) ? line + len : end + 1;
+	return strcmp(dec, term) == 0;
+}
+
+void dispatchLine(char *line, int len) {
+	const char *next = line;
+
+	if (flightCount > 0) {
+		clireq *r = &cliReq[inFlight[flightHead]];
+
+		if ((r->state == CR_SENT) && matchTerm(next, r->term[0], &next) &&
+			((r->term[1][0] == 0) || matchTerm(next, r->term[1], &next))) {
+
+			if (r->answer != NULL) {
+				int n = (len < r->answerSize) ? len : r->answerSize - 1;
+				memcpy(r->answer, line, n);
+				r->answer[n] = 0;
+			}
+			r->state   = CR_DONE;
+			flightHead = (flightHead + 1) % CLI_MAXREQ;
+			flightCount--;
+			return;
+		}
+	}
+
+	if (cliNotify != NULL) {
+		cliNotify(line, len);
+	} else {
+		logMSG(LS_SLIM, LL_DEBUG, "Unmatched CLI line: %.60s\n", line);
+	}
+}
+
+/*
+ * HTTP answers, one for each request in order; -1 when the connection
+ * cannot go on
+ */
+int rpcFeed(const char *data, int len) {
+	int answers = 0;
+
+	while (len > 0) {
+		if ((flightCount == 0) || (cliReq[inFlight[flightHead]].state != CR_SENT)) {
+			logMSG(LS_SLIM, LL_INFO, "HTTP data without a request\n");
+			return -1;
+		}
+		clireq *r = &cliReq[inFlight[flightHead]];
+
+		if (!rxStarted) {
+			jsonStart(&jsonRx, r->field, r->value, r->ctx);
+			rxStarted = true;
+		}
+		int n = httpFeed(&httpRx, data, len, &jsonRx);
+		data += n;
+		len  -= n;
+
+		if (httpRx.state == HS_ERROR) {
+			logMSG(LS_SLIM, LL_INFO, "Bad HTTP answer to '%s %s'\n", r->term[0], r->term[1]);
+			return -1;
+		}
+		if (httpRx.state != HS_DONE)	{break;}
+
+		if ((httpRx.status != 200) || httpRx.bad || !jsonComplete(&jsonRx)) {
+			logMSG(LS_SLIM, LL_INFO, "JSON-RPC '%s %s' failed: HTTP %d%s\n", r->term[0], r->term[1],
+				httpRx.status, httpRx.bad ? ", not JSON" : "");
+			r->state = CR_ERROR;
+		} else {
+			r->state = CR_DONE;
+		}
+		flightHead = (flightHead + 1) % CLI_MAXREQ;
+		flightCount--;
+		answers++;
+
+		int close = httpRx.close;
+		httpReset(&httpRx);
+		rxStarted = false;
+		if (close) {
+			logMSG(LS_SLIM, LL_DEBUG, "Server closed the HTTP connection\n");
+			return -1;
+		}
+	}
+	return answers;
+}
+
+/*
+ * Split received bytes into lines - also the entry point of recorded traffic
+ */
+int cliFeed(const char *data, int len) {
+	int lines = 0;
+
+	while (len > 0) {
+		int n = (len < CLI_RXSIZE - rxLen) ? len : CLI_RXSIZE - rxLen;
+		memcpy(rxBuff + rxLen, data, n);
+		rxLen += n;
+		data  += n;
+		len   -= n;
+
+		char *start = rxBuff;
+		char *nl;
+		while ((nl = (char *)memchr(start, '\n', rxLen - (start - rxBuff))) != NULL) {
+			*nl = 0;
+			if (!rxSkip) {
+				dispatchLine(start, nl - start);
+				lines++;
+			}
+			rxSkip = false;
+			start  = nl + 1;
+		}
+
+		rxLen -= start - rxBuff;
+		memmove(rxBuff, start, rxLen);
+
+		if (rxLen == CLI_RXSIZE) {
+			// a line longer than the whole buffer, throw it away
+			logMSG(LS_SLIM, LL_INFO, "CLI line too long, dropped\n");
+			if (flightCount > 0) {
+				cliReq[inFlight[flightHead]].state = CR_ERROR;
+				flightHead = (flightHead + 1) % CLI_MAXREQ;
+				flightCount--;
+			}
+			rxLen  = 0;
+			rxSkip = true;
+		}
+	}
+	return lines;
+}
+
+int cliOnReadable(void) {
+	char buff[BSIZE];
+	int  bytes;
+
+	if (cliSock < 0) {return -1;}
+
+	while ((bytes = read(cliSock, buff, sizeof(buff))) > 0) {
+		if (!cliJSON) {
+			traceRecord(TR_CLI, buff, bytes);
+			cliFeed(buff, bytes);
+		} else if (rpcFeed(buff, bytes) < 0) {
+			cliClose();
+			return -1;
+		}
+	}
+
+	if ((bytes == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+		logMSG(LS_SLIM, LL_INFO, "CLI connection lost\n");
+		cliClose();
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * Deadlines
+ ******************************************************************************/
+long cliNextDeadline(void) {
+	long next = 0;
+
+	for (int i = 0; i < flightCount; i++) {
+		long d = cliReq[inFlight[(flightHead + i) % CLI_MAXREQ]].deadline;
+		if ((next == 0) || (d < next)) {next = d;}
+	}
+	return next;
+}
+
+int cliExpire(long now) {
+	for (int i = 0; i < flightCount; i++) {
+		clireq *r = &cliReq[inFlight[(flightHead + i) % CLI_MAXREQ]];
+
+		if (r->deadline <= now) {
+			logMSG(LS_SLIM, LL_INFO, "CLI request '%s %s' timed out\n", r->term[0], r->term[1]);
+			r->state = CR_TIMEOUT;
+			// the answers behind it can not be matched any more
+			for (int j = 0; j < flightCount; j++) {
+				clireq *o = &cliReq[inFlight[(flightHead + j) % CLI_MAXREQ]];
+				if ((o->state == CR_QUEUED) || (o->state == CR_SENT)) {o->state = CR_ERROR;}
+			}
+			flightCount = 0;
+			cliClose();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Blocking driver for the thread mode: run the socket until every queued
+ * request is answered, expired, or timeoutMS elapsed.
+ */
+int cliPump(int timeoutMS) {
+	long end = cliNow() + timeoutMS * 1000000L;
+
+	if (cliFlush() < 0)	{return -1;}
+
+	while ((flightCount > 0) && (cliSock >= 0)) {
+		long now  = cliNow();
+		long next = cliNextDeadline();
+		if ((next == 0) || (next > end)) {next = end;}
+
+		if (cliExpire(now) > 0)		{return -1;}
+		if (now >= end)				{return flightCount;}
+
+		struct pollfd pfd;
+		pfd.fd     = cliSock;
+		pfd.events = POLLIN | (cliWantWrite() ? POLLOUT : 0);
+
+		int rc = poll(&pfd, 1, (int)((next - now) / 1000000L) + 1);
+		if (rc < 0) {
+			if (errno == EINTR)	{continue;}
+			return -1;
+		}
+		if (rc == 0)			{continue;}
+
+		if (pfd.revents & POLLOUT) {
+			if (cliFlush() < 0)			{return -1;}
+		}
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			if (cliOnReadable() < 0)	{return -1;}
+		}
+	}
+	return (cliSock >= 0) ? 0 : -1;
+}
+
+int cliRequest(const char *cmd, char *answer, int answerSize, int timeoutMS) {
+	int req;
+
+	if ((req = cliQueue(cmd, answer, answerSize, timeoutMS)) < 0)	{return -1;}
+	cliPump(timeoutMS);
+
+	int rc = (cliState(req) == CR_DONE) ? 0 : -1;
+	cliRelease(req);
+	return rc;
+}
+
+int cliRequestJSON(const char *player, const char *cmd, jsonfield_t field, jsonvalue_t value, void *ctx, int timeoutMS) {
+	int req;
+
+	if ((req = cliQueueJSON(player, cmd, field, value, ctx, timeoutMS)) < 0)	{return -1;}
+	cliPump(timeoutMS);
+
+	int rc = (cliState(req) == CR_DONE) ? 0 : -1;
+	cliRelease(req);
+	return rc;
+}
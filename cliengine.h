@@ -0,0 +1,65 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef CLIENGINE_H
+#define CLIENGINE_H 1
+
+#include <netinet/in.h>
+
+#include "jsonscan.h"
+
+#define CLI_MAXREQ		8
+#define CLI_CMDLEN		512
+#define CLI_RXSIZE		(16 * 1024)
+#define CLI_DEADLINE	2000		// ms
+
+typedef enum {CR_FREE, CR_QUEUED, CR_SENT, CR_DONE, CR_TIMEOUT, CR_ERROR} clistate_t;
+
+typedef void (*clinotify_t)(char *line, int len);
+
+int   cliConnect(in_addr_t addr, int port, int timeoutMS);
+int   cliConnectStart(in_addr_t addr, int port);
+int   cliConnectFD(void);
+int   cliConnectDone(void);
+void  cliClose(void);
+int   cliFD(void);
+int   cliConnection(void);
+int   cliConnected(void);
+void  cliSetOffline(void);
+void  cliSetNotify(clinotify_t notify);
+void  cliSetJSON(int json);
+int   cliIsJSON(void);
+
+int   cliQueue(const char *cmd, char *answer, int answerSize, int timeoutMS);
+int   cliQueueJSON(const char *player, const char *cmd, jsonfield_t field, jsonvalue_t value, void *ctx, int timeoutMS);
+int   cliFlush(void);
+int   cliWantWrite(void);
+int   cliOnReadable(void);
+int   cliFeed(const char *data, int len);
+int   cliExpire(long now);
+long  cliNextDeadline(void);
+int   cliPending(void);
+int   cliPump(int timeoutMS);
+clistate_t cliState(int req);
+void  cliRelease(int req);
+int   cliRequest(const char *cmd, char *answer, int answerSize, int timeoutMS);
+int   cliRequestJSON(const char *player, const char *cmd, jsonfield_t field, jsonvalue_t value, void *ctx, int timeoutMS);
+
+#endif
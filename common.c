@@ -22,8 +22,10 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
+#include <errno.h>
 
 #include "common.h"
+#include "logger.h"
 
 int verbose = 0;
 int textOut = false;
@@ -40,9 +42,7 @@ int getVerbose(void) {
 }
 
 int putMSG (const char *msg, int loglevel) {
-	if (loglevel > verbose) {return false;}
-	printf ("%s", msg);
-	return true;
+	return logMSG(LS_MAIN, loglevel, "%s", msg);
 }
 
 void enableTOut(void) {
@@ -51,11 +51,12 @@ void enableTOut(void) {
 
 int tOut(const char *msg) {
 	if (!textOut) 	{return false;}
-	printf ("%s", msg);
-	return true;
+	return logRaw(msg);
 }
 
 void abort(const char *msg) {
-	perror(msg);
+	int err = errno;
+	logERR(LS_MAIN, "%s: %s\n", msg, strerror(err));
+	closeLogger();
 	exit(1);
 }
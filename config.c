@@ -0,0 +1,263 @@
+/*
+ *	config.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The configuration file (-c): key = value lines, # comments. The
+ *	directory is watched with inotify, so an editor saving through a
+ *	rename is seen too. A changed file is read whole into a new config;
+ *	with an error in it the old one stays. configChanged() is called at a
+ *	frame boundary, the main loop applies the difference there.
+ *
+ *	player = Kitchen			follow = yes|no
+ *	server = 192.168.1.2:9090	soundcard = hw:CARD=IQaudIODAC
+ *	line1 = composer,artist		(line1 to line4, tags tried in turn)
+ *	font = prop|fixed			atlas = /usr/share/lmsmonitor/latin.atlas
+ *	refresh = 1000				(ms)
+ *	poll_sparse, poll_near, poll_dense, poll_stream, poll_idle,
+ *	poll_idle_max, poll_unnotified = ms
+ *	page_seconds = 10			upnext = yes|no		system = 2000 (ms, 0 off)
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/inotify.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+
+#define EVENT_BUF	4096
+
+char	configPath[CONFIG_PATH];
+char	configDir[CONFIG_PATH];
+char	configName[CONFIG_PATH];
+int		inotifyFD = -1;
+config	configs[2];
+int		configAt = 0;				// configs[configAt] is in use
+
+const char *tagNames[MAXTAG_TYPES] = {
+	"samplesize", "samplerate", "time", "duration", "title", "album",
+	"artist", "albumartist", "composer", "conductor", "mode"
+};
+
+const config *configNow(void) {
+	return &configs[configAt];
+}
+
+const config *configBefore(void) {
+	return &configs[configAt ^ 1];
+}
+
+/*******************************************************************************
+ * Parsing
+ ******************************************************************************/
+void emptyConfig(config *c) {
+	memset(c, 0, sizeof(*c));
+	c->follow     = -1;
+	c->font       = -1;
+	c->upNext     = -1;
+	c->systemRate = -1;
+}
+
+char *trim(char *s) {
+	while (isspace((unsigned char)*s))	{s++;}
+	for (int n = strlen(s); (n > 0) && isspace((unsigned char)s[n - 1]); n--) {
+		s[n - 1] = 0;
+	}
+	return s;
+}
+
+int parseFlag(const char *val) {
+	if ((strcmp(val, "yes") == 0) || (strcmp(val, "on") == 0) || (strcmp(val, "1") == 0))	{return 1;}
+	if ((strcmp(val, "no") == 0) || (strcmp(val, "off") == 0) || (strcmp(val, "0") == 0))	{return 0;}
+	return -1;
+}
+
+// a positive number of ms, -1 if it is not one
+long parseMS(const char *val, long min) {
+	char *end;
+	long ms = strtol(val, &end, 10);
+
+	return ((*end == 0) && (end != val) && (ms >= min)) ? ms : -1;
+}
+
+// composer,artist - the tags of a line, none for an empty line
+int parseLine(char *val, tagtypes_t *line) {
+	int n = 0;
+
+	line[0] = MAXTAG_TYPES;
+	if (strcmp(val, "none") == 0)	{return 0;}
+
+	for (char *name = strtok(val, ","); name != NULL; name = strtok(NULL, ",")) {
+		int t;
+		name = trim(name);
+		for (t = 0; (t < MAXTAG_TYPES) && (strcmp(name, tagNames[t]) != 0); t++);
+		if ((t == MAXTAG_TYPES) || (n == CONFIG_TAGS))	{return -1;}
+		line[n++] = (tagtypes_t)t;
+		line[n]   = MAXTAG_TYPES;
+	}
+	return (n > 0) ? 0 : -1;
+}
+
+int copyValue(char *to, const char *val, size_t size) {
+	if ((*val == 0) || (strlen(val) >= size))	{return -1;}
+	strcpy(to, val);
+	return 0;
+}
+
+int parseKey(config *c, const char *key, char *val) {
+	long ms;
+
+	if (strcmp(key, "player") == 0)		{return copyValue(c->player, val, sizeof(c->player));}
+	if (strcmp(key, "server") == 0)		{return copyValue(c->server, val, sizeof(c->server));}
+	if (strcmp(key, "soundcard") == 0)	{return copyValue(c->soundcard, val, sizeof(c->soundcard));}
+	if (strcmp(key, "atlas") == 0)		{return copyValue(c->atlas, val, sizeof(c->atlas));}
+	if (strcmp(key, "follow") == 0)		{return ((c->follow = parseFlag(val)) < 0) ? -1 : 0;}
+	if (strcmp(key, "upnext") == 0)		{return ((c->upNext = parseFlag(val)) < 0) ? -1 : 0;}
+
+	if ((strncmp(key, "line", 4) == 0) && (key[4] >= '1') && (key[4] < '1' + CONFIG_LINES) && (key[5] == 0)) {
+		c->lineSet[key[4] - '1'] = true;
+		return parseLine(val, c->layout[key[4] - '1']);
+	}
+
+	if (strcmp(key, "font") == 0) {
+		if (strcmp(val, "prop") == 0)		{c->font = FONT_PROP;}
+		else if (strcmp(val, "fixed") == 0)	{c->font = FONT_FIXED;}
+		return (c->font < 0) ? -1 : 0;
+	}
+
+	if (strcmp(key, "system") == 0)		{return ((c->systemRate = parseMS(val, 0)) < 0) ? -1 : 0;}
+	if (strcmp(key, "pages") == 0) {
+		pageturn list[MAXPAGES];
+		return (parsePages(val, list, MAXPAGES) < 0) ? -1 : copyValue(c->pages, val, sizeof(c->pages));
+	}
+	if (strcmp(key, "page_seconds") == 0) {
+		return ((c->pageSeconds = parseMS(val, 1)) < 0) ? -1 : 0;
+	}
+	if (strcmp(key, "refresh") == 0)	{return ((c->refresh = parseMS(val, 100)) < 0) ? -1 : 0;}
+
+	struct {const char *name; long *value;} polls[] = {
+		{"poll_sparse", &c->poll.sparse}, {"poll_near", &c->poll.near}, {"poll_dense", &c->poll.dense},
+		{"poll_stream", &c->poll.stream}, {"poll_idle", &c->poll.idle}, {"poll_idle_max", &c->poll.idleMax},
+		{"poll_unnotified", &c->poll.unnotified},
+	};
+	for (unsigned i = 0; i < sizeof(polls) / sizeof(polls[0]); i++) {
+		if (strcmp(key, polls[i].name) == 0) {
+			return ((ms = parseMS(val, 100)) < 0) ? -1 : (*polls[i].value = ms, 0);
+		}
+	}
+	return -1;
+}
+
+int loadConfig(config *c) {
+	char line[BSIZE];
+	int  lineNo = 0;
+
+	FILE *f = fopen(configPath, "r");
+	if (f == NULL) {
+		logERR(LS_MAIN, "Cannot read %s: %s\n", configPath, strerror(errno));
+		return -1;
+	}
+
+	emptyConfig(c);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineNo++;
+		char *hash = strchr(line, '#');
+		if (hash != NULL)	{*hash = 0;}
+
+		char *key = trim(line);
+		if (*key == 0)		{continue;}
+
+		char *eq = strchr(key, '=');
+		if (eq != NULL)		{*eq = 0;}
+		if ((eq == NULL) || (parseKey(c, trim(key), trim(eq + 1)) < 0)) {
+			logERR(LS_MAIN, "%s:%d: bad setting, file not taken\n", configPath, lineNo);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int initConfig(const char *path) {
+	if (strlen(path) >= CONFIG_PATH)	{return -1;}
+
+	strcpy(configPath, path);
+	strcpy(configDir, path);
+	char *slash = strrchr(configDir, '/');
+	if (slash == NULL) {
+		strcpy(configDir, ".");
+		strcpy(configName, path);
+	} else {
+		strcpy(configName, slash + 1);
+		if (slash == configDir)	{slash++;}
+		*slash = 0;
+	}
+
+	emptyConfig(&configs[configAt ^ 1]);
+	if (loadConfig(&configs[configAt]) < 0)	{return -1;}
+
+	if (((inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) ||
+		(inotify_add_watch(inotifyFD, configDir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+		logERR(LS_MAIN, "Cannot watch %s: %s, changes need a restart\n", configDir, strerror(errno));
+		closeConfig();
+	}
+	logMSG(LS_MAIN, LL_INFO, "Configuration %s\n", configPath);
+	return 0;
+}
+
+void closeConfig(void) {
+	if (inotifyFD >= 0) {
+		close(inotifyFD);
+		inotifyFD = -1;
+	}
+}
+
+/*
+ * One non blocking read of the watch: true when the file was written and
+ * read without error, configNow() is the new one then
+ */
+int configChanged(void) {
+	char buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int  written = false;
+	ssize_t n;
+
+	if (inotifyFD < 0)	{return false;}
+
+	while ((n = read(inotifyFD, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + n; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			if ((ev->len > 0) && (strcmp(ev->name, configName) == 0))	{written = true;}
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+	if (!written)	{return false;}
+
+	if (loadConfig(&configs[configAt ^ 1]) < 0)	{return false;}
+	configAt ^= 1;
+	logMSG(LS_MAIN, LL_INFO, "Configuration %s changed\n", configPath);
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H 1
+
+#include "sliminfo.h"
+#include "players.h"
+#include "pollsched.h"
+#include "fonts.h"
+#include "carousel.h"
+
+#define CONFIG_LINES	4			// tag lines of the now playing page
+#define CONFIG_TAGS		3			// tags tried for a line, the first valid is shown
+#define CONFIG_PATH		256
+
+/*
+ * A key missing from the file is 0, "" or -1 below: the command line or
+ * built in value stays
+ */
+typedef struct {
+	char		player[PLAYER_NAMELEN];
+	int			follow;							// -1
+	char		server[128];
+	char		soundcard[64];
+	int			lineSet[CONFIG_LINES];
+	tagtypes_t	layout[CONFIG_LINES][CONFIG_TAGS + 1];	// MAXTAG_TYPES ends a line
+	int			font;							// fontid_t, -1
+	char		atlas[CONFIG_PATH];
+	int			refresh;						// ms
+	pollpolicy	poll;							// ms each, 0
+	int			pageSeconds;
+	int			upNext;							// -1
+	int			systemRate;						// ms, -1; 0 no system page
+	char		pages[CAROUSEL_SPEC];			// playing:20,quality,clock
+} config;
+
+int   initConfig(const char *path);
+void  closeConfig(void);
+int   configChanged(void);
+const config *configNow(void);
+const config *configBefore(void);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ *	discovery.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	LMS server discovery with the TLV request of the slimproto discovery
+ *	protocol: 'e' followed by the tags we want answered, the server replies
+ *	'E' followed by TAG(4) LEN(1) VALUE(LEN) triplets.
+ *
+ *	The request goes out on the broadcast address of every active interface
+ *	at once, every answer arriving in a short window is collected.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+#include "discovery.h"
+
+// request: 'e' + tag + zero length for every value we ask for
+const char discRequest[] = "e" "NAME\0" "JSON\0" "VERS\0" "UUID\0" "CLIP\0";
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long discNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void tlvString(char *dest, int destSize, const unsigned char *val, int len) {
+	if (len >= destSize) {len = destSize - 1;}
+	memcpy(dest, val, len);
+	dest[len] = 0;
+}
+
+int tlvNumber(const unsigned char *val, int len) {
+	char num[8];
+	tlvString(num, sizeof(num), val, len);
+	return atoi(num);
+}
+
+int parseAnswer(const unsigned char *buf, int len, lmsserver *server) {
+	const unsigned char *p   = buf + 1;
+	const unsigned char *end = buf + len;
+
+	if ((len < 1) || (buf[0] != 'E'))	{return -1;}
+
+	server->cliPort  = DEFAULT_CLIPORT;
+	server->jsonPort = 0;
+	server->name[0] = server->uuid[0] = server->version[0] = 0;
+
+	while (p + 5 <= end) {
+		int vlen = p[4];
+		const unsigned char *val = p + 5;
+		if (val + vlen > end)	{break;}
+
+		if      (memcmp(p, "NAME", 4) == 0)	{tlvString(server->name,    sizeof(server->name),    val, vlen);}
+		else if (memcmp(p, "UUID", 4) == 0)	{tlvString(server->uuid,    sizeof(server->uuid),    val, vlen);}
+		else if (memcmp(p, "VERS", 4) == 0)	{tlvString(server->version, sizeof(server->version), val, vlen);}
+		else if (memcmp(p, "JSON", 4) == 0)	{server->jsonPort = tlvNumber(val, vlen);}
+		else if (memcmp(p, "CLIP", 4) == 0)	{server->cliPort  = tlvNumber(val, vlen);}
+
+		p = val + vlen;
+	}
+	return 0;
+}
+
+int serverMatches(const char *selector, const lmsserver *server) {
+	return (selector == NULL) ||
+		(strcasecmp(selector, server->name) == 0) || (strcasecmp(selector, server->uuid) == 0);
+}
+
+/*
+ * Send the request on all interfaces, the answers come in on the socket
+ * returned, read them with discoveryAnswer()
+ */
+int discoverySend(void) {
+	struct ifaddrs *ifList, *ifa;
+	struct sockaddr_in d;
+	int    enable = 1;
+	int    sent   = 0;
+
+	int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (sock < 0) {return -1;}
+	setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (const void *)&enable, sizeof(enable));
+
+	memset(&d, 0, sizeof(d));
+	d.sin_family = AF_INET;
+	d.sin_port   = htons(DISC_PORT);
+
+	if (getifaddrs(&ifList) == 0) {
+		for (ifa = ifList; ifa != NULL; ifa = ifa->ifa_next) {
+			if ((ifa->ifa_addr == NULL) || (ifa->ifa_addr->sa_family != AF_INET))	{continue;}
+			if (!(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK))		{continue;}
+			if (!(ifa->ifa_flags & IFF_BROADCAST) || (ifa->ifa_broadaddr == NULL))	{continue;}
+
+			d.sin_addr = ((struct sockaddr_in *)ifa->ifa_broadaddr)->sin_addr;
+			if (sendto(sock, discRequest, sizeof(discRequest) - 1, 0, (struct sockaddr *)&d, sizeof(d)) > 0) {
+				logMSG(LS_SLIM, LL_DEBUG, "Discovery sent on %s (%s)\n", ifa->ifa_name, inet_ntoa(d.sin_addr));
+				sent++;
+			}
+		}
+		freeifaddrs(ifList);
+	}
+
+	if (sent == 0) {
+		d.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+		if (sendto(sock, discRequest, sizeof(discRequest) - 1, 0, (struct sockaddr *)&d, sizeof(d)) < 0) {
+			logMSG(LS_SLIM, LL_INFO, "Error sending disovery\n");
+		}
+	}
+	return sock;
+}
+
+/*
+ * One answer from the socket, -1 when there is none (the socket does not
+ * block) or it is not one
+ */
+int discoveryAnswer(int sock, lmsserver *server) {
+	unsigned char readbuf[512];
+	struct sockaddr_in s;
+	socklen_t slen = sizeof(s);
+
+	int len = recvfrom(sock, readbuf, sizeof(readbuf), 0, (struct sockaddr *)&s, &slen);
+	if (parseAnswer(readbuf, len, server) < 0)	{return -1;}
+
+	server->addr = s.sin_addr.s_addr;
+	logMSG(LS_SLIM, LL_INFO, "Got response from: %s:%d name:%s version:%s cli:%d\n",
+		inet_ntoa(s.sin_addr), ntohs(s.sin_port), server->name, server->version, server->cliPort);
+	return 0;
+}
+
+/*
+ * Collect the answers for windowMS, or only until a server matching
+ * selector answered
+ */
+int discoverServers(lmsserver *found, int maxFound, int windowMS, const char *selector) {
+	int count = 0;
+	int sock  = discoverySend();
+	if (sock < 0) {return -1;}
+
+	long end = discNow() + windowMS;
+	struct pollfd pollinfo = {sock, POLLIN, 0};
+
+	for (long now = discNow(); (now < end) && (count < maxFound); now = discNow()) {
+		if (poll(&pollinfo, 1, end - now) != 1)					{continue;}
+		if (discoveryAnswer(sock, &found[count]) < 0)			{continue;}
+
+		// the same server answers once per interface it was reached on
+		int dup = false;
+		for (int i = 0; i < count; i++) {
+			dup |= (found[i].addr == found[count].addr);
+		}
+		if (dup)	{continue;}
+		count++;
+
+		// startup waits for this one, no need to sit out the window
+		if (serverMatches(selector, &found[count - 1]))	{break;}
+	}
+
+	close(sock);
+	return count;
+}
+
+/*
+ * selector: server name or UUID, NULL takes the first that answers.
+ * Retries with a growing window until a matching server shows up.
+ */
+int findServer(const char *selector, lmsserver *server) {
+	lmsserver found[MAXSERVERS];
+	int window = DISC_WINDOW;
+
+	while (true) {
+		logMSG(LS_SLIM, LL_INFO, "Sending discovery...\n");
+		int count = discoverServers(found, MAXSERVERS, window, selector);
+
+		for (int i = 0; i < count; i++) {
+			if (serverMatches(selector, &found[i])) {
+				memcpy(server, &found[i], sizeof(lmsserver));
+				return 0;
+			}
+		}
+
+		if (count < 0)	{sleep(1);}
+		window = (window * 2 > DISC_MAXWINDOW) ? DISC_MAXWINDOW : window * 2;
+	}
+	return -1;
+}
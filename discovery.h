@@ -0,0 +1,48 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef DISCOVERY_H
+#define DISCOVERY_H 1
+
+#include <netinet/in.h>
+
+#define DISC_PORT		3483
+#define DISC_WINDOW		100			// ms to collect answers
+#define DISC_MAXWINDOW	1600
+#define MAXSERVERS		8
+#define DEFAULT_CLIPORT	9090
+#define DEFAULT_JSONPORT	9000
+
+typedef struct LMSServer {
+	in_addr_t	addr;
+	int			cliPort;
+	int			jsonPort;
+	char		name[64];
+	char		uuid[64];
+	char		version[32];
+} lmsserver;
+
+int   discoverySend(void);
+int   discoveryAnswer(int sock, lmsserver *server);
+int   serverMatches(const char *selector, const lmsserver *server);
+int   discoverServers(lmsserver *found, int maxFound, int windowMS, const char *selector);
+int   findServer(const char *selector, lmsserver *server);
+
+#endif
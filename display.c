@@ -26,101 +26,317 @@
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 
+#include "common.h"
 #include "display.h"
+#include "fonts.h"
+#include "logger.h"
+#include "metrics.h"
+#include "fbstream.h"
+#include "i2cbus.h"
+#include "kernels.h"
 
-#ifdef __arm__
+#define SH1106_OFFSET	2			// 132 column RAM, the visible 128 start at 2
 
-#include "ArduiPi_OLED_lib.h"
-#include "Adafruit_GFX.h"
-#include "ArduiPi_OLED.h"
+#define SH1106_CMD		0x80		// control byte: one command, an other control byte follows
+#define SH1106_CMDS		0x00		// control byte: commands up to the STOP
+#define SH1106_DATA		0x40		// control byte: data up to the STOP
 
-#define SLEEP_TIME	(25000/25)
+// SH1106 128x64 set up, charge pump on
+const uint8_t sh1106Init[] = {
+	SH1106_CMDS,
+	0xAE,				// display off
+	0xD5, 0x80,			// clock divide
+	0xA8, 0x3F,			// multiplex 64
+	0xD3, 0x00,			// display offset
+	0x40,				// start line 0
+	0xAD, 0x8B,			// DC-DC on
+	0xA1,				// segment remap
+	0xC8,				// COM scan from the bottom
+	0xDA, 0x12,			// COM pins
+	0x81, 0xCF,			// contrast
+	0xD9, 0x1F,			// precharge
+	0xDB, 0x40,			// VCOM deselect
+	0xA4,				// show the RAM
+	0xA6,				// not inverted
+};
 
-ArduiPi_OLED 		display;
-int sleep_divisor	= 1 ;
-int oledType		= OLED_SH1106_I2C_128x64;
+const char *busSpec = NULL;		// -i, NULL the default bus on the Pi
+fontid_t    textFont = FONT_PROP;	// of the centered and scrolled lines
 
-#endif
+// page major like the SH1106 RAM: one byte is 8 vertical pixels, LSB on top
+uint8_t frameBuf[DISPLAY_PAGES][DISPLAY_WIDTH] __attribute__((aligned(16)));
+
+// the frame drawn to and shown: frameBuf, or an off screen one of a page
+uint8_t (*drawBuf)[DISPLAY_WIDTH] = frameBuf;
+
+// what the controller shows, to send the changed spans only
+uint8_t shownBuf[DISPLAY_PAGES][DISPLAY_WIDTH];
+int     shownLost = false;		// a transfer failed: not known, every page is sent again
+
+int  maxCharacter(void) { return DISPLAY_WIDTH / CHAR_WIDTH; }
+
+int  maxLine(void)		{ return DISPLAY_PAGES; }
 
-int  maxCharacter(void) { return  21; }
+int  maxXPixel(void)	{ return DISPLAY_WIDTH; }
 
-int  maxLine(void)		{ return   8; }
+int  maxYPixel(void)	{ return DISPLAY_PAGES * 8; }
 
-int  maxXPixel(void)	{ return 128; }
+const uint8_t *frameBuffer(void) { return &drawBuf[0][0]; }
 
-int  maxYPixel(void)	{ return  64; }
+void drawInto(uint8_t *frame)	{ drawBuf = (frame != NULL) ? (uint8_t (*)[DISPLAY_WIDTH])frame : frameBuf; }
+
+void setTextFont(fontid_t font) { textFont = font; }
+
+fontid_t getTextFont(void)	{ return textFont; }
 
-#ifdef __arm__
 /**********************************************************************
-*
+* Frame buffer drawing, a page row span at a time with the kernels
+* picked for the CPU, see kernels.c
 **********************************************************************/
-int initDisplay(void) {
-	if ( !display.init(OLED_I2C_RESET,oledType) ) {
-		return EXIT_FAILURE;
+
+void fillRect(int x, int y, int w, int h, int color) {
+	if (x < 0)						{w += x; x = 0;}
+	if (y < 0)						{h += y; y = 0;}
+	if (x + w > DISPLAY_WIDTH)		{w = DISPLAY_WIDTH - x;}
+	if (y + h > maxYPixel())		{h = maxYPixel() - y;}
+	if ((w <= 0) || (h <= 0))		{return;}
+
+	for (int row = y; row < y + h; row = (row | 7) + 1) {
+		int top    = row & 7;
+		int bottom = ((y + h - 1) >> 3 == row >> 3) ? (y + h - 1) & 7 : 7;
+		uint8_t mask = (0xFF >> (7 - bottom)) & (0xFF << top);
+		kern.fillSpan(&drawBuf[row >> 3][x], w, mask, color ? 0xFF : 0);
 	}
+}
 
-	display.begin();
+/*
+ * Columns of up to 25 rows from y, LSB on top, w of them from x. The
+ * pixels of the rectangle are replaced, the rest of the pages are kept.
+ */
+void blitColumns(int x, int y, int w, int h, const uint32_t *cols) {
+	uint8_t bytes[DISPLAY_WIDTH];
 
-	display.clearDisplay();			// clears the screen  buffer
-	display.setTextSize(1);
-	display.setTextColor(WHITE);
-	display.display();				// display it (clear display)
+	if (x < 0)						{w += x; cols -= x; x = 0;}
+	if (x + w > DISPLAY_WIDTH)		{w = DISPLAY_WIDTH - x;}
+	if ((w <= 0) || (h <= 0) || (h > 25) || (y < 0))	{return;}
 
-	return 0;
+	int      shift = y & 7;
+	uint32_t mask  = ((1u << h) - 1) << shift;
+
+	for (int page = y >> 3; mask && (page < DISPLAY_PAGES); page++, shift -= 8, mask >>= 8) {
+		for (int i = 0; i < w; i++) {
+			bytes[i] = (shift >= 0) ? cols[i] << shift : cols[i] >> -shift;
+		}
+		kern.blitSpan(&drawBuf[page][x], bytes, w, mask & 0xFF);
+	}
 }
 
-//********************************************************************
-void closeDisplay(void) {
-	display.clearDisplay();
+void clearDisplay(void) {
+	memset(drawBuf, 0, DISPLAY_FRAME);
+}
 
-	// Free PI GPIO ports
-	display.close();
+/*
+ * Opaque text: the glyph cells are cleared as they are drawn. Clipped to
+ * the screen, returns the x after the last glyph.
+ */
+int drawText(fontid_t font, int x, int y, const char *text) {
+	uint32_t cols[DISPLAY_WIDTH];
+	int height = fontHeight(font);
+	int prev   = -1;
+	int first  = DISPLAY_WIDTH;
+	int last   = 0;
+
+	for (int g; (g = nextCodepoint(&text)) >= 0; prev = g) {
+		x += glyphKern(font, prev, g);
+		int adv = glyphAdvance(font, g);
+
+		if (x >= DISPLAY_WIDTH)		{break;}
+		for (int col = (x < 0) ? -x : 0; (col < adv) && (x + col < DISPLAY_WIDTH); col++) {
+			if (last == 0)			{first = last = x + col;}
+			if (first > x + col)	{first = x + col;}
+			for (; last <= x + col; last++) {
+				cols[last] = 0;
+			}
+			cols[x + col] = glyphColumn(font, g, col);
+		}
+		x += adv;
+	}
 
-	return;
+	if (first < last) {
+		blitColumns(first, y, last - first, height, cols + first);
+	}
+	return x;
 }
 
 //********************************************************************
 void drawHorizontalBargraph(int x, int y, int w, int h, int percent) {
+	uint32_t cols[DISPLAY_WIDTH];
+
 	if (x == -1) {
 		x = 0;
-		w = display.width();
+		w = maxXPixel();
 	}
 
 	if (y == -1) {
-		y = display.height() - h;
+		y = maxYPixel() - h;
 	}
 
-	display.fillRect(				x, y, (int16_t) w, h, 0);
-	display.drawHorizontalBargraph(	x, y, (int16_t) w, h, 1, (uint16_t) percent);
+	if (percent > 100)	{percent = 100;}
+	if (percent < 0)	{percent = 0;}
 
-	return;
-}
+	if ((w < 2) || (w > DISPLAY_WIDTH) || (h < 2) || (h > 25)) {
+		fillRect(x,         y,         w,                        h,     0);
+		fillRect(x,         y,         w,                        1,     1);
+		fillRect(x,         y + h - 1, w,                        1,     1);
+		fillRect(x,         y,         1,                        h,     1);
+		fillRect(x + w - 1, y,         1,                        h,     1);
+		fillRect(x + 1,     y + 1,     ((w - 2) * percent) / 100, h - 2, 1);
+		return;
+	}
 
-void refreshDisplay(void) {
-	display.display();
-}
+	// outline and bar built as columns, one pass over the pages
+	uint32_t full  = (1u << h) - 1;
+	uint32_t frame = 1u | (1u << (h - 1));
+	int      bar   = ((w - 2) * percent) / 100;
 
+	cols[0] = cols[w - 1] = full;
+	for (int i = 1; i < w - 1; i++) {
+		cols[i] = (i <= bar) ? full : frame;
+	}
+	blitColumns(x, y, w, h, cols);
+}
 
 //********************************************************************
 void putText(int x, int y, char *buff) {
-	display.setTextSize(1);
-	display.fillRect( x, y, (int16_t) strlen(buff) * CHAR_WIDTH, CHAR_HEIGHT, 0);
-	display.setCursor(x, y);
-	display.print(buff);
+	drawText(FONT_FIXED, x, y, buff);
+}
+
+void putTextFont(fontid_t font, int x, int y, char *buff) {
+	drawText(font, x, y, buff);
 }
 
 //********************************************************************
 void clearLine(int y) {
-	display.fillRect( 0, y, maxXPixel(), CHAR_HEIGHT, 0);
+	fillRect(0, y, maxXPixel(), CHAR_HEIGHT, 0);
 }
 
 //********************************************************************
 void putTextToCenter(int y, char *buff) {
-	int tlen = strlen(buff);
-	int px = maxCharacter() < tlen ? 0 : (maxXPixel() - (tlen * CHAR_WIDTH)) / 2;
+	int width = textWidth(textFont, buff);
+
 	clearLine(y);
-	putText(px, y, buff);
+	if (width <= maxXPixel()) {
+		drawText(textFont, (maxXPixel() - width) / 2, y, buff);
+	} else {
+		char cut[BSIZE];
+		int  len = textFit(textFont, buff, maxXPixel());
+		if (len >= BSIZE)	{len = BSIZE - 1;}
+		memcpy(cut, buff, len);
+		cut[len] = 0;
+		drawText(textFont, 0, y, cut);
+	}
 }
 
+/*
+ * Text wider than the screen, scrolled by offset pixels; the start comes
+ * round again MARQUEE_GAP pixels after the end.
+ */
+void putTextMarquee(int y, char *buff, int offset) {
+	int width = textWidth(textFont, buff);
+
+	clearLine(y);
+	int x = drawText(textFont, -offset, y, buff);
+	if (x + MARQUEE_GAP < maxXPixel()) {
+		drawText(textFont, -offset + width + MARQUEE_GAP, y, buff);
+	}
+}
+
+/*
+ * Fixed font text drawn only where a cell differs from shown, which is
+ * then updated: a changed digit costs one cell. shown holds a line of
+ * maxCharacter() + 1, "" draws it all.
+ */
+void putTextCells(int y, const char *buff, char *shown) {
+	int  len  = strlen(buff);
+	int  old  = strlen(shown);
+	char cell[2] = {0, 0};
+
+	if (len > maxCharacter())	{len = maxCharacter();}
+
+	for (int i = 0; (i < len) || (i < old); i++) {
+		cell[0] = (i < len) ? buff[i] : ' ';
+		if ((i < old) && (shown[i] == cell[0]))	{continue;}
+
+		fillRect(i * CHAR_WIDTH, y, CHAR_WIDTH, CHAR_HEIGHT, 0);
+		drawText(FONT_FIXED, i * CHAR_WIDTH, y, cell);
+	}
+	memcpy(shown, buff, len);
+	shown[len] = 0;
+}
+
+void setDisplayBus(const char *spec) {
+	busSpec = spec;
+}
+
+// queues the changed span of every page, they go out in one transfer
+static void queuePages(void) {
+	for (int page = 0; page < DISPLAY_PAGES; page++) {
+		const uint8_t *now = drawBuf[page], *old = shownBuf[page];
+		int first = 0, last = DISPLAY_WIDTH;
+
+		if (!shownLost) {
+			while ((first < DISPLAY_WIDTH) && (now[first] == old[first]))	{first++;}
+			if (first == DISPLAY_WIDTH)	{continue;}
+			while (now[last - 1] == old[last - 1])	{last--;}
+		}
+
+		int col = first + SH1106_OFFSET;
+		uint8_t head[] = {SH1106_CMD, (uint8_t)(0xB0 | page), SH1106_CMD, (uint8_t)(0x10 | (col >> 4)),
+			SH1106_CMD, (uint8_t)(col & 0x0F), SH1106_DATA};
+		busMessage(head, sizeof(head), now + first, last - first, SH1106_DATA);
+		memcpy(shownBuf[page] + first, now + first, last - first);
+	}
+}
+
+/**********************************************************************
+* Without an OLED the frame buffer is still drawn, for the viewers
+**********************************************************************/
+int initDisplay(void) {
+	clearDisplay();
+	memset(shownBuf, 0, sizeof(shownBuf));
+
+#ifndef __arm__
+	if (busSpec == NULL)	{return 0;}
 #endif
+
+	if (openBus(busSpec) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	// set up, the RAM cleared, then on: one transfer
+	const uint8_t on[] = {SH1106_CMDS, 0xAF};
+	memset(shownBuf, 0xFF, sizeof(shownBuf));
+	busMessage(sh1106Init, sizeof(sh1106Init), NULL, 0, 0);
+	queuePages();
+	busMessage(on, sizeof(on), NULL, 0, 0);
+	if (busFlush() < 0) {
+		closeBus();
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
+
+//********************************************************************
+void closeDisplay(void) {
+	closeBus();
+}
+
+void refreshDisplay(void) {
+	streamFrame(frameBuffer());
+	queuePages();
+	shownLost = (busFlush() < 0);
+}
@@ -21,19 +21,40 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H 1
 
+#include <stdint.h>
+
+#include "fonts.h"
+
 #define CHAR_WIDTH  6
 #define CHAR_HEIGHT 8
 
+#define DISPLAY_WIDTH	128
+#define DISPLAY_PAGES	8
+#define DISPLAY_FRAME	(DISPLAY_PAGES * DISPLAY_WIDTH)	// bytes of a frame buffer
+#define MARQUEE_GAP		24			// pixels between the end and the restart of a scrolled line
+
+void setDisplayBus(const char *spec);
 int  initDisplay(void);
 void closeDisplay(void);
+void clearDisplay(void);
+void fillRect(int x, int y, int w, int h, int color);
+void blitColumns(int x, int y, int w, int h, const uint32_t *cols);
+int  drawText(fontid_t font, int x, int y, const char *text);
 void drawHorizontalBargraph(int x, int y, int w, int h, int percent);
 void putText(int x, int y, char *buff);
+void putTextFont(fontid_t font, int x, int y, char *buff);
 void putTextToCenter(int y, char *buff);
+void putTextMarquee(int y, char *buff, int offset);
+void putTextCells(int y, const char *buff, char *shown);
 void clearLine(int y);
 void refreshDisplay(void);
 int  maxCharacter(void);
 int  maxLine(void);
 int  maxXPixel(void);
 int  maxYPixel(void);
+const uint8_t *frameBuffer(void);
+void drawInto(uint8_t *frame);
+void setTextFont(fontid_t font);
+fontid_t getTextFont(void);
 
 #endif
@@ -0,0 +1,185 @@
+/*
+ *	fbbench.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Frames per second of a full redraw: the page span frame buffer of
+ *	display.c against the Adafruit_GFX way, every pixel a drawPixel call
+ *	into the library buffer and display() walking all of it. Both draw
+ *	the same screen, the buffers are compared at the end. The bus is left
+ *	out, it costs the same for both.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "display.h"
+#include "fonts.h"
+#include "metrics.h"
+#include "fbbench.h"
+
+#define BENCH_NS		1000000000L		// per path
+#define LIB_CHUNK		16				// data bytes per I2C write of the library
+
+typedef struct {
+	void (*clear)(void);
+	int  (*text)(fontid_t font, int x, int y, const char *text);
+	void (*fill)(int x, int y, int w, int h, int color);
+	void (*bar)(int x, int y, int w, int h, int percent);
+	void (*refresh)(void);
+} painter;
+
+/*******************************************************************************
+ * The per pixel path, like ArduiPi_OLED: drawPixel is virtual there
+ ******************************************************************************/
+uint8_t libBuf[DISPLAY_PAGES * DISPLAY_WIDTH];
+uint8_t libTx[LIB_CHUNK + 1];
+
+static void libPixel(int x, int y, int color) {
+	if ((x < 0) || (x >= DISPLAY_WIDTH) || (y < 0) || (y >= DISPLAY_PAGES * 8))	{return;}
+
+	if (color)	{libBuf[x + (y / 8) * DISPLAY_WIDTH] |=  (1 << (y & 7));}
+	else		{libBuf[x + (y / 8) * DISPLAY_WIDTH] &= ~(1 << (y & 7));}
+}
+
+void (*volatile drawPixel)(int x, int y, int color) = libPixel;
+
+static void pixClear(void) {
+	memset(libBuf, 0, sizeof(libBuf));
+}
+
+static void pixFill(int x, int y, int w, int h, int color) {
+	for (int i = x; i < x + w; i++) {
+		for (int j = y; j < y + h; j++) {
+			drawPixel(i, j, color);
+		}
+	}
+}
+
+static int pixText(fontid_t font, int x, int y, const char *text) {
+	int height = fontHeight(font);
+	int prev   = -1;
+
+	for (int g; (g = nextCodepoint(&text)) >= 0; prev = g) {
+		x += glyphKern(font, prev, g);
+		int adv = glyphAdvance(font, g);
+
+		if (x >= DISPLAY_WIDTH)		{break;}
+		for (int col = 0; col < adv; col++) {
+			uint16_t bits = glyphColumn(font, g, col);
+			for (int row = 0; row < height; row++) {
+				drawPixel(x + col, y + row, (bits >> row) & 1);
+			}
+		}
+		x += adv;
+	}
+	return x;
+}
+
+static void pixBar(int x, int y, int w, int h, int percent) {
+	if (x == -1) {
+		x = 0;
+		w = maxXPixel();
+	}
+
+	pixFill(x,         y,         w,                        h,     0);
+	pixFill(x,         y,         w,                        1,     1);
+	pixFill(x,         y + h - 1, w,                        1,     1);
+	pixFill(x,         y,         1,                        h,     1);
+	pixFill(x + w - 1, y,         1,                        h,     1);
+	pixFill(x + 1,     y + 1,     ((w - 2) * percent) / 100, h - 2, 1);
+}
+
+// display(): the whole buffer in chunks, each behind a control byte
+static void pixRefresh(void) {
+	for (int i = 0; i < (int)sizeof(libBuf); i += LIB_CHUNK) {
+		libTx[0] = 0x40;
+		memcpy(libTx + 1, libBuf + i, LIB_CHUNK);
+	}
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+static void drawScene(const painter *p, int frame) {
+	const char *title = "A title too long for the screen, it scrolls by";
+	char buff[64];
+	int  percent = frame % 101;
+
+	p->clear();
+
+	sprintf(buff, "Vol:             %3d%%", percent);
+	p->text(FONT_FIXED, 0, 0, buff);
+	p->bar(24, 2, 75, 4, percent);
+
+	const char *lines[] = {"Composer", NULL, "The Album", "Performer"};
+	for (int line = 0; line < 4; line++) {
+		int y = (line + 1) * 10;
+		p->fill(0, y, maxXPixel(), CHAR_HEIGHT, 0);
+		if (lines[line] != NULL) {
+			p->text(FONT_PROP, (maxXPixel() - textWidth(FONT_PROP, lines[line])) / 2, y, lines[line]);
+		} else {
+			int offset = (frame * 8) % (textWidth(FONT_PROP, title) + MARQUEE_GAP);
+			int x = p->text(FONT_PROP, -offset, y, title);
+			if (x + MARQUEE_GAP < maxXPixel()) {
+				p->text(FONT_PROP, x + MARQUEE_GAP, y, title);
+			}
+		}
+	}
+
+	sprintf(buff, "%d:%02d", frame / 60 % 60, frame % 60);
+	p->fill(0, 56, maxXPixel(), CHAR_HEIGHT, 0);
+	p->text(FONT_FIXED, 0, 56, buff);
+	p->text(FONT_FIXED, maxXPixel() - textWidth(FONT_FIXED, "4:56"), 56, "4:56");
+	p->text(FONT_FIXED, 52, 56, "play");
+	p->bar(-1, 51, 0, 4, percent);
+
+	p->refresh();
+}
+
+static double runPath(const painter *p, long *frames) {
+	long start = metricsNow();
+	long now;
+
+	*frames = 0;
+	do {
+		drawScene(p, (int)(*frames)++);
+		now = metricsNow();
+	} while (now - start < BENCH_NS);
+
+	return *frames * 1e9 / (now - start);
+}
+
+int benchFrames(void) {
+	const painter native = {clearDisplay, drawText, fillRect, drawHorizontalBargraph, refreshDisplay};
+	const painter pixel  = {pixClear, pixText, pixFill, pixBar, pixRefresh};
+	long nFrames, pFrames;
+
+	double nFps = runPath(&native, &nFrames);
+	double pFps = runPath(&pixel, &pFrames);
+
+	// the same last frame on both sides
+	long last = (nFrames < pFrames) ? nFrames : pFrames;
+	drawScene(&native, (int)last);
+	drawScene(&pixel, (int)last);
+	int match = memcmp(frameBuffer(), libBuf, sizeof(libBuf)) == 0;
+
+	printf("frames native_fps=%.0f pixel_fps=%.0f speedup=%.1fx match=%s\n",
+		nFps, pFps, nFps / pFps, match ? "yes" : "NO");
+	return match ? 0 : -1;
+}
@@ -0,0 +1,275 @@
+/*
+ *	fbstream.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Streams the rendered frame buffer to remote viewers (tools/fbview).
+ *	An unchanged frame costs one memcmp and nothing is sent. A changed one
+ *	is XORed against the previous frame and PackBits compressed, mostly
+ *	zero runs, so a scrolling line is a few dozen bytes. Keyframes are
+ *	sent every FBS_KEYEVERY frames on UDP, where packets get lost, and to
+ *	each new TCP viewer. A TCP viewer that cannot take a whole packet is
+ *	dropped, the monitor never waits for a slow client.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "fbstream.h"
+
+typedef enum {FS_NONE, FS_UDP, FS_TCP} fbstype_t;
+
+typedef struct {
+	int		fd;
+	int		needKey;
+} fbviewer;
+
+fbstype_t		fbsType   = FS_NONE;
+int				fbsFD     = -1;			// UDP socket or TCP listener
+fbviewer		viewers[FBS_MAXVIEWERS];
+
+uint8_t			lastFrame[FBS_FRAME];
+uint32_t		frameSeq  = 0;
+int				sinceKey  = FBS_KEYEVERY;	// first frame is a keyframe
+
+uint8_t			keyPacket[FBS_PACKET];
+uint8_t			deltaPacket[FBS_PACKET];
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int udpTarget(const char *hostPort) {
+	struct addrinfo hints, *res;
+	char host[256];
+	const char *port = strrchr(hostPort, ':');
+
+	if ((port == NULL) || (port - hostPort >= (int)sizeof(host)))	{return -1;}
+	memcpy(host, hostPort, port - hostPort);
+	host[port - hostPort] = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, port + 1, &hints, &res) != 0)	{return -1;}
+
+	// connected, so a send is all a frame takes
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if ((fd >= 0) && (connect(fd, res->ai_addr, res->ai_addrlen) < 0)) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+int tcpListener(const char *hostPort) {
+	struct sockaddr_in addr;
+	int enable = 1;
+	const char *port = strrchr(hostPort, ':');
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (port != NULL) {
+		char host[INET_ADDRSTRLEN] = {0};
+		int  len = port - hostPort;
+
+		if (len < INET_ADDRSTRLEN)	{memcpy(host, hostPort, len);}
+		// a mistyped address must not serve on every interface
+		if ((len >= INET_ADDRSTRLEN) || (inet_pton(AF_INET, host, &addr.sin_addr) != 1)) {
+			errno = EINVAL;
+			return -1;
+		}
+		port++;
+	} else {
+		port = hostPort;
+	}
+	addr.sin_port = htons(atoi(port));
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)	{return -1;}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, FBS_MAXVIEWERS) < 0)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * target: "udp:host:port" sends to one viewer, "tcp:port" or
+ * "tcp:addr:port" serves up to FBS_MAXVIEWERS connecting viewers.
+ */
+int initFrameStream(const char *target) {
+	for (int i = 0; i < FBS_MAXVIEWERS; i++) {
+		viewers[i].fd = -1;
+	}
+
+	if (strncmp(target, "udp:", 4) == 0) {
+		fbsType = FS_UDP;
+		fbsFD   = udpTarget(target + 4);
+	} else if (strncmp(target, "tcp:", 4) == 0) {
+		fbsType = FS_TCP;
+		fbsFD   = tcpListener(target + 4);
+	} else {
+		logERR(LS_DISPLAY, "Frame stream %s: use udp:host:port or tcp:[addr:]port\n", target);
+		return -1;
+	}
+
+	if (fbsFD < 0) {
+		logERR(LS_DISPLAY, "Frame stream %s: %s\n", target, strerror(errno));
+		fbsType = FS_NONE;
+		return -1;
+	}
+
+	memset(lastFrame, 0, sizeof(lastFrame));
+	logMSG(LS_DISPLAY, LL_INFO, "Streaming frames to %s\n", target);
+	return 0;
+}
+
+void closeViewer(fbviewer *v) {
+	close(v->fd);
+	v->fd = -1;
+	logMSG(LS_DISPLAY, LL_INFO, "Frame viewer disconnected\n");
+}
+
+void closeFrameStream(void) {
+	// without -d the viewers were never set up, their fds are 0
+	if (fbsType == FS_NONE)	{return;}
+
+	for (int i = 0; i < FBS_MAXVIEWERS; i++) {
+		if (viewers[i].fd >= 0)	{closeViewer(&viewers[i]);}
+	}
+	if (fbsFD >= 0) {
+		close(fbsFD);
+	}
+	fbsFD   = -1;
+	fbsType = FS_NONE;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int acceptViewers(void) {
+	int fresh = 0;
+
+	for (int fd; (fd = accept4(fbsFD, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0; ) {
+		int i = 0;
+		while ((i < FBS_MAXVIEWERS) && (viewers[i].fd >= 0))	{i++;}
+		if (i == FBS_MAXVIEWERS) {
+			close(fd);
+			continue;
+		}
+		viewers[i].fd      = fd;
+		viewers[i].needKey = true;
+		fresh++;
+		logMSG(LS_DISPLAY, LL_INFO, "Frame viewer connected\n");
+	}
+	return fresh;
+}
+
+int buildPacket(uint8_t *packet, const uint8_t *payload, int flags, uint32_t seq) {
+	int len = packBits(payload, FBS_FRAME, packet + FBS_HEADER);
+
+	packet[0]  = 'L';
+	packet[1]  = 'F';
+	packet[2]  = flags;
+	packet[3]  = DISPLAY_PAGES;
+	packet[4]  = DISPLAY_WIDTH >> 8;
+	packet[5]  = DISPLAY_WIDTH & 0xFF;
+	packet[6]  = seq >> 24;
+	packet[7]  = seq >> 16;
+	packet[8]  = seq >> 8;
+	packet[9]  = seq;
+	packet[10] = len >> 8;
+	packet[11] = len & 0xFF;
+	return FBS_HEADER + len;
+}
+
+/*
+ * Called with every refreshed frame, from the thread that draws.
+ */
+void streamFrame(const uint8_t *frame) {
+	uint8_t delta[FBS_FRAME];
+	int keyLen = 0, deltaLen = 0;
+
+	if (fbsType == FS_NONE)	{return;}
+
+	int fresh   = (fbsType == FS_TCP) ? acceptViewers() : 0;
+	int changed = memcmp(frame, lastFrame, FBS_FRAME) != 0;
+
+	if (!changed && !fresh)	{return;}
+
+	if (changed) {
+		frameSeq++;
+		sinceKey++;
+		for (int i = 0; i < FBS_FRAME; i++) {
+			delta[i] = frame[i] ^ lastFrame[i];
+		}
+		deltaLen = buildPacket(deltaPacket, delta, 0, frameSeq);
+		memcpy(lastFrame, frame, FBS_FRAME);
+	}
+
+	if (fbsType == FS_UDP) {
+		const uint8_t *packet = deltaPacket;
+		int len = deltaLen;
+
+		if (sinceKey >= FBS_KEYEVERY) {
+			len      = buildPacket(keyPacket, lastFrame, FBS_KEYFRAME, frameSeq);
+			packet   = keyPacket;
+			sinceKey = 0;
+		}
+		// nobody listening is not an error, the viewer may come later
+		if (send(fbsFD, packet, len, MSG_DONTWAIT) > 0) {
+			metricsCount(MC_STREAM_BYTES, len);
+		}
+		return;
+	}
+
+	if (fresh) {
+		keyLen = buildPacket(keyPacket, lastFrame, FBS_KEYFRAME, frameSeq);
+	}
+
+	// TCP is reliable, a viewer needs one keyframe and deltas from then on
+	for (int i = 0; i < FBS_MAXVIEWERS; i++) {
+		fbviewer *v = &viewers[i];
+		if (v->fd < 0)					{continue;}
+		if (!v->needKey && !changed)	{continue;}
+
+		const uint8_t *packet = v->needKey ? keyPacket : deltaPacket;
+		int len = v->needKey ? keyLen : deltaLen;
+
+		if (send(v->fd, packet, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) {
+			closeViewer(v);
+			continue;
+		}
+		v->needKey = false;
+		metricsCount(MC_STREAM_BYTES, len);
+	}
+}
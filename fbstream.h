@@ -0,0 +1,48 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef FBSTREAM_H
+#define FBSTREAM_H 1
+
+#include <stdint.h>
+
+#include "display.h"
+#include "rle.h"
+
+#define FBS_FRAME		(DISPLAY_PAGES * DISPLAY_WIDTH)
+#define FBS_HEADER		12
+#define FBS_PACKET		(FBS_HEADER + PACKBITS_MAX(FBS_FRAME))
+#define FBS_KEYEVERY	50			// frames between UDP keyframes
+#define FBS_MAXVIEWERS	4
+
+#define FBS_KEYFRAME	0x01
+
+/*
+ * Packet, multi byte fields big endian, back to back on TCP:
+ *   'L' 'F' | flags | pages | width (2) | sequence (4) | payload length (2) | payload
+ * The payload is the PackBits compressed page major frame, or for a delta
+ * the frame XOR the frame of sequence - 1.
+ */
+
+int   initFrameStream(const char *target);
+void  closeFrameStream(void);
+void  streamFrame(const uint8_t *frame);
+
+#endif
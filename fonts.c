@@ -0,0 +1,371 @@
+/*
+ *	fonts.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Font tables and text metrics. Glyphs are stored column by column, LSB
+ *	is the top row: the SH1106 page format, one column is one byte of a
+ *	page. The proportional and the large fonts are derived from the 5x7
+ *	base font at compile time. Code points outside ASCII come from the
+ *	glyph atlas when one is loaded, else they are transliterated.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tagUtils.h"
+#include "atlas.h"
+#include "fonts.h"
+
+constexpr uint8_t font5x7[GLYPHS][GLYPH_COLS] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00},		// ' '
+	{0x00, 0x00, 0x5F, 0x00, 0x00},		// !
+	{0x00, 0x07, 0x00, 0x07, 0x00},		// "
+	{0x14, 0x7F, 0x14, 0x7F, 0x14},		// #
+	{0x24, 0x2A, 0x7F, 0x2A, 0x12},		// $
+	{0x23, 0x13, 0x08, 0x64, 0x62},		// %
+	{0x36, 0x49, 0x56, 0x20, 0x50},		// &
+	{0x00, 0x05, 0x03, 0x00, 0x00},		// '
+	{0x00, 0x1C, 0x22, 0x41, 0x00},		// (
+	{0x00, 0x41, 0x22, 0x1C, 0x00},		// )
+	{0x14, 0x08, 0x3E, 0x08, 0x14},		// *
+	{0x08, 0x08, 0x3E, 0x08, 0x08},		// +
+	{0x00, 0x50, 0x30, 0x00, 0x00},		// ,
+	{0x08, 0x08, 0x08, 0x08, 0x08},		// -
+	{0x00, 0x60, 0x60, 0x00, 0x00},		// .
+	{0x20, 0x10, 0x08, 0x04, 0x02},		// /
+	{0x3E, 0x51, 0x49, 0x45, 0x3E},		// 0
+	{0x00, 0x42, 0x7F, 0x40, 0x00},		// 1
+	{0x42, 0x61, 0x51, 0x49, 0x46},		// 2
+	{0x21, 0x41, 0x45, 0x4B, 0x31},		// 3
+	{0x18, 0x14, 0x12, 0x7F, 0x10},		// 4
+	{0x27, 0x45, 0x45, 0x45, 0x39},		// 5
+	{0x3C, 0x4A, 0x49, 0x49, 0x30},		// 6
+	{0x01, 0x71, 0x09, 0x05, 0x03},		// 7
+	{0x36, 0x49, 0x49, 0x49, 0x36},		// 8
+	{0x06, 0x49, 0x49, 0x29, 0x1E},		// 9
+	{0x00, 0x36, 0x36, 0x00, 0x00},		// :
+	{0x00, 0x56, 0x36, 0x00, 0x00},		// ;
+	{0x08, 0x14, 0x22, 0x41, 0x00},		// <
+	{0x14, 0x14, 0x14, 0x14, 0x14},		// =
+	{0x00, 0x41, 0x22, 0x14, 0x08},		// >
+	{0x02, 0x01, 0x51, 0x09, 0x06},		// ?
+	{0x32, 0x49, 0x79, 0x41, 0x3E},		// @
+	{0x7E, 0x11, 0x11, 0x11, 0x7E},		// A
+	{0x7F, 0x49, 0x49, 0x49, 0x36},		// B
+	{0x3E, 0x41, 0x41, 0x41, 0x22},		// C
+	{0x7F, 0x41, 0x41, 0x22, 0x1C},		// D
+	{0x7F, 0x49, 0x49, 0x49, 0x41},		// E
+	{0x7F, 0x09, 0x09, 0x09, 0x01},		// F
+	{0x3E, 0x41, 0x49, 0x49, 0x7A},		// G
+	{0x7F, 0x08, 0x08, 0x08, 0x7F},		// H
+	{0x00, 0x41, 0x7F, 0x41, 0x00},		// I
+	{0x20, 0x40, 0x41, 0x3F, 0x01},		// J
+	{0x7F, 0x08, 0x14, 0x22, 0x41},		// K
+	{0x7F, 0x40, 0x40, 0x40, 0x40},		// L
+	{0x7F, 0x02, 0x0C, 0x02, 0x7F},		// M
+	{0x7F, 0x04, 0x08, 0x10, 0x7F},		// N
+	{0x3E, 0x41, 0x41, 0x41, 0x3E},		// O
+	{0x7F, 0x09, 0x09, 0x09, 0x06},		// P
+	{0x3E, 0x41, 0x51, 0x21, 0x5E},		// Q
+	{0x7F, 0x09, 0x19, 0x29, 0x46},		// R
+	{0x46, 0x49, 0x49, 0x49, 0x31},		// S
+	{0x01, 0x01, 0x7F, 0x01, 0x01},		// T
+	{0x3F, 0x40, 0x40, 0x40, 0x3F},		// U
+	{0x1F, 0x20, 0x40, 0x20, 0x1F},		// V
+	{0x3F, 0x40, 0x38, 0x40, 0x3F},		// W
+	{0x63, 0x14, 0x08, 0x14, 0x63},		// X
+	{0x07, 0x08, 0x70, 0x08, 0x07},		// Y
+	{0x61, 0x51, 0x49, 0x45, 0x43},		// Z
+	{0x00, 0x7F, 0x41, 0x41, 0x00},		// [
+	{0x02, 0x04, 0x08, 0x10, 0x20},		// backslash
+	{0x00, 0x41, 0x41, 0x7F, 0x00},		// ]
+	{0x04, 0x02, 0x01, 0x02, 0x04},		// ^
+	{0x40, 0x40, 0x40, 0x40, 0x40},		// _
+	{0x00, 0x01, 0x02, 0x04, 0x00},		// `
+	{0x20, 0x54, 0x54, 0x54, 0x78},		// a
+	{0x7F, 0x48, 0x44, 0x44, 0x38},		// b
+	{0x38, 0x44, 0x44, 0x44, 0x20},		// c
+	{0x38, 0x44, 0x44, 0x48, 0x7F},		// d
+	{0x38, 0x54, 0x54, 0x54, 0x18},		// e
+	{0x08, 0x7E, 0x09, 0x01, 0x02},		// f
+	{0x0C, 0x52, 0x52, 0x52, 0x3E},		// g
+	{0x7F, 0x08, 0x04, 0x04, 0x78},		// h
+	{0x00, 0x44, 0x7D, 0x40, 0x00},		// i
+	{0x20, 0x40, 0x44, 0x3D, 0x00},		// j
+	{0x7F, 0x10, 0x28, 0x44, 0x00},		// k
+	{0x00, 0x41, 0x7F, 0x40, 0x00},		// l
+	{0x7C, 0x04, 0x18, 0x04, 0x78},		// m
+	{0x7C, 0x08, 0x04, 0x04, 0x78},		// n
+	{0x38, 0x44, 0x44, 0x44, 0x38},		// o
+	{0x7C, 0x14, 0x14, 0x14, 0x08},		// p
+	{0x08, 0x14, 0x14, 0x18, 0x7C},		// q
+	{0x7C, 0x08, 0x04, 0x04, 0x08},		// r
+	{0x48, 0x54, 0x54, 0x54, 0x20},		// s
+	{0x04, 0x3F, 0x44, 0x40, 0x20},		// t
+	{0x3C, 0x40, 0x40, 0x20, 0x7C},		// u
+	{0x1C, 0x20, 0x40, 0x20, 0x1C},		// v
+	{0x3C, 0x40, 0x30, 0x40, 0x3C},		// w
+	{0x44, 0x28, 0x10, 0x28, 0x44},		// x
+	{0x0C, 0x50, 0x50, 0x50, 0x3C},		// y
+	{0x44, 0x64, 0x54, 0x4C, 0x44},		// z
+	{0x00, 0x08, 0x36, 0x41, 0x00},		// {
+	{0x00, 0x00, 0x7F, 0x00, 0x00},		// |
+	{0x00, 0x41, 0x36, 0x08, 0x00},		// }
+	{0x10, 0x08, 0x08, 0x10, 0x08},		// ~
+};
+
+/*******************************************************************************
+ * Compile time derived tables
+ ******************************************************************************/
+
+// proportional font: empty columns trimmed on both sides, space kept narrow
+struct PropMetrics {
+	uint8_t first[GLYPHS];
+	uint8_t width[GLYPHS];
+
+	constexpr PropMetrics() : first(), width() {
+		for (int g = 0; g < GLYPHS; g++) {
+			int lo = GLYPH_COLS, hi = -1;
+			for (int c = 0; c < GLYPH_COLS; c++) {
+				if (font5x7[g][c]) {
+					if (lo > c) {lo = c;}
+					hi = c;
+				}
+			}
+			first[g] = (hi < 0) ? 0 : lo;
+			width[g] = (hi < 0) ? 2 : hi - lo + 1;
+		}
+	}
+};
+
+// large font: every row and every column of the base font doubled
+constexpr uint16_t stretch(uint8_t b) {
+	uint16_t w = 0;
+	for (int i = 0; i < 8; i++) {
+		if (b & (1 << i)) {w |= 3 << (2 * i);}
+	}
+	return w;
+}
+
+struct LargeFont {
+	uint16_t col[GLYPHS][GLYPH_COLS];
+
+	constexpr LargeFont() : col() {
+		for (int g = 0; g < GLYPHS; g++) {
+			for (int c = 0; c < GLYPH_COLS; c++) {
+				col[g][c] = stretch(font5x7[g][c]);
+			}
+		}
+	}
+};
+
+constexpr PropMetrics propMetrics;
+constexpr LargeFont   largeFont;
+
+static_assert(propMetrics.width['i' - FIRST_GLYPH] == 3, "proportional metrics");
+static_assert(largeFont.col['|' - FIRST_GLYPH][2] == 0x3FFF, "large font stretch");
+
+typedef struct {char a, b; int8_t adjust;} kernpair;
+
+const kernpair kernPairs[] = {
+	{'A', 'T', -1}, {'A', 'V', -1}, {'A', 'W', -1}, {'A', 'Y', -1},
+	{'F', ',', -1}, {'F', '.', -1}, {'L', 'T', -1}, {'L', 'V', -1},
+	{'L', 'Y', -1}, {'P', ',', -1}, {'P', '.', -1}, {'T', ',', -1},
+	{'T', '.', -1}, {'T', 'A', -1}, {'T', 'a', -1}, {'T', 'e', -1},
+	{'T', 'o', -1}, {'V', 'A', -1}, {'W', 'A', -1}, {'Y', ',', -1},
+	{'Y', '.', -1}, {'Y', 'A', -1}, {'Y', 'o', -1}, {'r', ',', -1},
+	{'r', '.', -1},
+};
+
+typedef struct {
+	unsigned int	hash;
+	int				font;
+	int				width;
+	char			*key;
+} widthentry;
+
+widthentry	widthCache[WIDTH_CACHE];
+
+/*******************************************************************************
+ * Glyphs
+ ******************************************************************************/
+
+/*
+ * Decode the next UTF-8 character, -1 at the end of the string.
+ * Broken sequences come back as '?'.
+ */
+int nextCodepoint(const char **s) {
+	const unsigned char *p = (const unsigned char *)*s;
+	int cp;
+	int extra;
+
+	if (*p == 0)					{return -1;}
+
+	if      (*p < 0x80)				{cp = *p;        extra = 0;}
+	else if ((*p & 0xE0) == 0xC0)	{cp = *p & 0x1F; extra = 1;}
+	else if ((*p & 0xF0) == 0xE0)	{cp = *p & 0x0F; extra = 2;}
+	else if ((*p & 0xF8) == 0xF0)	{cp = *p & 0x07; extra = 3;}
+	else							{cp = '?';       extra = 0;}
+	p++;
+
+	for (; extra && ((*p & 0xC0) == 0x80); extra--, p++) {
+		cp = (cp << 6) | (*p & 0x3F);
+	}
+	*s = (const char *)p;
+
+	return extra ? '?' : cp;
+}
+
+int isBuiltin(int cp) {
+	return (cp >= FIRST_GLYPH) && (cp <= LAST_GLYPH);
+}
+
+// index in the built in font, with the old transliteration as last resort
+int builtinGlyph(int cp) {
+	if (!isBuiltin(cp))	{cp = getASCII(cp);}
+	if (!isBuiltin(cp))	{cp = '?';}
+	return cp - FIRST_GLYPH;
+}
+
+// atlas glyphs up to 8 pixel are stretched for the large font, higher ones are used as is
+int largeAtlas(void) {
+	return atlasHeight() > 8;
+}
+
+int loadAtlas(const char *path) {
+	if (openAtlas(path) < 0)	{return -1;}
+
+	for (int i = 0; i < WIDTH_CACHE; i++) {
+		free(widthCache[i].key);
+		widthCache[i].key = NULL;
+	}
+	return 0;
+}
+
+int fontHeight(fontid_t font) {
+	return (font == FONT_LARGE) ? 16 : 8;
+}
+
+// width of the glyph including the spacing column(s) after it
+int glyphAdvance(fontid_t font, int cp) {
+	const atlasglyph *ag = isBuiltin(cp) ? NULL : atlasGlyph(cp);
+
+	if (ag != NULL) {
+		if (font != FONT_LARGE)	{return ag->width + 1;}
+		return largeAtlas() ? ag->width + 2 : 2 * (ag->width + 1);
+	}
+
+	int glyph = builtinGlyph(cp);
+	switch (font) {
+		case FONT_PROP:		return propMetrics.width[glyph] + 1;
+		case FONT_LARGE:	return 2 * (GLYPH_COLS + 1);
+		default:			return GLYPH_COLS + 1;
+	}
+}
+
+int glyphKern(fontid_t font, int prev, int cp) {
+	if ((font != FONT_PROP) || !isBuiltin(prev) || !isBuiltin(cp))	{return 0;}
+
+	for (unsigned int i = 0; i < sizeof(kernPairs) / sizeof(kernPairs[0]); i++) {
+		if ((kernPairs[i].a == prev) && (kernPairs[i].b == cp))	{return kernPairs[i].adjust;}
+	}
+	return 0;
+}
+
+// one column of the glyph, LSB is the top row, spacing columns are empty
+uint16_t glyphColumn(fontid_t font, int cp, int col) {
+	const atlasglyph *ag = isBuiltin(cp) ? NULL : atlasGlyph(cp);
+
+	if (ag != NULL) {
+		if (font != FONT_LARGE)	{return (col < ag->width) ? ag->cols[col] & 0xFF : 0;}
+		if (largeAtlas())		{return (col < ag->width) ? ag->cols[col] : 0;}
+		return (col < 2 * ag->width) ? stretch(ag->cols[col / 2]) : 0;
+	}
+
+	int glyph = builtinGlyph(cp);
+	switch (font) {
+		case FONT_PROP:
+			if (col >= propMetrics.width[glyph])	{return 0;}
+			return font5x7[glyph][propMetrics.first[glyph] + col];
+		case FONT_LARGE:
+			if (col >= 2 * GLYPH_COLS)				{return 0;}
+			return largeFont.col[glyph][col / 2];
+		default:
+			if (col >= GLYPH_COLS)					{return 0;}
+			return font5x7[glyph][col];
+	}
+}
+
+/*******************************************************************************
+ * Text metrics
+ ******************************************************************************/
+int measureText(fontid_t font, const char *text) {
+	int width = 0;
+	int prev  = -1;
+
+	for (int g; (g = nextCodepoint(&text)) >= 0; prev = g) {
+		width += glyphKern(font, prev, g) + glyphAdvance(font, g);
+	}
+	// no spacing after the last glyph
+	return (width > 0) ? width - ((font == FONT_LARGE) ? 2 : 1) : 0;
+}
+
+/*
+ * Tags change far less often than they are laid out: widths are memoized
+ * in a small direct mapped cache keyed by font and string.
+ */
+int textWidth(fontid_t font, const char *text) {
+	unsigned int h = 2166136261u ^ font;		// FNV-1a
+	for (const char *p = text; *p; p++) {
+		h ^= (unsigned char)*p;
+		h *= 16777619u;
+	}
+
+	widthentry *e = &widthCache[h & (WIDTH_CACHE - 1)];
+	if ((e->key != NULL) && (e->hash == h) && (e->font == font) && (strcmp(e->key, text) == 0)) {
+		return e->width;
+	}
+
+	char *key = strdup(text);
+	if (key == NULL)	{return measureText(font, text);}
+
+	free(e->key);
+	e->key   = key;
+	e->hash  = h;
+	e->font  = font;
+	e->width = measureText(font, text);
+	return e->width;
+}
+
+// number of bytes of text that fit in maxWidth pixels
+int textFit(fontid_t font, const char *text, int maxWidth) {
+	const char *p   = text;
+	const char *end = text;
+	int width = 0;
+	int prev  = -1;
+
+	for (int g; (g = nextCodepoint(&p)) >= 0; prev = g) {
+		int adv = glyphKern(font, prev, g) + glyphAdvance(font, g);
+		int ink = adv - ((font == FONT_LARGE) ? 2 : 1);
+		if (width + ink > maxWidth)	{break;}
+		width += adv;
+		end = p;
+	}
+	return end - text;
+}
@@ -0,0 +1,44 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef FONTS_H
+#define FONTS_H 1
+
+#include <stdint.h>
+
+#define FIRST_GLYPH		' '
+#define LAST_GLYPH		'~'
+#define GLYPHS			(LAST_GLYPH - FIRST_GLYPH + 1)
+#define GLYPH_COLS		5			// columns of the base 5x7 font
+#define WIDTH_CACHE		32			// memoized text widths, must be a power of 2
+
+// FONT_FIXED: 6x8 cells, FONT_PROP: same glyphs trimmed + kerning, FONT_LARGE: 2x FONT_FIXED
+typedef enum {FONT_FIXED, FONT_PROP, FONT_LARGE, MAXFONTS} fontid_t;
+
+int      nextCodepoint(const char **s);
+int      loadAtlas(const char *path);
+int      fontHeight(fontid_t font);
+int      glyphAdvance(fontid_t font, int cp);
+int      glyphKern(fontid_t font, int prev, int cp);
+uint16_t glyphColumn(fontid_t font, int cp, int col);
+int      textWidth(fontid_t font, const char *text);
+int      textFit(fontid_t font, const char *text, int maxWidth);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ *	i2cbus.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	I2C transport of the display: messages are queued in one buffer and
+ *	go out with a single I2C_RDWR ioctl, repeated STARTs between them and
+ *	one STOP at the end. The mock bus takes the place of /dev/i2c-N on a
+ *	box without the display: it counts, logs every message and adds up
+ *	the wire time at the given clock.
+ *
+ *	Spec: /dev/i2c-N | N | mock[:logfile] [,addr=0x3c] [,chunk=bytes] [,clock=Hz]
+ *	chunk limits the data bytes of a message, for adapters that cannot
+ *	take long ones; 0 is no limit.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "i2cbus.h"
+
+typedef struct {
+	int				fd;						// -1 for the mock
+	int				mock;
+	FILE			*log;					// mock: one line per message
+	int				addr;
+	int				chunk;
+	long			clock;
+	uint8_t			buf[I2C_BATCH];
+	int				used;
+	struct i2c_msg	msgs[I2C_MAX_MSGS];
+	int				nmsgs;
+	int				failed;					// a batch flushed while queueing did not go out
+	i2cstats		stats;
+} i2cbus;
+
+i2cbus	bus;
+int		busReady = false;
+
+int busOpen(void) {
+	return busReady;
+}
+
+const i2cstats *busStats(void) {
+	return &bus.stats;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int parseBusOptions(const char *opt) {
+	char name[16];
+	long val;
+	int  n;
+
+	bus.addr  = I2C_DEFAULT_ADDR;
+	bus.chunk = 0;
+	bus.clock = I2C_DEFAULT_CLOCK;
+
+	while (*opt == ',') {
+		if (sscanf(opt + 1, "%15[a-z]=%li%n", name, &val, &n) != 2)	{return -1;}
+
+		if ((strcmp(name, "addr") == 0) && (val >= 0x03) && (val <= 0x77)) {
+			bus.addr = val;
+		} else if ((strcmp(name, "chunk") == 0) && (val >= 0) && (val <= I2C_BATCH / 2)) {
+			bus.chunk = val;
+		} else if ((strcmp(name, "clock") == 0) && (val > 0)) {
+			bus.clock = val;
+		} else {
+			return -1;
+		}
+		opt += 1 + n;
+	}
+	return (*opt == 0) ? 0 : -1;
+}
+
+int openBus(const char *spec) {
+	char dev[128];
+	unsigned long funcs = 0;
+
+	if (spec == NULL)	{spec = I2C_DEFAULT_BUS;}
+
+	size_t n = strcspn(spec, ",");
+	if ((n == 0) || (n >= sizeof(dev)) || (parseBusOptions(spec + n) < 0)) {
+		logERR(LS_DISPLAY, "Invalid I2C bus: %s\n", spec);
+		return -1;
+	}
+	memcpy(dev, spec, n);
+	dev[n] = 0;
+
+	bus.fd = -1;
+	bus.log = NULL;
+	bus.used = bus.nmsgs = 0;
+	memset(&bus.stats, 0, sizeof(bus.stats));
+
+	if (strncmp(dev, "mock", 4) == 0) {
+		bus.mock = true;
+		if ((dev[4] == ':') && ((bus.log = fopen(dev + 5, "w")) == NULL)) {
+			logERR(LS_DISPLAY, "Cannot create %s: %s\n", dev + 5, strerror(errno));
+			return -1;
+		}
+		logMSG(LS_DISPLAY, LL_INFO, "I2C mock bus, address 0x%02x, chunk %d\n", bus.addr, bus.chunk);
+		busReady = true;
+		return 0;
+	}
+
+	if (isdigit((unsigned char)dev[0])) {
+		snprintf(dev, sizeof(dev), "/dev/i2c-%d", atoi(spec));
+	}
+
+	bus.mock = false;
+	if ((bus.fd = open(dev, O_RDWR)) < 0) {
+		logERR(LS_DISPLAY, "Cannot open %s: %s\n", dev, strerror(errno));
+		return -1;
+	}
+	if ((ioctl(bus.fd, I2C_FUNCS, &funcs) < 0) || !(funcs & I2C_FUNC_I2C)) {
+		logERR(LS_DISPLAY, "%s cannot do combined transfers\n", dev);
+		close(bus.fd);
+		bus.fd = -1;
+		return -1;
+	}
+
+	logMSG(LS_DISPLAY, LL_INFO, "I2C bus %s, address 0x%02x, chunk %d\n", dev, bus.addr, bus.chunk);
+	busReady = true;
+	return 0;
+}
+
+void closeBus(void) {
+	if (!busReady)	{return;}
+
+	busFlush();
+	busReady = false;
+
+	if (bus.mock) {
+		logMSG(LS_DISPLAY, LL_INFO, "I2C mock: %lu transfers, %lu messages, %lu bytes, %.1fms on the wire\n",
+			bus.stats.transfers, bus.stats.messages, bus.stats.bytes, bus.stats.busSeconds * 1e3);
+	}
+	if (bus.log != NULL) {
+		fclose(bus.log);
+		bus.log = NULL;
+	}
+	if (bus.fd >= 0) {
+		close(bus.fd);
+		bus.fd = -1;
+	}
+}
+
+/*******************************************************************************
+ * Queueing - a message is head and data, data beyond the chunk size goes
+ * on in further messages starting with cont
+ ******************************************************************************/
+void busMessage(const uint8_t *head, int headLen, const uint8_t *data, int dataLen, uint8_t cont) {
+	int first = true;
+
+	if (!busReady)	{return;}
+
+	do {
+		int hlen = first ? headLen : 1;
+		int dlen = dataLen;
+		if ((bus.chunk > 0) && (dlen > bus.chunk))	{dlen = bus.chunk;}
+		if (dlen > I2C_BATCH / 2)					{dlen = I2C_BATCH / 2;}
+
+		if ((bus.nmsgs == I2C_MAX_MSGS) || (bus.used + hlen + dlen > I2C_BATCH)) {
+			if (busFlush() < 0)	{bus.failed = true;}
+		}
+
+		uint8_t *msg = bus.buf + bus.used;
+		if (first)	{memcpy(msg, head, hlen);}
+		else		{msg[0] = cont;}
+		if (dlen > 0)	{memcpy(msg + hlen, data, dlen);}
+
+		bus.msgs[bus.nmsgs].addr  = bus.addr;
+		bus.msgs[bus.nmsgs].flags = 0;
+		bus.msgs[bus.nmsgs].len   = hlen + dlen;
+		bus.msgs[bus.nmsgs].buf   = msg;
+		bus.nmsgs++;
+		bus.used += hlen + dlen;
+
+		data    += dlen;
+		dataLen -= dlen;
+		first    = false;
+	} while (dataLen > 0);
+}
+
+// START, address + W and an ACK per byte, a repeated START per message, STOP
+void mockTransfer(void) {
+	long bits = 1;
+
+	for (int i = 0; i < bus.nmsgs; i++) {
+		bits += 1 + 9 + 9 * bus.msgs[i].len;
+
+		if (bus.log != NULL) {
+			fprintf(bus.log, "%lu %02x %d:", bus.stats.transfers, bus.msgs[i].addr, bus.msgs[i].len);
+			for (int b = 0; b < bus.msgs[i].len; b++) {
+				fprintf(bus.log, " %02x", bus.msgs[i].buf[b]);
+			}
+			fputc('\n', bus.log);
+		}
+	}
+	bus.stats.busSeconds += (double)bits / bus.clock;
+}
+
+// the queued messages as one transfer, bytes sent or -1 also when one queued before did not go out
+int busFlush(void) {
+	int sent = bus.used;
+
+	if (!busReady)	{return 0;}
+	if (bus.nmsgs == 0) {
+		sent = bus.failed ? -1 : 0;
+		bus.failed = false;
+		return sent;
+	}
+
+	if (bus.mock) {
+		mockTransfer();
+	} else {
+		struct i2c_rdwr_ioctl_data rdwr = {bus.msgs, (__u32)bus.nmsgs};
+		if (ioctl(bus.fd, I2C_RDWR, &rdwr) < 0) {
+			logERR(LS_DISPLAY, "I2C transfer of %d messages failed: %s\n", bus.nmsgs, strerror(errno));
+			sent = -1;
+		}
+	}
+
+	if (sent >= 0) {
+		bus.stats.transfers++;
+		bus.stats.messages += bus.nmsgs;
+		bus.stats.bytes    += sent;
+		metricsCount(MC_I2C_TRANSFERS, 1);
+		metricsCount(MC_I2C_BYTES, sent);
+	}
+
+	bus.used = bus.nmsgs = 0;
+	if (bus.failed) {
+		bus.failed = false;
+		sent = -1;
+	}
+	return sent;
+}
@@ -0,0 +1,46 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef I2CBUS_H
+#define I2CBUS_H 1
+
+#include <stdint.h>
+
+#define I2C_DEFAULT_BUS		"/dev/i2c-1"
+#define I2C_DEFAULT_ADDR	0x3C
+#define I2C_DEFAULT_CLOCK	400000		// Hz, only the mock uses it
+#define I2C_MAX_MSGS		42			// I2C_RDWR_IOCTL_MAX_MSGS of the kernel
+#define I2C_BATCH			4096		// bytes queued for one transfer
+
+typedef struct {
+	unsigned long	transfers;			// I2C_RDWR calls
+	unsigned long	messages;			// START + address each
+	unsigned long	bytes;				// after the address
+	double			busSeconds;			// mock: wire time at the set clock
+} i2cstats;
+
+int   openBus(const char *spec);
+void  closeBus(void);
+int   busOpen(void);
+void  busMessage(const uint8_t *head, int headLen, const uint8_t *data, int dataLen, uint8_t cont);
+int   busFlush(void);
+const i2cstats *busStats(void);
+
+#endif
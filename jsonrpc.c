@@ -0,0 +1,195 @@
+/*
+ *	jsonrpc.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The HTTP side of the JSON-RPC transport (-s http://...). A CLI command
+ *	becomes a slim.request POST to /jsonrpc.js; the requests of a poll go
+ *	out back to back on one keep-alive connection and the server answers
+ *	them in order. An answer is framed here, by Content-Length or chunks,
+ *	and its body handed to the JSON scanner piece by piece as it comes off
+ *	the socket - the body is never collected.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jsonscan.h"
+#include "jsonrpc.h"
+
+/*******************************************************************************
+ * Requests
+ ******************************************************************************/
+int putQuoted(char *out, int size, const char *s, int len) {
+	int n = 0;
+
+	if (size < 3)	{return -1;}
+	out[n++] = '"';
+	for (int i = 0; i < len; i++) {
+		if (n + 3 > size)	{return -1;}
+		if ((s[i] == '"') || (s[i] == '\\'))	{out[n++] = '\\';}
+		out[n++] = s[i];
+	}
+	out[n++] = '"';
+	return n;
+}
+
+/*
+ * "<player> status - 1 tags:a" for <player>: the terms of the command
+ * become the array of strings slim.request takes. The length of the
+ * whole request, -1 if it does not fit.
+ */
+int rpcRequest(char *out, int size, const char *host, const char *player, const char *cmd) {
+	char body[RPC_BODY];
+	int  len, n;
+
+	len = snprintf(body, sizeof(body), "{\"id\":1,\"method\":\"slim.request\",\"params\":[");
+	if ((n = putQuoted(body + len, sizeof(body) - len, player, strlen(player))) < 0)	{return -1;}
+	len += n;
+	body[len++] = ',';
+	body[len++] = '[';
+
+	for (const char *t = cmd; *t; ) {
+		const char *end = strchr(t, ' ');
+		int tlen = (end == NULL) ? (int)strlen(t) : end - t;
+
+		if (tlen > 0) {
+			if (body[len - 1] != '[')	{body[len++] = ',';}
+			if ((n = putQuoted(body + len, sizeof(body) - len - 4, t, tlen)) < 0)	{return -1;}
+			len += n;
+		}
+		t += tlen;
+		while (*t == ' ')	{t++;}
+	}
+	len += snprintf(body + len, sizeof(body) - len, "]]}");
+
+	n = snprintf(out, size, "POST " RPC_PATH " HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+		"Content-Length: %d\r\n\r\n%s", host, len, body);
+	return (n < size) ? n : -1;
+}
+
+/*******************************************************************************
+ * Answers
+ ******************************************************************************/
+void httpReset(httpres *h) {
+	h->state   = HS_STATUS;
+	h->lineLen = 0;
+	h->status  = 0;
+	h->length  = -1;
+	h->left    = 0;
+	h->chunked = false;
+	h->close   = false;
+	h->bad     = false;
+}
+
+int headerIs(const char *line, const char *name, const char **value) {
+	int len = strlen(name);
+
+	if (strncasecmp(line, name, len) != 0)	{return false;}
+	for (*value = line + len; **value == ' '; (*value)++);
+	return true;
+}
+
+void httpLine(httpres *h) {
+	const char *value;
+	char *end;
+
+	switch (h->state) {
+		case HS_STATUS:
+			h->state = (sscanf(h->line, "HTTP/1.%*d %d", &h->status) == 1) ? HS_HEADER : HS_ERROR;
+			break;
+
+		case HS_HEADER:
+			if (h->lineLen > 0) {
+				if (headerIs(h->line, "Content-Length:", &value))		{h->length  = atol(value);}
+				if (headerIs(h->line, "Transfer-Encoding:", &value))	{h->chunked = (strcasestr(value, "chunked") != NULL);}
+				if (headerIs(h->line, "Connection:", &value))			{h->close   = (strcasestr(value, "close") != NULL);}
+				break;
+			}
+			// 100 Continue comes before the answer
+			if ((h->status >= 100) && (h->status < 200)) {
+				httpReset(h);
+			} else if (h->chunked) {
+				h->state = HS_CHUNKSIZE;
+			} else if (h->length > 0) {
+				h->left  = h->length;
+				h->state = HS_BODY;
+			} else {
+				// no length, up to the close: not a keep-alive answer
+				h->state = (h->length == 0) ? HS_DONE : HS_ERROR;
+			}
+			break;
+
+		case HS_CHUNKSIZE:
+			h->left = strtol(h->line, &end, 16);
+			if ((end == h->line) || (h->left < 0)) {
+				h->state = HS_ERROR;
+			} else {
+				h->state = (h->left == 0) ? HS_TRAILER : HS_CHUNKDATA;
+			}
+			break;
+
+		case HS_CHUNKEND:
+			h->state = (h->lineLen == 0) ? HS_CHUNKSIZE : HS_ERROR;
+			break;
+
+		case HS_TRAILER:
+			if (h->lineLen == 0)	{h->state = HS_DONE;}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * Bytes off the socket: the ones that belong to this answer are taken,
+ * the body goes to the scanner while it is JSON. HS_DONE ends the answer,
+ * HS_ERROR the connection.
+ */
+int httpFeed(httpres *h, const char *data, int len, jsonscan *js) {
+	int used = 0;
+
+	while ((used < len) && (h->state != HS_DONE) && (h->state != HS_ERROR)) {
+		if ((h->state == HS_BODY) || (h->state == HS_CHUNKDATA)) {
+			int n = (len - used < h->left) ? len - used : (int)h->left;
+
+			if (!h->bad && (h->status == 200) && (jsonFeed(js, data + used, n) < 0)) {
+				h->bad = true;
+			}
+			used    += n;
+			h->left -= n;
+			if (h->left == 0) {
+				h->state = (h->state == HS_BODY) ? HS_DONE : HS_CHUNKEND;
+			}
+			continue;
+		}
+
+		char c = data[used++];
+		if (c == '\r')	{continue;}
+		if (c != '\n') {
+			if (h->lineLen < RPC_LINE - 1)	{h->line[h->lineLen++] = c;}
+			continue;
+		}
+		h->line[h->lineLen] = 0;
+		httpLine(h);
+		h->lineLen = 0;
+	}
+	return used;
+}
@@ -0,0 +1,48 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef JSONRPC_H
+#define JSONRPC_H 1
+
+#include "jsonscan.h"
+
+#define RPC_PATH		"/jsonrpc.js"
+#define RPC_BODY		512			// longest request body
+#define RPC_LINE		256			// status and header lines, longer ones are cut
+
+typedef enum {HS_STATUS, HS_HEADER, HS_BODY, HS_CHUNKSIZE, HS_CHUNKDATA, HS_CHUNKEND, HS_TRAILER, HS_DONE, HS_ERROR} httpstate_t;
+
+typedef struct {
+	httpstate_t	state;
+	char		line[RPC_LINE];
+	int			lineLen;
+	int			status;
+	long		length;					// Content-Length, -1 none
+	long		left;					// of the body or the chunk
+	int			chunked;
+	int			close;					// Connection: close
+	int			bad;					// the body is not JSON
+} httpres;
+
+int   rpcRequest(char *out, int size, const char *host, const char *player, const char *cmd);
+void  httpReset(httpres *h);
+int   httpFeed(httpres *h, const char *data, int len, jsonscan *js);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ *	jsonscan.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	An incremental JSON scanner for the JSON-RPC answers of the server.
+ *	It takes the body in whatever pieces the socket delivers, keeps the
+ *	path to the value being read (the member key of every object level and
+ *	the element of every array level) and asks the caller where a value
+ *	goes when it starts. Strings are unescaped straight into that buffer,
+ *	a byte at a time and compared with what it held on the way, so a tag
+ *	that did not change is neither copied around nor compared again. No
+ *	allocation, no copy of the body; values nobody asks for are skipped.
+ *	Literals are not spelt out: true, false and null are told by their
+ *	first letter.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonscan.h"
+
+typedef enum {
+	JS_VALUE,			// a value
+	JS_MEMBER,			// after {: a key or }
+	JS_KEY,				// after ,: a key
+	JS_COLON,
+	JS_ELEMENT,			// after [: a value or ]
+	JS_NEXT,			// after a value: , or the end of its object or array
+	JS_STRING,
+	JS_ESCAPE,
+	JS_UNICODE,
+	JS_SCALAR,
+	JS_DONE,
+	JS_ERROR
+} jsonstate_t;
+
+void jsonStart(jsonscan *js, jsonfield_t field, jsonvalue_t value, void *ctx) {
+	memset(js, 0, sizeof(*js));
+	js->state = JS_VALUE;
+	js->field = field;
+	js->value = value;
+	js->ctx   = ctx;
+}
+
+int jsonComplete(const jsonscan *js) {
+	return js->state == JS_DONE;
+}
+
+const char *jsonKey(const jsonscan *js, int level) {
+	return ((level >= 0) && (level < js->depth) && !js->isArray[level]) ? js->key[level] : "";
+}
+
+int jsonIndex(const jsonscan *js, int level) {
+	return ((level >= 0) && (level < js->depth) && js->isArray[level]) ? js->index[level] : -1;
+}
+
+/*******************************************************************************
+ * Output - in place, a byte is written only when it differs
+ ******************************************************************************/
+
+// whole characters only: one that does not fit ends the value
+void putBytes(jsonscan *js, const char *p, int n) {
+	if (js->out == NULL)	{return;}
+
+	if (js->outLen + n > js->outSize - 1) {
+		js->truncated = true;
+		js->outSize   = js->outLen + 1;
+		return;
+	}
+	for (int i = 0; i < n; i++, js->outLen++) {
+		if (js->out[js->outLen] != p[i]) {
+			js->out[js->outLen] = p[i];
+			js->changed = true;
+		}
+	}
+}
+
+void putCode(jsonscan *js, int cp) {
+	char utf[4];
+	int  n;
+
+	if (cp < 0x80) {
+		utf[0] = cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		utf[0] = 0xC0 | (cp >> 6);
+		utf[1] = 0x80 | (cp & 0x3F);
+		n = 2;
+	} else if (cp < 0x10000) {
+		utf[0] = 0xE0 | (cp >> 12);
+		utf[1] = 0x80 | ((cp >> 6) & 0x3F);
+		utf[2] = 0x80 | (cp & 0x3F);
+		n = 3;
+	} else {
+		utf[0] = 0xF0 | (cp >> 18);
+		utf[1] = 0x80 | ((cp >> 12) & 0x3F);
+		utf[2] = 0x80 | ((cp >> 6) & 0x3F);
+		utf[3] = 0x80 | (cp & 0x3F);
+		n = 4;
+	}
+	putBytes(js, utf, n);
+}
+
+// a high surrogate without its low half
+void flushHigh(jsonscan *js) {
+	if (js->high) {
+		js->high = 0;
+		putCode(js, 0xFFFD);
+	}
+}
+
+void putEscaped(jsonscan *js, int code) {
+	if (js->high) {
+		int high = js->high;
+		js->high = 0;
+		if ((code >= 0xDC00) && (code <= 0xDFFF)) {
+			putCode(js, 0x10000 + ((high - 0xD800) << 10) + (code - 0xDC00));
+			return;
+		}
+		putCode(js, 0xFFFD);
+	}
+	if ((code >= 0xD800) && (code <= 0xDBFF)) {
+		js->high = code;
+		return;
+	}
+	putCode(js, ((code >= 0xDC00) && (code <= 0xDFFF)) ? 0xFFFD : code);
+}
+
+// raw UTF-8 of the body: a character goes out when its last byte is in
+void putRaw(jsonscan *js, unsigned char c) {
+	flushHigh(js);
+
+	if (js->seqNeed > 0) {
+		if ((c & 0xC0) == 0x80) {
+			js->seq[js->seqLen++] = c;
+			if (js->seqLen == js->seqNeed) {
+				putBytes(js, js->seq, js->seqLen);
+				js->seqNeed = 0;
+			}
+			return;
+		}
+		js->seqNeed = 0;		// broken, dropped
+	}
+
+	if (c < 0x80) {
+		putBytes(js, (const char *)&c, 1);
+		return;
+	}
+	if      ((c & 0xE0) == 0xC0)	{js->seqNeed = 2;}
+	else if ((c & 0xF0) == 0xE0)	{js->seqNeed = 3;}
+	else if ((c & 0xF8) == 0xF0)	{js->seqNeed = 4;}
+	else							{return;}
+	js->seq[0] = c;
+	js->seqLen = 1;
+}
+
+/*******************************************************************************
+ * Structure
+ ******************************************************************************/
+int fail(jsonscan *js) {
+	js->state = JS_ERROR;
+	return -1;
+}
+
+void afterValue(jsonscan *js) {
+	js->state = (js->depth == 0) ? JS_DONE : JS_NEXT;
+}
+
+void endValue(jsonscan *js) {
+	if (js->out != NULL) {
+		// the old value went on
+		if (js->out[js->outLen] != 0)	{js->changed = true;}
+		js->out[js->outLen] = 0;
+		if (js->value != NULL)	{js->value(js, js->out, js->outLen);}
+	}
+	afterValue(js);
+}
+
+void endString(jsonscan *js) {
+	flushHigh(js);
+	js->seqNeed = 0;
+
+	if (!js->inKey) {
+		endValue(js);
+		return;
+	}
+	// a cut key matches nothing
+	char *key = js->key[js->depth - 1];
+	key[js->truncated ? 0 : js->outLen] = 0;
+	js->state = JS_COLON;
+}
+
+void startString(jsonscan *js, char *out, int size, int inKey) {
+	js->out       = ((out != NULL) && (size > 0)) ? out : NULL;
+	js->outSize   = size;
+	js->outLen    = 0;
+	js->truncated = false;
+	js->changed   = false;
+	js->inKey     = inKey;
+	js->high      = 0;
+	js->seqNeed   = 0;
+}
+
+int startValue(jsonscan *js, int c) {
+	int size = 0;
+
+	if ((c == '{') || (c == '[')) {
+		if (js->depth == JSON_DEPTH)	{return fail(js);}
+		int d = js->depth++;
+		js->isArray[d] = (c == '[');
+		js->key[d][0]  = 0;
+		js->index[d]   = 0;
+		js->state      = js->isArray[d] ? JS_ELEMENT : JS_MEMBER;
+		return 0;
+	}
+
+	if      (c == '"')								{js->type = JT_STRING;}
+	else if ((c == '-') || ((c >= '0') && (c <= '9')))	{js->type = JT_NUMBER;}
+	else if (c == 't')								{js->type = JT_TRUE;}
+	else if (c == 'f')								{js->type = JT_FALSE;}
+	else if (c == 'n')								{js->type = JT_NULL;}
+	else											{return fail(js);}
+
+	char *out = (js->field != NULL) ? js->field(js, &size) : NULL;
+	startString(js, out, size, false);
+
+	if (c == '"') {
+		js->state = JS_STRING;
+	} else {
+		putBytes(js, (const char *)&c, 1);
+		js->state = JS_SCALAR;
+	}
+	return 0;
+}
+
+int closeLevel(jsonscan *js, int array) {
+	if ((js->depth == 0) || (js->isArray[js->depth - 1] != array))	{return fail(js);}
+	js->depth--;
+	afterValue(js);
+	return 0;
+}
+
+int structural(jsonscan *js, int c) {
+	switch (js->state) {
+		case JS_MEMBER:
+			if (c == '}')	{return closeLevel(js, false);}
+			// fall through
+		case JS_KEY:
+			if (c != '"')	{return fail(js);}
+			startString(js, js->key[js->depth - 1], JSON_KEYLEN, true);
+			js->state = JS_STRING;
+			return 0;
+
+		case JS_COLON:
+			if (c != ':')	{return fail(js);}
+			js->state = JS_VALUE;
+			return 0;
+
+		case JS_ELEMENT:
+			if (c == ']')	{return closeLevel(js, true);}
+			// fall through
+		case JS_VALUE:
+			return startValue(js, c);
+
+		case JS_NEXT:
+			if (c == '}')	{return closeLevel(js, false);}
+			if (c == ']')	{return closeLevel(js, true);}
+			if (c != ',')	{return fail(js);}
+			if (js->isArray[js->depth - 1]) {
+				js->index[js->depth - 1]++;
+				js->state = JS_VALUE;
+			} else {
+				js->state = JS_KEY;
+			}
+			return 0;
+
+		default:
+			// something after the value
+			return fail(js);
+	}
+}
+
+int hexDigit(int c) {
+	if ((c >= '0') && (c <= '9'))	{return c - '0';}
+	if ((c >= 'a') && (c <= 'f'))	{return c - 'a' + 10;}
+	if ((c >= 'A') && (c <= 'F'))	{return c - 'A' + 10;}
+	return -1;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+
+// a piece of the body; -1 once it is not JSON
+int jsonFeed(jsonscan *js, const char *data, int len) {
+	for (int i = 0; (i < len) && (js->state != JS_ERROR); i++) {
+		unsigned char c = data[i];
+		int v;
+
+		switch (js->state) {
+			case JS_STRING:
+				if (c == '"')		{endString(js);}
+				else if (c == '\\')	{js->state = JS_ESCAPE;}
+				else if (c < 0x20)	{fail(js);}
+				else				{putRaw(js, c);}
+				break;
+
+			case JS_ESCAPE:
+				js->state = JS_STRING;
+				switch (c) {
+					case '"': case '\\': case '/':	putEscaped(js, c);		break;
+					case 'b':	putEscaped(js, '\b');	break;
+					case 'f':	putEscaped(js, '\f');	break;
+					case 'n':	putEscaped(js, '\n');	break;
+					case 'r':	putEscaped(js, '\r');	break;
+					case 't':	putEscaped(js, '\t');	break;
+					case 'u':
+						js->hex   = 0;
+						js->code  = 0;
+						js->state = JS_UNICODE;
+						break;
+					default:	fail(js);				break;
+				}
+				break;
+
+			case JS_UNICODE:
+				if ((v = hexDigit(c)) < 0) {
+					fail(js);
+					break;
+				}
+				js->code = (js->code << 4) | v;
+				if (++js->hex == 4) {
+					putEscaped(js, js->code);
+					js->state = JS_STRING;
+				}
+				break;
+
+			case JS_SCALAR:
+				if (((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+					(c == '.') || (c == '+') || (c == '-')) {
+					putBytes(js, (const char *)&c, 1);
+					break;
+				}
+				endValue(js);
+				i--;				// the character after it is structure
+				break;
+
+			default:
+				if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))	{break;}
+				structural(js, c);
+				break;
+		}
+	}
+	return (js->state == JS_ERROR) ? -1 : 0;
+}
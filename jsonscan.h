@@ -0,0 +1,69 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef JSONSCAN_H
+#define JSONSCAN_H 1
+
+#define JSON_DEPTH		8			// nested objects and arrays
+#define JSON_KEYLEN		32			// longer keys match nothing
+
+typedef enum {JT_STRING, JT_NUMBER, JT_TRUE, JT_FALSE, JT_NULL} jsontype_t;
+
+typedef struct JsonScan jsonscan;
+
+/*
+ * field: where the value starting now goes, NULL skips it; size counts
+ * the closing 0. value: it is complete there, changed when a byte differs
+ * from what the buffer held.
+ */
+typedef char *(*jsonfield_t)(jsonscan *js, int *size);
+typedef void  (*jsonvalue_t)(jsonscan *js, char *value, int len);
+
+struct JsonScan {
+	int			state;
+	int			depth;						// open objects and arrays
+	char		isArray[JSON_DEPTH];
+	char		key[JSON_DEPTH][JSON_KEYLEN];	// member of each object level
+	int			index[JSON_DEPTH];			// element of each array level
+	char		*out;						// the value or key being written
+	int			outSize;
+	int			outLen;
+	int			inKey;
+	int			truncated;
+	int			changed;
+	jsontype_t	type;
+	int			hex;						// \u digits read
+	int			code;
+	int			high;						// a high surrogate waiting for its pair
+	char		seq[4];						// a UTF-8 character split between two reads
+	int			seqLen;
+	int			seqNeed;
+	jsonfield_t	field;
+	jsonvalue_t	value;
+	void		*ctx;
+};
+
+void  jsonStart(jsonscan *js, jsonfield_t field, jsonvalue_t value, void *ctx);
+int   jsonFeed(jsonscan *js, const char *data, int len);
+int   jsonComplete(const jsonscan *js);
+const char *jsonKey(const jsonscan *js, int level);
+int   jsonIndex(const jsonscan *js, int level);
+
+#endif
@@ -0,0 +1,519 @@
+/*
+ *	kernels.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The inner loops of the frame buffer (span fill and blit) and of the
+ *	CLI field decoding, each in a scalar, a NEON and an SSE2/AVX2 variant.
+ *	The binary is built for the base of its machine class (ARMv6 on a 32
+ *	bit Pi, any x86-64), the wider variants are compiled for their own
+ *	instruction set and picked at startup from the hwcaps of the kernel
+ *	or cpuid - one build is at home on a Pi Zero, a Pi 5 and the x86
+ *	test hosts. -K runs every variant the CPU has and prints its rate.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "display.h"
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86		1
+#define TARGET_SSE2		__attribute__((target("sse2")))
+#define TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define KERNEL_NEON		1
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD		(1 << 1)
+#endif
+#elif defined(__arm__) && defined(__ARM_ARCH) && (__GNUC__ >= 8)
+// an ARMv6 build: NEON only in the functions for it, run where the kernel reports it
+#pragma GCC push_options
+#pragma GCC target("arch=armv7-a,fpu=neon")
+#include <arm_neon.h>
+#pragma GCC pop_options
+#include <sys/auxv.h>
+#define KERNEL_NEON		1
+#define KERNEL_NEON32	1
+#ifndef HWCAP_ARM_NEON
+#define HWCAP_ARM_NEON	(1 << 12)
+#endif
+#endif
+
+typedef struct {
+	fillspan_t	fill;
+	blitspan_t	blit;
+	pctdecode_t	decode;
+} kernelset;
+
+const char *variantNames[MAXVARIANTS] = {"scalar", "neon", "sse2", "avx2"};
+const char *kernelNames[MAXKERNELS]   = {"fill", "blit", "decode"};
+
+const char *variantName(kvariant_t v) {
+	return (v < MAXVARIANTS) ? variantNames[v] : "none";
+}
+
+/*******************************************************************************
+ * Scalar - 8 bytes a step in a 64 bit word
+ ******************************************************************************/
+void fillScalar(uint8_t *row, int n, uint8_t mask, uint8_t fill) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memset(row, fill, n);
+		return;
+	}
+
+	uint64_t m = 0x0101010101010101ull * mask;
+	uint64_t f = 0x0101010101010101ull * (uint8_t)(fill & mask);
+	for (; i + 8 <= n; i += 8) {
+		uint64_t r;
+		memcpy(&r, row + i, 8);
+		r = (r & ~m) | f;
+		memcpy(row + i, &r, 8);
+	}
+	for (; i < n; i++) {
+		row[i] = (row[i] & ~mask) | (fill & mask);
+	}
+}
+
+void blitScalar(uint8_t *row, const uint8_t *src, int n, uint8_t mask) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memcpy(row, src, n);
+		return;
+	}
+
+	uint64_t m = 0x0101010101010101ull * mask;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t r, b;
+		memcpy(&r, row + i, 8);
+		memcpy(&b, src + i, 8);
+		r = (r & ~m) | (b & m);
+		memcpy(row + i, &r, 8);
+	}
+	for (; i < n; i++) {
+		row[i] = (row[i] & ~mask) | (src[i] & mask);
+	}
+}
+
+static inline int hexValue(int c) {
+	if ((c >= '0') && (c <= '9'))	{return c - '0';}
+	if ((c >= 'a') && (c <= 'f'))	{return c - 'a' + 10;}
+	if ((c >= 'A') && (c <= 'F'))	{return c - 'A' + 10;}
+	return -1;
+}
+
+// the character at s[*at], + is a blank, %HH a byte; -1 for a broken escape
+static inline int pctChar(const char *s, int len, int *at) {
+	int c = (unsigned char)s[(*at)++];
+	int high, low;
+
+	if (c == '+')	{return ' ';}
+	if (c != '%')	{return c;}
+
+	if ((*at + 2 > len) || ((high = hexValue(s[*at])) < 0) || ((low = hexValue(s[*at + 1])) < 0))	{return -1;}
+	*at += 2;
+	return (high << 4) | low;
+}
+
+// the rest from at on, the length of out
+static inline int pctTail(const char *s, int len, int at, char *out, char *o) {
+	while (at < len) {
+		int c = pctChar(s, len, &at);
+		if (c < 0)	{return -1;}
+		*o++ = c;
+	}
+	*o = 0;
+	return o - out;
+}
+
+int decodeScalar(const char *s, int len, char *out) {
+	return pctTail(s, len, 0, out, out);
+}
+
+/*******************************************************************************
+ * NEON - 16 bytes a step
+ ******************************************************************************/
+#ifdef KERNEL_NEON
+#ifdef KERNEL_NEON32
+#pragma GCC push_options
+#pragma GCC target("arch=armv7-a,fpu=neon")
+#endif
+
+void fillNEON(uint8_t *row, int n, uint8_t mask, uint8_t fill) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memset(row, fill, n);
+		return;
+	}
+
+	uint8x16_t vm = vdupq_n_u8(mask);
+	uint8x16_t vf = vdupq_n_u8(fill);
+	for (; i + 16 <= n; i += 16) {
+		vst1q_u8(row + i, vbslq_u8(vm, vf, vld1q_u8(row + i)));
+	}
+	fillScalar(row + i, n - i, mask, fill);
+}
+
+void blitNEON(uint8_t *row, const uint8_t *src, int n, uint8_t mask) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memcpy(row, src, n);
+		return;
+	}
+
+	uint8x16_t vm = vdupq_n_u8(mask);
+	for (; i + 16 <= n; i += 16) {
+		vst1q_u8(row + i, vbslq_u8(vm, vld1q_u8(src + i), vld1q_u8(row + i)));
+	}
+	blitScalar(row + i, src + i, n - i, mask);
+}
+
+// runs without % and + go through 16 bytes at a time
+int decodeNEON(const char *s, int len, char *out) {
+	uint8x16_t pct  = vdupq_n_u8('%');
+	uint8x16_t plus = vdupq_n_u8('+');
+	char *o = out;
+	int  at = 0;
+
+	while (at + 16 <= len) {
+		uint8x16_t v  = vld1q_u8((const uint8_t *)s + at);
+		uint8x16_t sp = vorrq_u8(vceqq_u8(v, pct), vceqq_u8(v, plus));
+		uint64x2_t w  = vreinterpretq_u64_u8(sp);
+
+		if ((vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) == 0) {
+			vst1q_u8((uint8_t *)o, v);
+			o  += 16;
+			at += 16;
+			continue;
+		}
+		// the plain bytes before the first special one, then it
+		while ((s[at] != '%') && (s[at] != '+'))	{*o++ = s[at++];}
+
+		int c = pctChar(s, len, &at);
+		if (c < 0)	{return -1;}
+		*o++ = c;
+	}
+	return pctTail(s, len, at, out, o);
+}
+
+#ifdef KERNEL_NEON32
+#pragma GCC pop_options
+#endif
+#endif
+
+/*******************************************************************************
+ * SSE2 and AVX2 - 16 and 32 bytes a step, decoding in SSE2 only
+ ******************************************************************************/
+#ifdef KERNEL_X86
+TARGET_SSE2 void fillSSE2(uint8_t *row, int n, uint8_t mask, uint8_t fill) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memset(row, fill, n);
+		return;
+	}
+
+	__m128i vm = _mm_set1_epi8((char)mask);
+	__m128i vf = _mm_set1_epi8((char)(fill & mask));
+	for (; i + 16 <= n; i += 16) {
+		__m128i r = _mm_loadu_si128((const __m128i *)(row + i));
+		_mm_storeu_si128((__m128i *)(row + i), _mm_or_si128(_mm_andnot_si128(vm, r), vf));
+	}
+	fillScalar(row + i, n - i, mask, fill);
+}
+
+TARGET_SSE2 void blitSSE2(uint8_t *row, const uint8_t *src, int n, uint8_t mask) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memcpy(row, src, n);
+		return;
+	}
+
+	__m128i vm = _mm_set1_epi8((char)mask);
+	for (; i + 16 <= n; i += 16) {
+		__m128i r = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(row + i), _mm_or_si128(_mm_andnot_si128(vm, r), _mm_and_si128(vm, b)));
+	}
+	blitScalar(row + i, src + i, n - i, mask);
+}
+
+// runs without % and + are copied 16 bytes at a time, up to the first special one
+TARGET_SSE2 int decodeSSE2(const char *s, int len, char *out) {
+	__m128i pct  = _mm_set1_epi8('%');
+	__m128i plus = _mm_set1_epi8('+');
+	char *o = out;
+	int  at = 0;
+
+	while (at + 16 <= len) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + at));
+		int special = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, plus)));
+
+		if (special == 0) {
+			_mm_storeu_si128((__m128i *)o, v);
+			o  += 16;
+			at += 16;
+			continue;
+		}
+		int plain = __builtin_ctz(special);
+		memcpy(o, s + at, plain);
+		o  += plain;
+		at += plain;
+
+		int c = pctChar(s, len, &at);
+		if (c < 0)	{return -1;}
+		*o++ = c;
+	}
+	return pctTail(s, len, at, out, o);
+}
+
+TARGET_AVX2 void fillAVX2(uint8_t *row, int n, uint8_t mask, uint8_t fill) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memset(row, fill, n);
+		return;
+	}
+
+	__m256i vm = _mm256_set1_epi8((char)mask);
+	__m256i vf = _mm256_set1_epi8((char)(fill & mask));
+	for (; i + 32 <= n; i += 32) {
+		__m256i r = _mm256_loadu_si256((const __m256i *)(row + i));
+		_mm256_storeu_si256((__m256i *)(row + i), _mm256_or_si256(_mm256_andnot_si256(vm, r), vf));
+	}
+	fillSSE2(row + i, n - i, mask, fill);
+}
+
+TARGET_AVX2 void blitAVX2(uint8_t *row, const uint8_t *src, int n, uint8_t mask) {
+	int i = 0;
+
+	if (mask == 0xFF) {
+		memcpy(row, src, n);
+		return;
+	}
+
+	__m256i vm = _mm256_set1_epi8((char)mask);
+	for (; i + 32 <= n; i += 32) {
+		__m256i r = _mm256_loadu_si256((const __m256i *)(row + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(row + i), _mm256_or_si256(_mm256_andnot_si256(vm, r), _mm256_and_si256(vm, b)));
+	}
+	blitSSE2(row + i, src + i, n - i, mask);
+}
+#endif
+
+/*******************************************************************************
+ * Dispatch
+ ******************************************************************************/
+const kernelset kernelSets[MAXVARIANTS] = {
+	{fillScalar, blitScalar, decodeScalar},
+#ifdef KERNEL_NEON
+	{fillNEON, blitNEON, decodeNEON},
+#else
+	{NULL, NULL, NULL},
+#endif
+#ifdef KERNEL_X86
+	{fillSSE2, blitSSE2, decodeSSE2},
+	{fillAVX2, blitAVX2, NULL},		// 32 bytes without an escape are rare in tags, SSE2 decodes faster
+#else
+	{NULL, NULL, NULL},
+	{NULL, NULL, NULL},
+#endif
+};
+
+kernels kern = {fillScalar, blitScalar, decodeScalar, {KV_SCALAR, KV_SCALAR, KV_SCALAR}};
+
+int cpuHas(kvariant_t v) {
+	switch (v) {
+		case KV_SCALAR:
+			return true;
+
+#if defined(KERNEL_NEON) && defined(__aarch64__)
+		case KV_NEON:
+			return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#elif defined(KERNEL_NEON)
+		case KV_NEON:
+			return (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) != 0;
+#endif
+
+#ifdef KERNEL_X86
+		case KV_SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+
+		case KV_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+
+		default:
+			return false;
+	}
+}
+
+static const void *kernelOf(const kernelset *ks, kernel_t k) {
+	switch (k) {
+		case KN_FILL:	return (const void *)ks->fill;
+		case KN_BLIT:	return (const void *)ks->blit;
+		default:		return (const void *)ks->decode;
+	}
+}
+
+// the widest variant the CPU runs, for every kernel on its own
+void initKernels(void) {
+	for (int k = 0; k < MAXKERNELS; k++) {
+		kvariant_t best = KV_SCALAR;
+		for (int v = KV_SCALAR + 1; v < MAXVARIANTS; v++) {
+			if ((kernelOf(&kernelSets[v], (kernel_t)k) != NULL) && cpuHas((kvariant_t)v))	{best = (kvariant_t)v;}
+		}
+		kern.variant[k] = best;
+	}
+	kern.fillSpan  = kernelSets[kern.variant[KN_FILL]].fill;
+	kern.blitSpan  = kernelSets[kern.variant[KN_BLIT]].blit;
+	kern.pctDecode = kernelSets[kern.variant[KN_DECODE]].decode;
+
+	logMSG(LS_MAIN, LL_INFO, "Kernels: fill %s, blit %s, decode %s\n", variantNames[kern.variant[KN_FILL]],
+		variantNames[kern.variant[KN_BLIT]], variantNames[kern.variant[KN_DECODE]]);
+}
+
+/*******************************************************************************
+ * -K: every variant against the scalar one, then its rate
+ ******************************************************************************/
+#define BENCH_TEXT		4096
+
+uint8_t benchFrame[DISPLAY_PAGES][DISPLAY_WIDTH];
+uint8_t benchSrc[DISPLAY_WIDTH];
+char    benchText[BENCH_TEXT];
+char    benchOut[BENCH_TEXT + 1];
+int     benchLen = 0;
+
+// field values as the CLI sends them: mostly plain, a few escapes
+void benchInput(void) {
+	const char *parts[] = {
+		"Hello%20W%C3%B6rld", "Some+long+album+title+%28Remastered+2011%29",
+		"the_quick_brown_fox_jumps_over_the_lazy_dog.0123456789-ABCDEFGHIJKLMNOPQRSTUVWXYZ",
+		"%E3%81%93%E3%82%93%E3%81%AB%E3%81%A1%E3%81%AF", "Symphony.No.5.in.C.minor.Op.67.I.Allegro.con.brio",
+	};
+
+	benchLen = 0;
+	for (int i = 0; benchLen < BENCH_TEXT - 128; i++) {
+		const char *p = parts[i % 5];
+		memcpy(benchText + benchLen, p, strlen(p));
+		benchLen += strlen(p);
+	}
+	for (int i = 0; i < DISPLAY_WIDTH; i++) {
+		benchSrc[i] = (uint8_t)(i * 37 + 11);
+	}
+}
+
+// one pass over the frame or the text, its bytes
+static long benchPass(const kernelset *ks, kernel_t k, int pass) {
+	switch (k) {
+		case KN_FILL:
+			for (int page = 0; page < DISPLAY_PAGES; page++) {
+				ks->fill(benchFrame[page], DISPLAY_WIDTH, 0x3C, (uint8_t)pass);
+			}
+			return DISPLAY_PAGES * DISPLAY_WIDTH;
+
+		case KN_BLIT:
+			for (int page = 0; page < DISPLAY_PAGES; page++) {
+				ks->blit(benchFrame[page], benchSrc, DISPLAY_WIDTH, (uint8_t)(0x0F << (pass & 3)));
+			}
+			return DISPLAY_PAGES * DISPLAY_WIDTH;
+
+		default:
+			ks->decode(benchText, benchLen, benchOut);
+			return benchLen;
+	}
+}
+
+// the same results as the scalar variant: every length, offset and mask of a span, every cut of the text
+static int benchMatch(const kernelset *ks, kernel_t k) {
+	uint8_t want[DISPLAY_WIDTH], got[DISPLAY_WIDTH];
+	char    wantText[BENCH_TEXT + 1];
+	const kernelset *sc = &kernelSets[KV_SCALAR];
+
+	if (k == KN_DECODE) {
+		for (int len = 0; len <= benchLen; len += (len < 256) ? 1 : 97) {
+			int a = sc->decode(benchText, len, wantText);
+			int b = ks->decode(benchText, len, benchOut);
+			if ((a != b) || ((a >= 0) && (memcmp(wantText, benchOut, a + 1) != 0)))	{return false;}
+		}
+		return true;
+	}
+
+	for (int n = 0; n <= DISPLAY_WIDTH; n++) {
+		for (int mask = 1; mask < 256; mask += 17) {
+			int at = (n * 7) % (DISPLAY_WIDTH - n + 1);
+			for (int i = 0; i < DISPLAY_WIDTH; i++) {
+				want[i] = got[i] = (uint8_t)(i * 13 + n);
+			}
+			if (k == KN_FILL) {
+				sc->fill(want + at, n, mask, 0xA5);
+				ks->fill(got + at, n, mask, 0xA5);
+			} else {
+				sc->blit(want + at, benchSrc, n, mask);
+				ks->blit(got + at, benchSrc, n, mask);
+			}
+			if (memcmp(want, got, sizeof(want)) != 0)	{return false;}
+		}
+	}
+	return true;
+}
+
+int benchKernels(void) {
+	int rc = 0;
+
+	benchInput();
+
+	for (int k = 0; k < MAXKERNELS; k++) {
+		for (int v = 0; v < MAXVARIANTS; v++) {
+			const kernelset *ks = &kernelSets[v];
+			if ((kernelOf(ks, (kernel_t)k) == NULL) || !cpuHas((kvariant_t)v))	{continue;}
+
+			int  match = benchMatch(ks, (kernel_t)k);
+			long bytes = 0;
+			int  pass  = 0;
+			long start = metricsNow(), now;
+			do {
+				bytes += benchPass(ks, (kernel_t)k, pass++);
+				now = metricsNow();
+			} while (now - start < KERNEL_BENCH_NS);
+
+			printf("kernel %-6s %-6s %8.0f MB/s match=%s%s\n", kernelNames[k], variantNames[v],
+				bytes * 1e3 / (now - start), match ? "yes" : "NO", (kern.variant[k] == v) ? " chosen" : "");
+			if (!match)	{rc = -1;}
+		}
+	}
+	return rc;
+}
@@ -0,0 +1,53 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H 1
+
+#include <stdint.h>
+
+#define KERNEL_BENCH_NS	200000000L		// per kernel and variant
+
+typedef enum {KV_SCALAR, KV_NEON, KV_SSE2, KV_AVX2, MAXVARIANTS} kvariant_t;
+
+typedef enum {KN_FILL, KN_BLIT, KN_DECODE, MAXKERNELS} kernel_t;
+
+// row = (row & ~mask) | (fill & mask), the same mask in every byte
+typedef void (*fillspan_t)(uint8_t *row, int n, uint8_t mask, uint8_t fill);
+// row = (row & ~mask) | (src & mask)
+typedef void (*blitspan_t)(uint8_t *row, const uint8_t *src, int n, uint8_t mask);
+// len bytes of a percent encoded CLI field to out (len + 1 bytes), the length or -1
+typedef int  (*pctdecode_t)(const char *s, int len, char *out);
+
+typedef struct {
+	fillspan_t	fillSpan;
+	blitspan_t	blitSpan;
+	pctdecode_t	pctDecode;
+	kvariant_t	variant[MAXKERNELS];
+} kernels;
+
+extern kernels kern;			// scalar until initKernels()
+
+void  initKernels(void);
+const char *variantName(kvariant_t v);
+int   cpuHas(kvariant_t v);
+int   benchKernels(void);
+
+#endif
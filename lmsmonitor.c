@@ -31,50 +31,628 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "tagUtils.h"
 #include "mixermon.h"
 #include "sliminfo.h"
 #include "display.h"
 #include "common.h"
-
-#ifdef __arm__
-
-#include "ArduiPi_OLED_lib.h"
-#include "Adafruit_GFX.h"
-#include "ArduiPi_OLED.h"
-#include "display.h"
-
-#endif
+#include "logger.h"
+#include "tagstream.h"
+#include "metrics.h"
+#include "reactor.h"
+#include "trace.h"
+#include "fbstream.h"
+#include "snapshot.h"
+#include "broker.h"
+#include "fbbench.h"
+#include "pollsched.h"
+#include "playlist.h"
+#include "sysstats.h"
+#include "config.h"
+#include "players.h"
+#include "termscreen.h"
+#include "carousel.h"
+#include "kernels.h"
 
 #define SLEEP_TIME	(25000/25)
 #define CHRPIXEL 8
+#define MARQUEE_STEP	8		// pixels a too long line scrolls per refresh
+#define UPNEXT_ROWS		5
+#define UPNEXT_AHEAD	24		// entries the up next page scrolls through
+#define UPNEXT_STEP		2		// refreshes per scrolled entry
+#define SYS_ROWS		4
+#define TERM_VOLBAR		12		// cells of the volume bar on a terminal
+
+typedef enum {TEXT_OFF, TEXT_SCREEN, TEXT_PLAIN} textmode_t;	// -t, -T
 
 char stbl[BSIZE];
 tag *tags;
 
+#define LINE_NUM CONFIG_LINES
+tagtypes_t layout[LINE_NUM][CONFIG_TAGS + 1] = {
+	{COMPOSER,    ARTIST,       MAXTAG_TYPES},
+	{ALBUM,       MAXTAG_TYPES, MAXTAG_TYPES},
+	{TITLE,       MAXTAG_TYPES, MAXTAG_TYPES},
+	{ALBUMARTIST, CONDUCTOR,    MAXTAG_TYPES},
+};
+int scrollPos[LINE_NUM];
+int termScroll[LINE_NUM];		// cells, the same lines on a terminal
+
+int  pageDwell  = 0;			// s per page, -p
+char pageSpec[CAROUSEL_SPEC] = {0};	// -g: the pages in turn, "" the ones of -p and -y
+int  upNextOn   = false;		// -p
+int  systemRate = 0;			// -y: ms between samples, 0 no system page
+char sysShown[SYS_ROWS][DISPLAY_WIDTH / CHAR_WIDTH + 1];
+int  upNextTop  = 0;			// entries scrolled past the one after the current
+int  upNextTick = 0;
+int  upNextCur  = -1;
+
+long startupBegin;				// ns, start of main
+long firstPixel = 0;			// ns after startupBegin, 0 not yet
+long firstMeta  = 0;
+int  benchStartup = false;		// -b: report the startup times and leave
+char serverName[128];			// -c: the server of the config file
+
+/*******************************************************************************
+ * Screen updates - shared by the thread mode main loop and the reactor
+ ******************************************************************************/
+void drawVolume(long actVolume, char *buff) {
+	sprintf(buff, "Vol:             %3ld%%", actVolume);
+	putText(0, 0, buff);
+	drawHorizontalBargraph(24, 2, 75, 4, actVolume);
+
+	sprintf(buff, "%4ld%%", actVolume);
+	termText(0, 0, "Vol");
+	termBar(0, 4, TERM_VOLBAR, actVolume);
+	termText(0, 4 + TERM_VOLBAR, buff);
+}
+
+void showVolume(long actVolume) {
+	char buff[255];
+	page_t shown = carouselShown();
+
+	// a turn of the knob: see what the player made of it now
+	schedNow();
+
+	// on the now playing page, also while another one is shown
+	drawPage(PAGE_PLAYING);
+	drawVolume(actVolume, buff);
+	drawPage(shown);
+	if (shown == PAGE_PLAYING) {
+		refreshDisplay();
+		termFlush();
+	}
+	tOut(buff);
+	streamTags(NULL, actVolume);
+	publishSnapshot(NULL, actVolume);
+}
+
+void drawNowPlaying(void) {
+	char buff[255];
+	long pTime, dTime;
+
+	tOut("_____________________\n");
+
+	for (int line = 0; line < LINE_NUM; line++) {
+		int filled = false;
+		for (tagtypes_t *t = layout[line]; *t != MAXTAG_TYPES; t++) {
+			if (tags[*t].valid) {
+				filled = true;
+				int width = textWidth(getTextFont(), tags[*t].tagData);
+				if (tags[*t].changed) {
+					scrollPos[line]  = 0;
+					termScroll[line] = 0;
+				}
+				if (width > maxXPixel()) {
+					putTextMarquee((line + 1) * 10, tags[*t].tagData, scrollPos[line]);
+					scrollPos[line] = (scrollPos[line] + MARQUEE_STEP) % (width + MARQUEE_GAP);
+				} else if (tags[*t].changed) {
+					putTextToCenter((line + 1) * 10, tags[*t].tagData);
+				}
+				int cells = termWidth(tags[*t].tagData);
+				if (cells > TERM_COLS) {
+					termMarquee(line + 1, tags[*t].tagData, termScroll[line]);
+					termScroll[line] = (termScroll[line] + 1) % (cells + TERM_MARQUEE);
+				} else {
+					termCenter(line + 1, tags[*t].tagData);
+				}
+				sprintf(stbl, "%s\n", tags[*t].tagData);
+				tOut(stbl);
+				break;
+			}
+		}
+		if(!filled) {
+			clearLine((line + 1) * 10);
+			termText(line + 1, 0, "");
+		}
+	}
+
+	pTime = tags[TIME].valid     ? strtol(tags[TIME].tagData,     NULL, 10) : 0;
+	dTime = tags[DURATION].valid ? strtol(tags[DURATION].tagData, NULL, 10) : 0;
+
+	sprintf(buff, "%ld:%02ld", pTime/60, pTime%60);
+	int twidth = textWidth(FONT_FIXED, buff);
+	clearLine(56);
+	putText(0, 56, buff);
+
+	sprintf(buff, "%ld:%02ld", dTime/60, dTime%60);
+	int dwidth = textWidth(FONT_FIXED, buff);
+	putText(maxXPixel() - dwidth, 56, buff);
+
+	sprintf(buff, "%s", tags[MODE].valid ? tags[MODE].tagData : "");
+	int mwidth = textWidth(FONT_FIXED, buff);
+	putText(twidth + (maxXPixel() - twidth - dwidth - mwidth) / 2, 56, buff);
+
+	drawHorizontalBargraph(-1, 51, 0, 4, (pTime*100) / (dTime == 0 ? 1 : dTime));
+
+	sprintf(buff, "%3ld:%02ld  %5s  %3ld:%02ld", pTime/60, pTime%60, tags[MODE].valid ? tags[MODE].tagData : "",  dTime/60, dTime%60);
+	sprintf(stbl, "%s\n\n", buff);
+	tOut(stbl);
+	termBar(5, 0, TERM_COLS, (pTime*100) / (dTime == 0 ? 1 : dTime));
+	termText(6, 0, buff);
+}
+
+/*
+ * The entries after the current one, scrolling through the next
+ * UPNEXT_AHEAD. Only the windows of them are fetched (playlist.c).
+ */
+void drawUpNext(void) {
+	char buff[255];
+	int  current = playlistCurrent();
+	int  tracks  = playlistTracks();
+
+	if (current != upNextCur) {
+		upNextCur  = current;
+		upNextTop  = 0;
+		upNextTick = 0;
+	}
+	int first = current + 1 + upNextTop;
+	playlistShow(first, UPNEXT_ROWS);
+
+	fillRect(0, 0, maxXPixel(), maxYPixel(), 0);
+	drawText(FONT_FIXED, 0, 0, "Up next");
+	sprintf(buff, "%d/%d", current + 1, tracks);
+	putText(maxXPixel() - textWidth(FONT_FIXED, buff), 0, buff);
+	fillRect(0, 9, maxXPixel(), 1, 1);
+	tOut("_____________________\nUp next\n");
+	termText(0, 0, "Up next");
+	termText(0, TERM_COLS - strlen(buff), buff);
+
+	for (int row = 0; row < UPNEXT_ROWS; row++) {
+		int index = first + row;
+		if (index >= tracks) {
+			termText(row + 1, 0, "");
+			continue;
+		}
+
+		const plentry *e = playlistEntry(index);
+		if (e == NULL) {
+			snprintf(buff, sizeof(buff), "%d ...", index + 1);
+		} else if (e->artist[0] != 0) {
+			snprintf(buff, sizeof(buff), "%d %s - %s", index + 1, e->title, e->artist);
+		} else {
+			snprintf(buff, sizeof(buff), "%d %s", index + 1, e->title);
+		}
+		drawText(FONT_PROP, 0, 12 + row * 10, buff);
+		termText(row + 1, 0, buff);
+		sprintf(stbl, "%s\n", buff);
+		tOut(stbl);
+	}
+	tOut("\n");
+
+	// down a row every UPNEXT_STEP refreshes, back to the top at the end
+	if (++upNextTick >= UPNEXT_STEP) {
+		upNextTick = 0;
+		upNextTop++;
+		if ((upNextTop + UPNEXT_ROWS > UPNEXT_AHEAD) || (current + 1 + upNextTop + UPNEXT_ROWS > tracks)) {
+			upNextTop = 0;
+		}
+	}
+}
+
+/*
+ * CPU, temperature, memory and Wi-Fi, sampled at most every -y ms. Only
+ * the characters that changed are drawn again.
+ */
+void drawSystem(long now) {
+	const sysstats *st = systemStats();
+	char value[48];
+	char line[SYS_ROWS][64];
+
+	if (!sampleSystemStats(now) && (sysShown[0][0] != 0))	{return;}
+
+	if (st->cpu >= 0)	{snprintf(value, sizeof(value), "%d%%", st->cpu);}
+	else				{snprintf(value, sizeof(value), "--");}
+	snprintf(line[0], sizeof(line[0]), "CPU %17s", value);
+
+	if (st->temp != SYS_NOTEMP)	{snprintf(value, sizeof(value), "%ld.%ldC", st->temp / 1000, labs(st->temp % 1000) / 100);}
+	else						{snprintf(value, sizeof(value), "--");}
+	snprintf(line[1], sizeof(line[1]), "Temp %16s", value);
+
+	if (st->memTotal > 0)	{snprintf(value, sizeof(value), "%ld/%ldM", (st->memTotal - st->memAvailable) / 1024, st->memTotal / 1024);}
+	else					{snprintf(value, sizeof(value), "--");}
+	snprintf(line[2], sizeof(line[2]), "Memory %14s", value);
+
+	if (st->wifi)	{snprintf(value, sizeof(value), "%ddBm link %d", st->wifiLevel, st->wifiLink);}
+	else			{snprintf(value, sizeof(value), "--");}
+	snprintf(line[3], sizeof(line[3]), "WiFi %16s", value);
+
+	tOut("_____________________\nSystem\n");
+	for (int row = 0; row < SYS_ROWS; row++) {
+		putTextCells(12 + row * 10, line[row], sysShown[row]);
+		termText(row + 1, 0, line[row]);
+		sprintf(stbl, "%s\n", line[row]);
+		tOut(stbl);
+	}
+	tOut("\n");
+
+	if (st->cpu >= 0) {
+		drawHorizontalBargraph(-1, 54, 0, 4, st->cpu);
+		termBar(5, 0, TERM_COLS, st->cpu);
+	}
+}
+
+/*
+ * Sample size and rate of the playing track, from the tags of the last
+ * status answer
+ */
+void qualityText(char *quality, char *rate, int size) {
+	if (getQuality(tags, quality, size) == NULL)	{snprintf(quality, size, "--");}
+
+	long hz = tags[SAMPLERATE].valid ? strtol(tags[SAMPLERATE].tagData, NULL, 10) : 0;
+	if (hz > 0) {
+		snprintf(rate, size, "%s bit %ld.%ld kHz", tags[SAMPLESIZE].valid ? tags[SAMPLESIZE].tagData : "--",
+			hz / 1000, (hz % 1000) / 100);
+	} else {
+		rate[0] = 0;
+	}
+}
+
+void drawQuality(void) {
+	char quality[32], rate[32], mode[32];
+
+	qualityText(quality, rate, sizeof(quality));
+	snprintf(mode, sizeof(mode), "%s", tags[MODE].valid ? tags[MODE].tagData : "");
+
+	drawText(FONT_FIXED, 0, 0, "Quality");
+	fillRect(0, 9, maxXPixel(), 1, 1);
+	drawText(FONT_LARGE, (maxXPixel() - textWidth(FONT_LARGE, quality)) / 2, 20, quality);
+	putTextToCenter(44, rate);
+	putTextToCenter(54, mode);
+
+	termText(0, 0, "Quality");
+	termCenter(2, quality);
+	termCenter(4, rate);
+	termCenter(6, mode);
+	snprintf(stbl, sizeof(stbl), "_____________________\nQuality\n%s\n%s\n\n", quality, rate);
+	tOut(stbl);
+}
+
+// the time to the minute and the date, the inputs of the clock page
+void clockText(char *hm, char *date, int size) {
+	time_t t = time(NULL);
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	strftime(hm, size, "%H:%M", &tm);
+	strftime(date, size, "%a %d %b %Y", &tm);
+}
+
+void drawClock(void) {
+	char hm[32], date[32];
+
+	clockText(hm, date, sizeof(hm));
+
+	drawText(FONT_LARGE, (maxXPixel() - textWidth(FONT_LARGE, hm)) / 2, 16, hm);
+	putTextToCenter(44, date);
+
+	termCenter(2, hm);
+	termCenter(4, date);
+	snprintf(stbl, sizeof(stbl), "_____________________\n%s\n%s\n\n", hm, date);
+	tOut(stbl);
+}
+
+/*
+ * What a page is drawn from and does not follow on its own: the frame
+ * left with other inputs is drawn again when the page comes back. The
+ * now playing page draws its changed lines and the volume, up next all
+ * of it every frame, the system page its changed characters.
+ */
+uint64_t pageInputs(page_t page) {
+	char a[64], b[64];
+	uint64_t h = 0;
+
+	switch (page) {
+		case PAGE_PLAYING:
+			for (int line = 0; line < LINE_NUM; line++) {
+				const char *shown = "";
+				for (tagtypes_t *t = layout[line]; *t != MAXTAG_TYPES; t++) {
+					if (tags[*t].valid) {
+						shown = tags[*t].tagData;
+						break;
+					}
+				}
+				h = (h ^ tagHash(shown, strlen(shown))) * 31;
+			}
+			return h;
+
+		case PAGE_QUALITY:
+			qualityText(a, b, sizeof(a));
+			h = tagHash(a, strlen(a)) ^ (tagHash(b, strlen(b)) * 31);
+			return tags[MODE].valid ? h ^ (tagHash(tags[MODE].tagData, strlen(tags[MODE].tagData)) * 961) : h;
+
+		case PAGE_CLOCK:
+			clockText(a, b, sizeof(a));
+			return tagHash(a, strlen(a)) ^ (tagHash(b, strlen(b)) * 31);
+
+		default:
+			return 0;
+	}
+}
+
+// a page drawn in full, into its own frame
+void enterPage(page_t page, long actVolume) {
+	char buff[255];
+
+	clearDisplay();
+	termClear();
+
+	switch (page) {
+		case PAGE_PLAYING:
+			drawVolume(actVolume, buff);
+			for (int i = 0; i < MAXTAG_TYPES; i++) {
+				tags[i].changed = true;
+			}
+			break;
+
+		case PAGE_SYSTEM:
+			drawText(FONT_FIXED, 0, 0, "System");
+			termText(0, 0, "System");
+			fillRect(0, 9, maxXPixel(), 1, 1);
+			for (int row = 0; row < SYS_ROWS; row++) {
+				sysShown[row][0] = 0;
+			}
+			break;
+
+		case PAGE_QUALITY:	drawQuality();	break;
+		case PAGE_CLOCK:	drawClock();	break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * -g (or pages = in the config file) lists the pages in turn, without it
+ * now playing, up next with -p and the system page with -y
+ */
+void setupPages(void) {
+	pageturn list[MAXPAGES];
+	int count = 0;
+	int system = false;
+
+	if (pageSpec[0] != 0) {
+		count = parsePages(pageSpec, list, MAXPAGES);
+	}
+	if (count <= 0) {
+		list[0] = (pageturn){PAGE_PLAYING, 0};
+		count   = 1;
+		if (upNextOn)			{list[count++] = (pageturn){PAGE_UPNEXT, 0};}
+		if (systemRate > 0)		{list[count++] = (pageturn){PAGE_SYSTEM, 0};}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (list[i].page == PAGE_SYSTEM)	{system = true;}
+	}
+	if (system && (openSystemStats(systemRate) < 0)) {
+		logERR(LS_MAIN, "No system statistics, system page disabled\n");
+		for (int i = 0; i < count; i++) {
+			if (list[i].page == PAGE_SYSTEM) {
+				memmove(&list[i], &list[i + 1], (count - i - 1) * sizeof(pageturn));
+				count--;
+				break;
+			}
+		}
+		if (count == 0)	{list[count++] = (pageturn){PAGE_PLAYING, 0};}
+	}
+	setCarousel(list, count, (pageDwell > 0) ? pageDwell : CAROUSEL_DWELL);
+}
+
+/*
+ * What the config file sets and the one before did not, all of it before
+ * the frame is drawn. was NULL at startup: the server, the player, the
+ * sound card and the atlas went in with the command line then.
+ */
+void applyConfig(const config *c, const config *was, long actVolume) {
+	int redraw = false;
+	int pages  = false;
+
+	if (was != NULL) {
+		if ((c->server[0] != 0) && (strcmp(c->server, was->server) != 0)) {
+			logMSG(LS_MAIN, LL_INFO, "Server %s, reconnecting\n", c->server);
+			strcpy(serverName, c->server);
+			switchServer(serverName);
+		}
+		if ((c->player[0] != 0) && (strcmp(c->player, was->player) != 0)) {
+			lmsplayer *p = findPlayerByName(c->player);
+			if (p != NULL) {
+				selectPlayer(p->id);
+			} else {
+				logERR(LS_MAIN, "Player %s not found, not switched\n", c->player);
+			}
+		}
+		if ((c->soundcard[0] != 0) && (strcmp(c->soundcard, was->soundcard) != 0)) {
+			switchMimo(c->soundcard);
+		}
+		if ((c->atlas[0] != 0) && (strcmp(c->atlas, was->atlas) != 0)) {
+			redraw = (loadAtlas(c->atlas) == 0);
+		}
+	}
+
+	if ((c->follow >= 0) && ((was == NULL) || (c->follow != was->follow))) {
+		setAutoFollow(c->follow);
+	}
+
+	for (int line = 0; line < LINE_NUM; line++) {
+		if (c->lineSet[line] && ((was == NULL) || !was->lineSet[line] ||
+			(memcmp(c->layout[line], was->layout[line], sizeof(c->layout[line])) != 0))) {
+			memcpy(layout[line], c->layout[line], sizeof(layout[line]));
+			redraw = true;
+		}
+	}
+	if ((c->font >= 0) && ((was == NULL) || (c->font != was->font))) {
+		setTextFont((fontid_t)c->font);
+		redraw = true;
+	}
+
+	if ((c->refresh > 0) && ((was == NULL) || (c->refresh != was->refresh))) {
+		setRefreshInterval(c->refresh);
+	}
+
+	pollpolicy policy = *getPollPolicy();
+	if (c->poll.sparse > 0)		{policy.sparse  = c->poll.sparse;}
+	if (c->poll.near > 0)		{policy.near    = c->poll.near;}
+	if (c->poll.dense > 0)		{policy.dense   = c->poll.dense;}
+	if (c->poll.stream > 0)		{policy.stream  = c->poll.stream;}
+	if (c->poll.idle > 0)		{policy.idle    = c->poll.idle;}
+	if (c->poll.idleMax > 0)	{policy.idleMax = c->poll.idleMax;}
+	if (c->poll.unnotified > 0)	{policy.unnotified = c->poll.unnotified;}
+	if (memcmp(&policy, getPollPolicy(), sizeof(policy)) != 0) {
+		setPollPolicy(&policy);
+	}
+
+	if ((c->pageSeconds > 0) && ((was == NULL) || (c->pageSeconds != was->pageSeconds))) {
+		pageDwell = c->pageSeconds;
+		pages     = true;
+	}
+	if ((c->upNext >= 0) && ((was == NULL) || (c->upNext != was->upNext))) {
+		upNextOn = c->upNext;
+		pages    = true;
+	}
+	if ((c->systemRate >= 0) && ((was == NULL) || (c->systemRate != was->systemRate))) {
+		systemRate = c->systemRate;
+		pages      = true;
+	}
+	if ((c->pages[0] != 0) && ((was == NULL) || (strcmp(c->pages, was->pages) != 0))) {
+		strcpy(pageSpec, c->pages);
+		pages = true;
+	}
+
+	if (was == NULL)	{return;}
+	if (pages) {
+		setupPages();
+	}
+	if (redraw) {
+		invalidatePages();
+	}
+}
+
+void showTags(long actVolume) {
+	long frameStart;
+
+	frameStart = metricsNow();
+	if (configChanged()) {
+		applyConfig(configNow(), configBefore(), actVolume);
+	}
+	carouselTurn(frameStart);
+
+	page_t page = carouselPage();
+	if (showPage(page, pageInputs(page))) {
+		enterPage(page, actVolume);
+	}
+
+	// quality and clock: drawn in full above when their inputs changed
+	switch (page) {
+		case PAGE_PLAYING:	drawNowPlaying();			break;
+		case PAGE_UPNEXT:	drawUpNext();				break;
+		case PAGE_SYSTEM:	drawSystem(frameStart);		break;
+		default:										break;
+	}
+
+	streamTags(tags, actVolume);
+	publishSnapshot(tags, actVolume);
+
+	for(int i = 0; i < MAXTAG_TYPES; i++) {
+		tags[i].changed = false;
+	}
+
+	refreshDisplay();
+	termFlush();
+	metricsTime(MT_FRAME, frameStart);
+	metricsCount(MC_FRAMES, 1);
+
+	if (firstMeta == 0) {
+		firstMeta = metricsNow() - startupBegin;
+		logMSG(LS_MAIN, LL_INFO, "Startup: first pixel after %.1fms, first metadata after %.1fms\n",
+			firstPixel / 1e6, firstMeta / 1e6);
+		if (benchStartup) {
+			printf("startup first_pixel_ms=%.1f first_metadata_ms=%.1f\n", firstPixel / 1e6, firstMeta / 1e6);
+			exit(0);
+		}
+	}
+}
+
+/*******************************************************************************
+ * Startup - server discovery and the player handshake take the longest,
+ * they run while the display comes up and the mixer is opened
+ ******************************************************************************/
+void *startNetwork(void *playerName) {
+	return initSliminfo((char *)playerName);
+}
+
+void showSplash(const char *playerName) {
+	char buff[64];
+
+	clearDisplay();
+	termClear();
+	sprintf(buff, "LMSMonitor");
+	putTextToCenter(20, buff);
+	termCenter(2, buff);
+	snprintf(buff, sizeof(buff), "%s", (playerName != NULL) ? playerName : "looking for players");
+	putTextToCenter(40, buff);
+	termCenter(4, buff);
+	refreshDisplay();
+	termFlush();
+
+	firstPixel = metricsNow() - startupBegin;
+}
+
 int main(int argc, char *argv[]) {
 	long lastVolume = 0;
 	long actVolume  = 0;
-	long pTime, dTime;
-	char buff[255];
 	char *sndCard = NULL;
 	char *playerName = NULL;
+	pageturn turnList[MAXPAGES];
+	char *streamTarget = NULL;
+	char *metricsOn = NULL;
+	char *atlasFile = NULL;
+	char *recordFile = NULL;
+	char *replayFile = NULL;
+	char *frameTarget = NULL;
+	char *snapName = NULL;
+	char *brokerOn = NULL;
+	char *configFile = NULL;
+	pthread_t netThread;
+	int   replayFast = false;
+	int   reactorMode = false;
+	int   benchFPS = false;
+	int   benchKern = false;
+	int   textMode = TEXT_OFF;
 	int  aName;
 
-	#define LINE_NUM 4
-	tagtypes_t layout[LINE_NUM][3] = {
-		{COMPOSER,    ARTIST,       MAXTAG_TYPES},
-		{ALBUM,       MAXTAG_TYPES, MAXTAG_TYPES},
-		{TITLE,       MAXTAG_TYPES, MAXTAG_TYPES},
-		{ALBUMARTIST, CONDUCTOR,    MAXTAG_TYPES},
-	};
-
+	startupBegin = metricsNow();
 	opterr = 0;
-	while ((aName = getopt (argc, argv, "o:n:tvh")) != -1) {
+	while ((aName = getopt (argc, argv, "o:n:s:l:j:m:f:R:P:d:k:B:i:p:g:y:c:xabFKrtTvh")) != -1) {
 		switch (aName) {
 			case 't':
-				enableTOut();
+				if (textMode == TEXT_OFF)	{textMode = TEXT_SCREEN;}
+				break;
+
+			case 'T':
+				textMode = TEXT_PLAIN;
 				break;
 
 			case 'v':
@@ -89,108 +667,252 @@ int main(int argc, char *argv[]) {
 				playerName = optarg;
 				break;
 
+			case 'r':
+				reactorMode = true;
+				break;
+
+			case 'a':
+				setAutoFollow(true);
+				break;
+
+			case 's':
+				setServerSelector(optarg);
+				break;
+
+			case 'j':
+				streamTarget = optarg;
+				break;
+
+			case 'm':
+				metricsOn = optarg;
+				break;
+
+			case 'f':
+				atlasFile = optarg;
+				break;
+
+			case 'R':
+				recordFile = optarg;
+				break;
+
+			case 'P':
+				replayFile = optarg;
+				break;
+
+			case 'x':
+				replayFast = true;
+				break;
+
+			case 'b':
+				benchStartup = true;
+				break;
+
+			case 'F':
+				benchFPS = true;
+				break;
+
+			case 'K':
+				benchKern = true;
+				break;
+
+			case 'd':
+				frameTarget = optarg;
+				break;
+
+			case 'k':
+				snapName = optarg;
+				break;
+
+			case 'i':
+				setDisplayBus(optarg);
+				break;
+
+			case 'p':
+				pageDwell = atoi(optarg);
+				upNextOn  = true;
+				break;
+
+			case 'g':
+				if (parsePages(optarg, turnList, MAXPAGES) < 0) {
+					printf("Invalid page list: %s (playing, upnext, system, quality, clock, each with :seconds)\n", optarg);
+					exit(1);
+				}
+				strcpy(pageSpec, optarg);
+				break;
+
+			case 'y':
+				systemRate = atoi(optarg);
+				break;
+
+			case 'c':
+				configFile = optarg;
+				break;
+
+			case 'B':
+				brokerOn = optarg;
+				break;
+
+			case 'l':
+				if (parseLogLevels(optarg) < 0) {
+					printf("Invalid log level list: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
 			case 'h':
-				printf("LMSMonitor Ver. 0.2\nUsage [options] -n Player name\noptions:\n -o Soundcard (eg. hw:CARD=IQaudIODAC)\n -t enable print info to stdout\n -v increment verbose level\n\n");
+				printf("LMSMonitor Ver. 0.2\nUsage [options] -n Player name\noptions:\n -a follow the player that started playing last (default without -n)\n -s Server name, UUID or IP[:port] (default: first discovered), http://... for JSON-RPC\n -o Soundcard (eg. hw:CARD=IQaudIODAC)\n -r single thread event loop instead of poller and mixer threads\n -t show the screen on the terminal, only the changed characters are written (lines without a terminal)\n -T print info to stdout as lines\n -j stream changed tags as JSON lines (- stdout, FIFO path or unix:/socket)\n -v increment verbose level\n -m serve Prometheus metrics on [addr:]port or unix:/socket\n -f glyph atlas for non ASCII characters (see tools/mkatlas)\n -R record CLI traffic and volume changes to a trace file\n -P replay a trace file without server and sound card, report CPU and frame statistics\n -x replay as fast as possible instead of real time\n -b print the time to the first pixel and the first metadata, then exit\n -F print the frames per second of a full redraw, frame buffer against per pixel drawing, then exit\n -K print the rate of every fill, blit and decode kernel the CPU runs and the one picked, then exit\n -d stream the screen to tools/fbview (udp:host:port or tcp:[addr:]port)\n -B broker: serve monitors on [addr:]port over one LMS connection\n -i OLED I2C bus: /dev/i2c-N, N or mock[:logfile], then ,addr=0x3c ,chunk=bytes ,clock=Hz (default /dev/i2c-1)\n -p show now playing and the up next list in turn, s each\n -g pages in turn: playing, upnext, system, quality, clock, each with :s of its own (eg. playing:20,quality,clock)\n -c config file, watched and applied while running\n -y add a system page (CPU, temperature, memory, Wi-Fi) sampled every ms\n -k publish tags, volume and playback clock in shared memory (eg. lmsmonitor, see lmssnap.h)\n -l per subsystem log levels (eg. slim=2,mixer=0)\n\n");
 				exit(1);
 				break;
 		}
 	}
 
-	if((tags = initSliminfo(playerName)) == NULL)	{ exit(1); }
+	if (reactorMode || (brokerOn != NULL)) {
+		sigset_t mask;
+		reactorSignals(&mask);
+	}
+
+	if (initLogger() < 0) {
+		printf("Failed to start logger, logging synchronously\n");
+	}
+
+	metricsThread("main");
+	initKernels();
+	if (benchKern) {
+		int rc = benchKernels();
+		closeLogger();
+		exit((rc < 0) ? 1 : 0);
+	}
+
+	if ((metricsOn != NULL) && (initMetrics(metricsOn) < 0)) {
+		logERR(LS_MAIN, "Metrics endpoint disabled\n");
+	}
+
+	if (brokerOn != NULL) {
+		// no display, no mixer: the monitors connected to us have them
+		int rc = runBroker(brokerOn);
+		closeMetrics();
+		closeLogger();
+		exit((rc < 0) ? 1 : 0);
+	}
+
+	if (configFile != NULL) {
+		// the file wins over the command line
+		if (initConfig(configFile) < 0) {
+			closeLogger();
+			exit(1);
+		}
+		const config *c = configNow();
+		if (c->server[0] != 0) {
+			strcpy(serverName, c->server);
+			setServerSelector(serverName);
+		}
+		if (c->player[0] != 0)		{playerName = (char *)c->player;}
+		if (c->soundcard[0] != 0)	{sndCard    = (char *)c->soundcard;}
+		if (c->atlas[0] != 0)		{atlasFile  = (char *)c->atlas;}
+		applyConfig(c, NULL, 0);
+	}
+
+	if ((atlasFile != NULL) && (loadAtlas(atlasFile) < 0)) {
+		logERR(LS_MAIN, "Non ASCII characters are transliterated\n");
+	}
 
-	// init ALSA mixer monitor
-	startMimo(sndCard, NULL);
+	if (benchFPS) {
+		// before initDisplay: no OLED, the frames are drawn only
+		int rc = benchFrames();
+		closeLogger();
+		exit((rc < 0) ? 1 : 0);
+	}
 
-#ifdef __arm__
-	// init OLED display
+	if ((streamTarget != NULL) && (initTagStream(streamTarget) < 0)) {
+		closeLogger();
+		exit(1);
+	}
+
+	if ((snapName != NULL) && (initSnapshot(snapName) < 0)) {
+		logERR(LS_MAIN, "Shared memory snapshot disabled\n");
+	}
+
+	if ((recordFile != NULL) && (initTrace(recordFile) < 0)) {
+		closeLogger();
+		exit(1);
+	}
+
+	if (replayFile != NULL) {
+		tags = replaySliminfo();
+	} else if (pthread_create(&netThread, NULL, startNetwork, playerName) != 0) {
+		abort("Failed to create startup thread!");
+	}
+
+	// init ALSA mixer monitor, its own thread opens the mixer
+	if ((replayFile == NULL) && !reactorMode) {
+		startMimo(sndCard, NULL);
+	}
+
+	// the screen on the terminal, the log lines below it
+	if ((textMode == TEXT_SCREEN) && (initTermScreen() < 0)) {
+		textMode = TEXT_PLAIN;
+	}
+	if (textMode == TEXT_PLAIN) {
+		enableTOut();
+	}
+
+	// init OLED display, off screen frame buffer only without one
 	if (initDisplay() == EXIT_FAILURE) {
 		exit(EXIT_FAILURE);
 	}
-#endif
 
-	while (true) {
+	if ((frameTarget != NULL) && (initFrameStream(frameTarget) < 0)) {
+		logERR(LS_MAIN, "Screen streaming disabled\n");
+	}
+	setupPages();
+
+	if (replayFile == NULL) {
+		showSplash(playerName);
 
-		actVolume = getActVolume();
-		if (actVolume != lastVolume) {
-			sprintf(buff, "Vol:             %3ld%%", actVolume);
-#ifdef __arm__
-			putText(0, 0, buff);
-			drawHorizontalBargraph(24, 2, 75, 4, actVolume);
-			refreshDisplay();
-#endif
-			tOut(buff);
-			lastVolume = actVolume;
+		if (reactorMode) {
+			setMimoDevice(sndCard, NULL);
+			openMimo();
 		}
+		pthread_join(netThread, (void **)&tags);
+	}
+	if (tags == NULL)	{ closeLogger(); exit(1); }
+	clearDisplay();
+	termClear();
 
-		if (isRefreshed()) {
-			tOut("_____________________\n");
+	if (replayFile != NULL) {
+		replayTrace(replayFile, replayFast, showVolume, showTags);
+	} else if (reactorMode) {
+		runReactor(showVolume, showTags);
+	} else {
+		startSliminfo();
 
-			for (int line = 0; line < LINE_NUM; line++) {
-#ifdef __arm__
-				int filled = false;
-#endif
-				for (tagtypes_t *t = layout[line]; *t != MAXTAG_TYPES; t++) {
-					if (tags[*t].valid) {
-#ifdef __arm__
-						filled = true;
-#endif
-						if (tags[*t].changed) {
-								strncpy(buff, tags[*t].tagData, maxCharacter());
-#ifdef __arm__
-								putTextToCenter((line + 1) * 10, buff);
-#endif
-						}
-						sprintf(stbl, "%s\n", tags[*t].tagData);
-						tOut(stbl);
-						break;
-					}
-				}
-#ifdef __arm__
-				if(!filled) {
-					clearLine((line + 1) * 10);
-				}
-#endif
+		while (true) {
+			actVolume = getActVolume();
+			if (actVolume != lastVolume) {
+				showVolume(actVolume);
+				lastVolume = actVolume;
 			}
 
-			pTime = tags[TIME].valid     ? strtol(tags[TIME].tagData,     NULL, 10) : 0;
-			dTime = tags[DURATION].valid ? strtol(tags[DURATION].tagData, NULL, 10) : 0;
-
-#ifdef __arm__
-			sprintf(buff, "%ld:%02ld", pTime/60, pTime%60);
-			int tlen = strlen(buff);
-			clearLine(56);
-			putText(0, 56, buff);
-
-			sprintf(buff, "%ld:%02ld", dTime/60, dTime%60);
-			int dlen = strlen(buff);
-			putText(maxXPixel() - (dlen * CHAR_WIDTH), 56, buff);
-
-			sprintf(buff, "%s", tags[MODE].valid ? tags[MODE].tagData : "");
-			int mlen = strlen(buff);
-			putText(((maxXPixel() - ((tlen + mlen + dlen) * CHAR_WIDTH)) / 2) + (tlen * CHAR_WIDTH), 56, buff);
-
-			drawHorizontalBargraph(-1, 51, 0, 4, (pTime*100) / (dTime == 0 ? 1 : dTime));
-#else
-			sprintf(buff, "%3ld:%02ld  %5s  %3ld:%02ld", pTime/60, pTime%60, tags[MODE].valid ? tags[MODE].tagData : "",  dTime/60, dTime%60);
-			sprintf(stbl, "%s\n\n", buff);
-			tOut(stbl);
-#endif
-			for(int i = 0; i < MAXTAG_TYPES; i++) {
-				tags[i].changed = false;
+			if (isRefreshed()) {
+				showTags(actVolume);
+				askRefresh();
 			}
 
-#ifdef __arm__
-			refreshDisplay();
-#endif
-			askRefresh();
+			usleep(SLEEP_TIME);
 		}
+	}
 
-		usleep(SLEEP_TIME);
-    }
-
-#ifdef __arm__
+	closeFrameStream();
 	closeDisplay();
-#endif
 	closeSliminfo();
+	closeSystemStats();
+	closeConfig();
+	closeTrace();
+	closeTagStream();
+	closeSnapshot();
+	closeMetrics();
+	closeLogger();
+	// after the last queued line
+	closeTermScreen();
 	return 0;
 }
@@ -0,0 +1,142 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Reader side of the lmsmonitor -k shared memory snapshot. Header only,
+ *	plain C or C++, copy it next to the consumer and link with -lrt on
+ *	older glibc. See tools/snapcat.c for an example.
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef LMSSNAP_H
+#define LMSSNAP_H 1
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define LMSSNAP_NAME		"/lmsmonitor"		// shm_open name, /dev/shm/lmsmonitor
+#define LMSSNAP_MAGIC		0x534D4C53			// "SLMS"
+#define LMSSNAP_VERSION		1
+#define LMSSNAP_TAGS		16
+#define LMSSNAP_NAMELEN		16
+#define LMSSNAP_DATALEN		256
+#define LMSSNAP_RETRIES		64					// copies tried while the monitor writes
+
+typedef struct {
+	char		name[LMSSNAP_NAMELEN];			// "title", "artist", ... as the CLI tags
+	int32_t		valid;
+	char		data[LMSSNAP_DATALEN];			// UTF-8
+} lmssnaptag;
+
+/*
+ * seq is odd while the monitor writes, readers copy the segment and take
+ * the copy if seq was even and unchanged around it.
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	size;							// sizeof(lmssnap) of the writer
+	uint32_t	seq;
+	int32_t		pid;							// of the monitor, 0 once it stopped
+	int32_t		volume;							// percent, -1 unknown
+	int32_t		playing;						// mode is "play"
+	int32_t		tagCount;
+	int64_t		elapsed;						// ms into the track at stamp
+	int64_t		duration;						// ms, 0 unknown
+	int64_t		stamp;							// CLOCK_MONOTONIC ms of the last update
+	lmssnaptag	tags[LMSSNAP_TAGS];
+} lmssnap;
+
+static inline int64_t lmsSnapNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Maps the segment read only, NULL if the monitor does not publish or
+ * publishes an other layout.
+ */
+static inline const lmssnap *lmsSnapOpen(const char *name) {
+	int fd = shm_open(name ? name : LMSSNAP_NAME, O_RDONLY, 0);
+	if (fd < 0)	{return NULL;}
+
+	void *map = mmap(NULL, sizeof(lmssnap), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)	{return NULL;}
+
+	const lmssnap *shm = (const lmssnap *)map;
+	if ((shm->magic != LMSSNAP_MAGIC) || (shm->version != LMSSNAP_VERSION) || (shm->size != sizeof(lmssnap))) {
+		munmap(map, sizeof(lmssnap));
+		return NULL;
+	}
+	return shm;
+}
+
+static inline void lmsSnapClose(const lmssnap *shm) {
+	if (shm != NULL)	{munmap((void *)shm, sizeof(lmssnap));}
+}
+
+// changes with every update, compare it to skip copying an unchanged snapshot
+static inline uint32_t lmsSnapSeq(const lmssnap *shm) {
+	return __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Consistent copy of the snapshot. Never blocks the monitor: 0 on success,
+ * -1 if every one of LMSSNAP_RETRIES copies overlapped an update.
+ */
+static inline int lmsSnapRead(const lmssnap *shm, lmssnap *copy) {
+	for (int i = 0; i < LMSSNAP_RETRIES; i++) {
+		uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)	{continue;}
+
+		memcpy(copy, (const void *)shm, sizeof(lmssnap));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq) {
+			copy->seq = seq;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// tag of a copy by CLI name, NULL if not valid
+static inline const char *lmsSnapTag(const lmssnap *copy, const char *name) {
+	for (int i = 0; (i < copy->tagCount) && (i < LMSSNAP_TAGS); i++) {
+		if (strcmp(copy->tags[i].name, name) == 0) {
+			return copy->tags[i].valid ? copy->tags[i].data : NULL;
+		}
+	}
+	return NULL;
+}
+
+// playback position now, the clock runs on between two updates while playing
+static inline int64_t lmsSnapElapsed(const lmssnap *copy) {
+	int64_t pos = copy->elapsed;
+
+	if (copy->playing)	{pos += lmsSnapNow() - copy->stamp;}
+	if ((copy->duration > 0) && (pos > copy->duration))	{pos = copy->duration;}
+	return pos;
+}
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ *	logger.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Asynchronous logger: every thread formats its message into a slot of a
+ *	bounded MPSC ring, a single writer thread does the I/O.
+ *	A full ring drops the message and counts it, the producer never waits.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+
+#define LF_RAW		1		// no timestamp, no subsystem prefix (-t output)
+#define LF_ERR		2		// goes to stderr
+
+typedef struct LogSlot {
+	unsigned long	seq;
+	long			stamp;	// ns since logger start
+	unsigned char	subsys;
+	unsigned char	flags;
+	char			text[LOG_LINE];
+} logslot_t;
+
+const char *subsysName[LS_MAXSUBSYS] = {"main", "slim", "mixer", "display", "text"};
+
+logslot_t		logRing[LOG_SLOTS];
+unsigned long	logHead = 0;		// next slot to claim (producers)
+unsigned long	logTail = 0;		// next slot to drain (writer only)
+int				logLevel[LS_MAXSUBSYS] = {-1, -1, -1, -1, -1};
+logstats_t		logStats;
+
+struct timespec	logStart;
+sem_t			logSem;
+int				writerIdle  = false;
+int				loggerRun   = false;
+int				logFD       = STDOUT_FILENO;
+pthread_t		loggerThread;
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long elapsedNS(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - logStart.tv_sec) * 1000000000L + (now.tv_nsec - logStart.tv_nsec);
+}
+
+int setLogLevel(logsubsys_t subsys, int loglevel) {
+	if ((subsys < 0) || (subsys >= LS_MAXSUBSYS)) {return -1;}
+	logLevel[subsys] = loglevel;
+	return 0;
+}
+
+int getLogLevel(logsubsys_t subsys) {
+	if ((subsys < 0) || (subsys >= LS_MAXSUBSYS)) {return LL_QUIET;}
+	return logLevel[subsys] < 0 ? getVerbose() : logLevel[subsys];
+}
+
+/*
+ * "slim=2,mixer=0" - subsystems not listed follow the -v level
+ */
+int parseLogLevels(const char *spec) {
+	char name[16];
+	int  level;
+	int  n;
+
+	while ((spec != NULL) && (*spec)) {
+		if (sscanf(spec, "%15[a-z]=%d%n", name, &level, &n) != 2) {return -1;}
+
+		int i;
+		for (i = 0; (i < LS_MAXSUBSYS) && (strcmp(name, subsysName[i]) != 0); i++);
+		if (i == LS_MAXSUBSYS) {return -1;}
+		logLevel[i] = level;
+
+		spec += n;
+		if (*spec == ',') {spec++;}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * Producer side - lock free, never blocks
+ ******************************************************************************/
+/*
+ * Claim n consecutive slots, all or nothing - long raw lines must not be
+ * split by other producers nor truncated by a partial drop.
+ */
+long claimSlots(logsubsys_t subsys, int n) {
+	unsigned long pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+
+	while (true) {
+		long dif = 0;
+		for (int i = 0; (i < n) && (dif == 0); i++) {
+			logslot_t *slot = &logRing[(pos + i) & (LOG_SLOTS - 1)];
+			dif = (long)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (long)(pos + i);
+		}
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&logHead, &pos, pos + n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				return pos;
+			}
+		} else if (dif < 0) {
+			// ring is full - drop
+			__atomic_add_fetch(&logStats.dropped, 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&logStats.droppedBy[subsys], 1, __ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+logslot_t *claimSlot(logsubsys_t subsys) {
+	long pos = claimSlots(subsys, 1);
+	return pos < 0 ? NULL : &logRing[pos & (LOG_SLOTS - 1)];
+}
+
+void publishSlot(logslot_t *slot) {
+	unsigned long pos = slot->seq;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_exchange_n(&writerIdle, false, __ATOMIC_SEQ_CST)) {
+		sem_post(&logSem);
+	}
+}
+
+int logPut(logsubsys_t subsys, int flags, const char *fmt, va_list args) {
+	if (!loggerRun) {
+		// not started yet (or already closed) - write in place
+		vfprintf((flags & LF_ERR) ? stderr : stdout, fmt, args);
+		return true;
+	}
+
+	logslot_t *slot;
+	if ((slot = claimSlot(subsys)) == NULL) {return false;}
+
+	slot->stamp  = elapsedNS();
+	slot->subsys = subsys;
+	slot->flags  = flags;
+	vsnprintf(slot->text, LOG_LINE, fmt, args);
+	publishSlot(slot);
+
+	return true;
+}
+
+int logPutF(logsubsys_t subsys, int flags, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int rc = logPut(subsys, flags, fmt, args);
+	va_end(args);
+	return rc;
+}
+
+int logMSG(logsubsys_t subsys, int loglevel, const char *fmt, ...) {
+	if (loglevel > getLogLevel(subsys)) {return false;}
+
+	va_list args;
+	va_start(args, fmt);
+	int rc = logPut(subsys, 0, fmt, args);
+	va_end(args);
+	return rc;
+}
+
+int logERR(logsubsys_t subsys, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int rc = logPut(subsys, LF_ERR, fmt, args);
+	va_end(args);
+	return rc;
+}
+
+int logRaw(const char *msg) {
+	int len = strlen(msg);
+	int n   = (len / (LOG_LINE - 1)) + 1;
+
+	if ((!loggerRun) || (n == 1)) {
+		return logPutF(LS_TEXT, LF_RAW, "%s", msg);
+	}
+	if (n > LOG_SLOTS / 4) {return false;}
+
+	long pos;
+	if ((pos = claimSlots(LS_TEXT, n)) < 0) {return false;}
+
+	long stamp = elapsedNS();
+	for (int i = 0; i < n; i++) {
+		logslot_t *slot = &logRing[(pos + i) & (LOG_SLOTS - 1)];
+		slot->stamp  = stamp;
+		slot->subsys = LS_TEXT;
+		slot->flags  = LF_RAW;
+		strncpy(slot->text, msg, LOG_LINE - 1);
+		slot->text[LOG_LINE - 1] = 0;
+		msg += strlen(slot->text);
+		publishSlot(slot);
+	}
+	return true;
+}
+
+/*
+ * Timestamped messages go to stdout by default, a machine readable stream
+ * on stdout moves them out of its way.
+ */
+void setLogOutput(int fd) {
+	logFD = fd;
+}
+
+/*******************************************************************************
+ * Writer side - the only place where log output hits a file descriptor
+ ******************************************************************************/
+int drainRing(void) {
+	char  out[LOG_SLOTS * 32];
+	int   olen = 0;
+	int   count = 0;
+
+	while (true) {
+		logslot_t *slot = &logRing[logTail & (LOG_SLOTS - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != logTail + 1) {break;}
+
+		char line[LOG_LINE + 64];
+		int  llen;
+		if (slot->flags & LF_RAW) {
+			llen = snprintf(line, sizeof(line), "%s", slot->text);
+		} else {
+			llen = snprintf(line, sizeof(line), "[%5ld.%06ld] %s: %s",
+				slot->stamp / 1000000000L, (slot->stamp / 1000L) % 1000000L,
+				subsysName[slot->subsys], slot->text);
+		}
+		if (llen >= (int)sizeof(line)) {llen = sizeof(line) - 1;}
+
+		int fd = (slot->flags & LF_ERR) ? STDERR_FILENO : (slot->flags & LF_RAW) ? STDOUT_FILENO : logFD;
+
+		if (fd != STDOUT_FILENO) {
+			// keep stdout/stderr ordering
+			if (olen > 0) {
+				if (write(STDOUT_FILENO, out, olen) < 0) {}
+				olen = 0;
+			}
+			if (write(fd, line, llen) < 0) {}
+		} else {
+			if (olen + llen > (int)sizeof(out)) {
+				if (write(STDOUT_FILENO, out, olen) < 0) {}
+				olen = 0;
+			}
+			memcpy(out + olen, line, llen);
+			olen += llen;
+		}
+
+		__atomic_store_n(&slot->seq, logTail + LOG_SLOTS, __ATOMIC_RELEASE);
+		logTail++;
+		count++;
+	}
+
+	if (olen > 0) {
+		if (write(STDOUT_FILENO, out, olen) < 0) {}
+	}
+	__atomic_add_fetch(&logStats.written, count, __ATOMIC_RELAXED);
+
+	return count;
+}
+
+int ringEmpty(void) {
+	logslot_t *slot = &logRing[logTail & (LOG_SLOTS - 1)];
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != logTail + 1;
+}
+
+void *loggerWriter(void *x_voidptr) {
+	metricsThread("logger");
+
+	while (__atomic_load_n(&loggerRun, __ATOMIC_ACQUIRE)) {
+		drainRing();
+
+		__atomic_store_n(&writerIdle, true, __ATOMIC_SEQ_CST);
+		if (ringEmpty()) {
+			sem_wait(&logSem);
+		}
+		__atomic_store_n(&writerIdle, false, __ATOMIC_SEQ_CST);
+	}
+	drainRing();
+	return NULL;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int initLogger(void) {
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &logStart);
+	memset(&logStats, 0, sizeof(logStats));
+
+	for (unsigned long i = 0; i < LOG_SLOTS; i++) {
+		logRing[i].seq = i;
+	}
+	logHead = logTail = 0;
+
+	if (sem_init(&logSem, 0, 0) != 0)	{return -1;}
+
+	loggerRun = true;
+	if (pthread_create(&loggerThread, NULL, loggerWriter, NULL) != 0) {
+		loggerRun = false;
+		sem_destroy(&logSem);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Wait (bounded) until the writer has emptied the ring - for the exit paths
+ */
+void flushLogger(void) {
+	if (!loggerRun) {return;}
+
+	for (int i = 0; (i < 200) && !ringEmpty(); i++) {
+		if (__atomic_exchange_n(&writerIdle, false, __ATOMIC_SEQ_CST)) {
+			sem_post(&logSem);
+		}
+		usleep(1000);
+	}
+}
+
+void closeLogger(void) {
+	if (!loggerRun) {return;}
+
+	__atomic_store_n(&loggerRun, false, __ATOMIC_RELEASE);
+	sem_post(&logSem);
+	pthread_join(loggerThread, NULL);
+	sem_destroy(&logSem);
+
+	if (logStats.dropped > 0) {
+		fprintf(stderr, "Logger: %lu written, %lu dropped\n", logStats.written, logStats.dropped);
+	}
+}
+
+void getLogStats(logstats_t *stats) {
+	if (stats == NULL) {return;}
+	memcpy(stats, &logStats, sizeof(logstats_t));
+}
@@ -0,0 +1,47 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H 1
+
+#define LOG_SLOTS	256		// must be a power of 2
+#define LOG_LINE	256
+
+typedef enum {LS_MAIN, LS_SLIM, LS_MIXER, LS_DISPLAY, LS_TEXT, LS_MAXSUBSYS} logsubsys_t;
+
+typedef struct LogStats {
+	unsigned long written;
+	unsigned long dropped;
+	unsigned long droppedBy[LS_MAXSUBSYS];
+} logstats_t;
+
+int   initLogger(void);
+void  closeLogger(void);
+void  flushLogger(void);
+int   setLogLevel(logsubsys_t subsys, int loglevel);
+int   getLogLevel(logsubsys_t subsys);
+int   parseLogLevels(const char *spec);
+int   logMSG(logsubsys_t subsys, int loglevel, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int   logERR(logsubsys_t subsys, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int   logRaw(const char *msg);
+void  setLogOutput(int fd);
+void  getLogStats(logstats_t *stats);
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ *	metrics.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Prometheus text exposition of the monitor internals.
+ *	The hot paths only do relaxed atomic adds, the listener runs in its own
+ *	thread and never takes a lock the render or poll paths could wait for.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+
+#define METRICS_BUFF	8192
+
+typedef struct MTimer {
+	const char		*name;
+	const char		*help;
+	unsigned long	count;
+	unsigned long	sumNS;
+	unsigned long	lastNS;
+	unsigned long	maxNS;
+} mtimer;
+
+typedef struct MThread {
+	const char		*name;
+	pthread_t		thread;
+} mthread;
+
+mtimer mTimers[MT_MAXTIMERS] = {
+	{"lms_poll_latency_seconds", "CLI request round trip",            0, 0, 0, 0},
+	{"lms_parse_seconds",        "Tag parsing of a status answer",    0, 0, 0, 0},
+	{"lms_frame_seconds",        "Screen update of one refresh cycle", 0, 0, 0, 0},
+};
+
+const char *mCounterName[MC_MAXCOUNTERS] = {
+	"lms_polls_total",
+	"lms_frames_total",
+	"lms_i2c_bytes_total",
+	"lms_connects_total",
+	"lms_reconnects_total",
+	"lms_volume_events_total",
+	"lms_stream_bytes_total",
+	"lms_i2c_transfers_total",
+	"lms_tags_unchanged_total",
+	"lms_decode_cache_hits_total",
+	"lms_decode_cache_misses_total",
+	"lms_playlist_entries_total",
+};
+
+unsigned long	mCounters[MC_MAXCOUNTERS];
+mthread			mThreads[MAXTHREADS];
+int				mThreadCount = 0;
+
+int				metricsFD = -1;
+int				metricsRun = false;
+pthread_t		metricsThreadID;
+char			metricsSock[108] = {0};
+
+/*******************************************************************************
+ * Recording - called from the hot paths
+ ******************************************************************************/
+long metricsNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void metricsTime(mtimer_t timer, long start) {
+	unsigned long ns = metricsNow() - start;
+	mtimer *t = &mTimers[timer];
+
+	__atomic_add_fetch(&t->count, 1,  __ATOMIC_RELAXED);
+	__atomic_add_fetch(&t->sumNS, ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&t->lastNS,  ns, __ATOMIC_RELAXED);
+	if (ns > __atomic_load_n(&t->maxNS, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&t->maxNS, ns, __ATOMIC_RELAXED);
+	}
+}
+
+void metricsCount(mcounter_t counter, unsigned long n) {
+	__atomic_add_fetch(&mCounters[counter], n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Register the calling thread for the per thread CPU time
+ */
+void metricsThread(const char *name) {
+	int i = __atomic_fetch_add(&mThreadCount, 1, __ATOMIC_RELAXED);
+	if (i >= MAXTHREADS) {return;}
+
+	mThreads[i].thread = pthread_self();
+	__atomic_store_n(&mThreads[i].name, name, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * Exposition
+ ******************************************************************************/
+double cpuSeconds(clockid_t cid) {
+	struct timespec ts;
+	if (clock_gettime(cid, &ts) != 0) {return 0;}
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int metricsText(char *out, int outSize) {
+	char *o   = out;
+	char *end = out + outSize;
+	logstats_t ls;
+
+	for (int i = 0; (i < MT_MAXTIMERS) && (o < end); i++) {
+		mtimer *t = &mTimers[i];
+		o += snprintf(o, end - o,
+			"# HELP %s %s\n# TYPE %s summary\n%s_sum %.6f\n%s_count %lu\n"
+			"# TYPE %s_last gauge\n%s_last %.6f\n# TYPE %s_max gauge\n%s_max %.6f\n",
+			t->name, t->help, t->name,
+			t->name, __atomic_load_n(&t->sumNS, __ATOMIC_RELAXED) / 1e9,
+			t->name, __atomic_load_n(&t->count, __ATOMIC_RELAXED),
+			t->name, t->name, __atomic_load_n(&t->lastNS, __ATOMIC_RELAXED) / 1e9,
+			t->name, t->name, __atomic_load_n(&t->maxNS, __ATOMIC_RELAXED) / 1e9);
+	}
+
+	for (int i = 0; (i < MC_MAXCOUNTERS) && (o < end); i++) {
+		o += snprintf(o, end - o, "# TYPE %s counter\n%s %lu\n",
+			mCounterName[i], mCounterName[i], __atomic_load_n(&mCounters[i], __ATOMIC_RELAXED));
+	}
+
+	getLogStats(&ls);
+	if (o < end) {
+		o += snprintf(o, end - o, "# TYPE lms_log_dropped_total counter\nlms_log_dropped_total %lu\n", ls.dropped);
+	}
+
+	if (o < end) {
+		// the total on its own: a sum over thread adds up the threads only
+		o += snprintf(o, end - o, "# TYPE lms_process_cpu_seconds_total counter\n"
+			"lms_process_cpu_seconds_total %.6f\n# TYPE lms_thread_cpu_seconds_total counter\n",
+			cpuSeconds(CLOCK_PROCESS_CPUTIME_ID));
+	}
+
+	int n = __atomic_load_n(&mThreadCount, __ATOMIC_RELAXED);
+	for (int i = 0; (i < n) && (i < MAXTHREADS) && (o < end); i++) {
+		const char *name = __atomic_load_n(&mThreads[i].name, __ATOMIC_ACQUIRE);
+		clockid_t cid;
+
+		if (name == NULL)											{continue;}
+		if (pthread_getcpuclockid(mThreads[i].thread, &cid) != 0)	{continue;}
+		o += snprintf(o, end - o, "lms_thread_cpu_seconds_total{thread=\"%s\"} %.6f\n", name, cpuSeconds(cid));
+	}
+
+	return (o < end) ? o - out : outSize - 1;
+}
+
+/*******************************************************************************
+ * Listener - one short lived connection per scrape
+ ******************************************************************************/
+void serveScrape(int cfd) {
+	char request[1024];
+	char body[METRICS_BUFF];
+	char head[128];
+	struct pollfd pfd = {cfd, POLLIN, 0};
+
+	// a scraper that does not send its request in time is dropped
+	if (poll(&pfd, 1, 200) != 1)								{return;}
+	if (recv(cfd, request, sizeof(request) - 1, MSG_DONTWAIT) <= 0)	{return;}
+
+	int blen = metricsText(body, sizeof(body));
+	int hlen = snprintf(head, sizeof(head),
+		"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", blen);
+
+	if (send(cfd, head, hlen, MSG_DONTWAIT | MSG_NOSIGNAL) == hlen) {
+		send(cfd, body, blen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+}
+
+void *metricsServer(void *x_voidptr) {
+	struct pollfd pfd = {metricsFD, POLLIN, 0};
+
+	metricsThread("metrics");
+
+	while (metricsRun) {
+		if (poll(&pfd, 1, 500) != 1) {continue;}
+
+		int cfd = accept(metricsFD, NULL, NULL);
+		if (cfd < 0) {continue;}
+		serveScrape(cfd);
+		close(cfd);
+	}
+	return NULL;
+}
+
+/*
+ * listenOn: "9100", "127.0.0.1:9100" or "unix:/path"
+ */
+int initMetrics(const char *listenOn) {
+	int enable = 1;
+
+	if (listenOn == NULL) {return -1;}
+
+	if (strncmp(listenOn, "unix:", 5) == 0) {
+		struct sockaddr_un addr;
+
+		if (strlen(listenOn + 5) >= sizeof(addr.sun_path)) {
+			logERR(LS_MAIN, "Metrics socket path too long: %s\n", listenOn + 5);
+			return -1;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", listenOn + 5);
+		snprintf(metricsSock, sizeof(metricsSock), "%s", addr.sun_path);
+		unlink(metricsSock);
+
+		if ((metricsFD = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)	{return -1;}
+		if (bind(metricsFD, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			logERR(LS_MAIN, "Metrics bind %s: %s\n", listenOn, strerror(errno));
+			close(metricsFD);
+			return -1;
+		}
+	} else {
+		struct sockaddr_in addr;
+		const char *port = strchr(listenOn, ':');
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family      = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (port != NULL) {
+			char host[INET_ADDRSTRLEN] = {0};
+			int  len = port - listenOn;
+
+			if (len < INET_ADDRSTRLEN)	{memcpy(host, listenOn, len);}
+			// a mistyped address must not serve on every interface
+			if ((len >= INET_ADDRSTRLEN) || (inet_pton(AF_INET, host, &addr.sin_addr) != 1)) {
+				logERR(LS_MAIN, "Metrics address %s: not an IPv4 address\n", listenOn);
+				return -1;
+			}
+			port++;
+		} else {
+			port = listenOn;
+		}
+		addr.sin_port = htons(atoi(port));
+
+		if ((metricsFD = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)	{return -1;}
+		setsockopt(metricsFD, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+		if (bind(metricsFD, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			logERR(LS_MAIN, "Metrics bind %s: %s\n", listenOn, strerror(errno));
+			close(metricsFD);
+			return -1;
+		}
+	}
+
+	if (listen(metricsFD, 4) < 0) {
+		close(metricsFD);
+		return -1;
+	}
+
+	metricsRun = true;
+	if (pthread_create(&metricsThreadID, NULL, metricsServer, NULL) != 0) {
+		metricsRun = false;
+		close(metricsFD);
+		return -1;
+	}
+
+	logMSG(LS_MAIN, LL_INFO, "Metrics listening on %s\n", listenOn);
+	return 0;
+}
+
+void closeMetrics(void) {
+	if (!metricsRun) {return;}
+
+	metricsRun = false;
+	pthread_join(metricsThreadID, NULL);
+	close(metricsFD);
+	if (metricsSock[0]) {unlink(metricsSock);}
+}
@@ -0,0 +1,37 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H 1
+
+#define MAXTHREADS	8
+
+typedef enum {MT_POLL, MT_PARSE, MT_FRAME, MT_MAXTIMERS} mtimer_t;
+typedef enum {MC_POLLS, MC_FRAMES, MC_I2C_BYTES, MC_CONNECTS, MC_RECONNECTS, MC_VOLUME_EVENTS, MC_STREAM_BYTES, MC_I2C_TRANSFERS, MC_TAGS_UNCHANGED, MC_DECODE_HITS, MC_DECODE_MISSES, MC_PLAYLIST_ENTRIES, MC_MAXCOUNTERS} mcounter_t;
+
+int   initMetrics(const char *listenOn);
+void  closeMetrics(void);
+void  metricsThread(const char *name);
+long  metricsNow(void);
+void  metricsTime(mtimer_t timer, long start);
+void  metricsCount(mcounter_t counter, unsigned long n);
+int   metricsText(char *out, int outSize);
+
+#endif
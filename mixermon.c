@@ -25,21 +25,34 @@
 #include <alsa/asoundlib.h>
 
 #include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "mixermon.h"
+#include "trace.h"
 
 #define SLEEP_TIME	(25000/25)
 #define CNLENGTH    64
+#define MIMO_WAIT	1000		// ms, the mixer thread looks for a card switch
 
 char        device_name[CNLENGTH];
 char        card[CNLENGTH];
-snd_mixer_t *handle;
+char        nextCard[CNLENGTH];
+int         cardPending = false;
+snd_mixer_t *handle = NULL;
 pthread_t   seventsThread;
-char        stbm[BSIZE];
 long actVolume  = 0;
 
 long getActVolume(void) {
     return actVolume;
 }
 
+void setActVolume(long volume) {
+	if (volume != actVolume) {
+		traceVolume(volume);
+	}
+	actVolume = volume;
+}
+
 static void sevents_value(snd_mixer_selem_id_t *sid) {
 	long min, max, currentVolume;
 	const char *selem_name;
@@ -61,7 +74,7 @@ static void sevents_value(snd_mixer_selem_id_t *sid) {
 
 	// Get current volume
 	if (snd_mixer_selem_get_playback_volume (elem, SND_MIXER_SCHN_FRONT_LEFT, &currentVolume) == 0) {
-		actVolume = (currentVolume*100)/(max-min);
+		setActVolume((currentVolume*100)/(max-min));
 //		printf("actVolume = %ld (currentVolume = %ld)\n", actVolume, currentVolume);
    	}
 }
@@ -90,6 +103,7 @@ static int melem_event(snd_mixer_elem_t *elem, unsigned int mask) {
 	}
 */
 	if (mask & SND_CTL_EVENT_MASK_VALUE) {
+		metricsCount(MC_VOLUME_EVENTS, 1);
 		sevents_value(sid);
 	}
 
@@ -119,37 +133,100 @@ static int mixer_event(snd_mixer_t *mixer, unsigned int mask, snd_mixer_elem_t *
 	return 0;
 }
 
-void *sevents(void *x_voidptr){
+int openMimo(void) {
 	int err;
 
 	if ((err = snd_mixer_open(&handle, 0)) < 0) {
-		perror("Mixer open error.\n");
-		return NULL;
+		logERR(LS_MIXER, "Mixer open error: %s\n", snd_strerror(err));
+		handle = NULL;
+		return -1;
 	}
 
 	if ((err = snd_mixer_attach(handle, card)) < 0) {
-		perror("Mixer attach error.\n");
-		snd_mixer_close(handle);
-		return NULL;
+		logERR(LS_MIXER, "Mixer attach error: %s\n", snd_strerror(err));
+		closeMimo();
+		return -1;
 	}
 
 	if ((err = snd_mixer_selem_register(handle, NULL, NULL)) < 0) {
-		perror("Mixer register error.\n");
-		snd_mixer_close(handle);
-		return NULL;
+		logERR(LS_MIXER, "Mixer register error: %s\n", snd_strerror(err));
+		closeMimo();
+		return -1;
 	}
 
 	snd_mixer_set_callback(handle, mixer_event);
 	if ((err = snd_mixer_load(handle)) < 0) {
-		perror("Mixer load error.\n");
+		logERR(LS_MIXER, "Mixer load error: %s\n", snd_strerror(err));
+		closeMimo();
+		return -1;
+	}
+	return 0;
+}
+
+void closeMimo(void) {
+	if (handle != NULL) {
 		snd_mixer_close(handle);
-		return NULL;;
+		handle = NULL;
 	}
+}
+
+/*
+ * Poll descriptors of the mixer - for an external event loop
+ */
+int mimoPollFDs(struct pollfd *pfds, int maxFDs) {
+	if (handle == NULL)	{return 0;}
+
+	int count = snd_mixer_poll_descriptors_count(handle);
+	if (count > maxFDs)	{count = maxFDs;}
+	return snd_mixer_poll_descriptors(handle, pfds, count);
+}
+
+int mimoHandleEvents(struct pollfd *pfds, int count) {
+	unsigned short revents = 0;
+
+	if (handle == NULL)	{return -1;}
+
+	snd_mixer_poll_descriptors_revents(handle, pfds, count, &revents);
+	if (revents & (POLLIN | POLLPRI)) {
+		return snd_mixer_handle_events(handle);
+	}
+	return 0;
+}
+
+/*
+ * Another card, from the config file: the handle is swapped by the thread
+ * of the mixer, mimoSwitch() does it there
+ */
+void switchMimo(const char *cName) {
+	strncpy(nextCard, cName, CNLENGTH - 1);
+	__atomic_store_n(&cardPending, true, __ATOMIC_RELEASE);
+}
+
+// 1 when the mixer was reopened with another card
+int mimoSwitch(void) {
+	if (!__atomic_exchange_n(&cardPending, false, __ATOMIC_ACQUIRE))	{return 0;}
+
+	closeMimo();
+	setMimoDevice(nextCard, NULL);
+	openMimo();
+	return 1;
+}
+
+void *sevents(void *x_voidptr){
+	metricsThread("mixer");
+
+	openMimo();
 
 //	printf("Ready to listen...\n");
 	while (1) {
 		int res;
-		res = snd_mixer_wait(handle, -1);
+		mimoSwitch();
+		if (handle == NULL) {
+			// no mixer until another card is set
+			usleep(MIMO_WAIT * 1000);
+			continue;
+		}
+		res = snd_mixer_wait(handle, MIMO_WAIT);
 		if (res >= 0) {
 			// printf("Poll ok: %i\n", res);
 			res = snd_mixer_handle_events(handle);
@@ -157,14 +234,11 @@ void *sevents(void *x_voidptr){
 		}
 	}
 
-	snd_mixer_close(handle);
+	closeMimo();
 	return NULL;
 }
 
-
-int startMimo(char *cName, char *dName) {
-	int x = 0;
-
+void setMimoDevice(char *cName, char *dName) {
     if (cName != NULL) {
         strncpy(card, cName, CNLENGTH);
     } else {
@@ -177,8 +251,13 @@ int startMimo(char *cName, char *dName) {
         strncpy(device_name, "default", CNLENGTH);
     }
 
-    sprintf(stbm, "Init ALSA wint CARD:%s and DEVICE:%s\n", card, device_name);
-    putMSG(stbm, LL_INFO);
+    logMSG(LS_MIXER, LL_INFO, "Init ALSA wint CARD:%s and DEVICE:%s\n", card, device_name);
+}
+
+int startMimo(char *cName, char *dName) {
+	int x = 0;
+
+	setMimoDevice(cName, dName);
 
 	if (pthread_create(&seventsThread, NULL, sevents, &x) != 0) {
 		abort("Failed to create ALSA mixer monitoring thread!");
@@ -22,7 +22,17 @@
 #ifndef MIMO_CALLBACK_H
 #define MIMO_CALLBACK_H 1
 
+#include <poll.h>
+
 long getActVolume(void);
+void setActVolume(long volume);
 int  startMimo(char *cName, char *dName);
+void setMimoDevice(char *cName, char *dName);
+void switchMimo(const char *cName);
+int  mimoSwitch(void);
+int  openMimo(void);
+void closeMimo(void);
+int  mimoPollFDs(struct pollfd *pfds, int maxFDs);
+int  mimoHandleEvents(struct pollfd *pfds, int count);
 
 #endif
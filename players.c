@@ -0,0 +1,258 @@
+/*
+ *	players.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Player directory: built from "players 0 N", kept up to date by the
+ *	client / playlist notifications, looked up by name or ID through two
+ *	small open addressing hash tables.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "common.h"
+#include "logger.h"
+#include "tagUtils.h"
+#include "players.h"
+
+lmsplayer	players[MAXPLAYERS];
+int			playerNum = 0;
+int			nameIndex[PLAYER_HASH];		// slot + 1, 0 is empty
+int			idIndex[PLAYER_HASH];
+long		noteSeq = 0;
+lmsplayer	staged[MAXPLAYERS];			// a new list while it is read
+int			stagedNum = 0;
+
+/*******************************************************************************
+ * Index
+ ******************************************************************************/
+unsigned int hashKey(const char *key, int fold) {
+	unsigned int h = 2166136261u;		// FNV-1a
+
+	for (; *key; key++) {
+		h ^= (unsigned char)(fold ? tolower(*key) : *key);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void indexPut(int *table, const char *key, int fold, int slot) {
+	unsigned int h = hashKey(key, fold);
+
+	for (int i = 0; i < PLAYER_HASH; i++) {
+		int *e = &table[(h + i) & (PLAYER_HASH - 1)];
+		if (*e == 0) {
+			*e = slot + 1;
+			return;
+		}
+	}
+}
+
+lmsplayer *indexGet(int *table, const char *key, int fold) {
+	unsigned int h = hashKey(key, fold);
+
+	for (int i = 0; i < PLAYER_HASH; i++) {
+		int e = table[(h + i) & (PLAYER_HASH - 1)];
+		if (e == 0) {return NULL;}
+
+		lmsplayer *p = &players[e - 1];
+		if (p->present && ((fold ? strcasecmp(p->name, key) : strcmp(p->id, key)) == 0)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+void rebuildIndex(void) {
+	memset(nameIndex, 0, sizeof(nameIndex));
+	memset(idIndex,   0, sizeof(idIndex));
+
+	for (int i = 0; i < playerNum; i++) {
+		if (!players[i].present) {continue;}
+		indexPut(nameIndex, players[i].name, true,  i);
+		indexPut(idIndex,   players[i].id,   false, i);
+	}
+}
+
+lmsplayer *findPlayerByName(const char *name) {
+	return (name == NULL) ? NULL : indexGet(nameIndex, name, true);
+}
+
+lmsplayer *findPlayerByID(const char *id) {
+	return (id == NULL) ? NULL : indexGet(idIndex, id, false);
+}
+
+int playerCountKnown(void) {
+	int count = 0;
+	for (int i = 0; i < playerNum; i++) {
+		count += players[i].present;
+	}
+	return count;
+}
+
+/*******************************************************************************
+ * players 0 N answer
+ ******************************************************************************/
+const char *playersQuery(void) {
+	static char q[32];
+	sprintf(q, "players 0 %d\n", MAXPLAYERS);
+	return q;
+}
+
+/*
+ * A new list is staged player by player, then replaces the directory in
+ * one go - the CLI answer and the JSON-RPC players_loop alike
+ */
+void stagePlayers(void) {
+	memset(staged, 0, sizeof(staged));
+	stagedNum = 0;
+}
+
+// the index-th player of the new list, NULL past MAXPLAYERS
+lmsplayer *stagePlayer(int index) {
+	if ((index < 0) || (index >= MAXPLAYERS))	{return NULL;}
+
+	if (index >= stagedNum)	{stagedNum = index + 1;}
+	staged[index].present = true;
+	return &staged[index];
+}
+
+int commitPlayers(void) {
+	// keep the start order we already know about
+	for (int i = 0; i < stagedNum; i++) {
+		lmsplayer *old = findPlayerByID(staged[i].id);
+		if (old != NULL) {staged[i].startedAt = old->startedAt;}
+		// a start only the list tells of (JSON-RPC, no notifications)
+		if (staged[i].playing && ((old == NULL) || !old->playing)) {staged[i].startedAt = ++noteSeq;}
+		logMSG(LS_SLIM, LL_DEBUG, "Player %s: %s (%s)%s\n", staged[i].id, staged[i].name, staged[i].model, staged[i].playing ? " playing" : "");
+	}
+
+	memcpy(players, staged, sizeof(players));
+	playerNum = stagedNum;
+	rebuildIndex();
+
+	return playerNum;
+}
+
+int parsePlayers(char *answer) {
+	char		term[BSIZE];
+	int			count = 0;
+	lmsplayer	*p = NULL;
+
+	stagePlayers();
+
+	for (char *t = answer; (t != NULL) && (*t); t = strchr(t, ' ')) {
+		while (*t == ' ') {t++;}
+		// a CLI line is longer than term, decode() has no bound
+		if (strcspn(t, " \n") >= sizeof(term))	{continue;}
+		if (decode(t, term) < 0)	{continue;}
+
+		char *val = strchr(term, ':');
+		if (val == NULL)			{continue;}
+		*val++ = 0;
+
+		if (strcmp(term, "playerindex") == 0) {
+			if ((p = stagePlayer(count++)) == NULL)	{break;}
+		} else if (p == NULL) {
+			continue;
+		} else if (strcmp(term, "playerid") == 0) {
+			strncpy(p->id,    val, PLAYER_IDLEN - 1);
+		} else if (strcmp(term, "name") == 0) {
+			strncpy(p->name,  val, PLAYER_NAMELEN - 1);
+		} else if (strcmp(term, "model") == 0) {
+			strncpy(p->model, val, PLAYER_NAMELEN - 1);
+		} else if (strcmp(term, "isplaying") == 0) {
+			p->playing = atoi(val);
+		}
+	}
+
+	return commitPlayers();
+}
+
+/*
+ * The player we should follow: the last one that started playing,
+ * then anything playing, then anything connected.
+ */
+lmsplayer *activePlayer(void) {
+	lmsplayer *best = NULL;
+
+	for (int i = 0; i < playerNum; i++) {
+		lmsplayer *p = &players[i];
+		if (!p->present) {continue;}
+
+		if ((best == NULL) ||
+			(p->playing && !best->playing) ||
+			(p->playing && best->playing && (p->startedAt > best->startedAt))) {
+			best = p;
+		}
+	}
+	return best;
+}
+
+/*******************************************************************************
+ * Notifications: "<playerid> client new|reconnect|disconnect|forget"
+ *                "<playerid> playlist newsong|pause|stop ..."
+ ******************************************************************************/
+playernote_t playerNotification(char *line, lmsplayer **player) {
+	char id[PLAYER_IDLEN];
+	char cmd[16];
+	char sub[16];
+	char arg[16];
+	char term[BSIZE];
+
+	*player = NULL;
+	arg[0]  = 0;
+
+	if (strcspn(line, " \n") >= sizeof(term))		{return PN_NONE;}
+	if (decode(line, term) < 0)						{return PN_NONE;}
+	if (strlen(term) >= PLAYER_IDLEN)				{return PN_NONE;}
+	strcpy(id, term);
+	if (sscanf(line, "%*s %15s %15s %15s", cmd, sub, arg) < 2)	{return PN_NONE;}
+
+	lmsplayer *p = findPlayerByID(id);
+
+	if (strcmp(cmd, "client") == 0) {
+		if ((strcmp(sub, "disconnect") == 0) || (strcmp(sub, "forget") == 0)) {
+			if (p != NULL) {
+				p->present = false;
+				rebuildIndex();
+			}
+		}
+		logMSG(LS_SLIM, LL_INFO, "Player %s: client %s\n", id, sub);
+		return PN_STALE;
+	}
+
+	if (strcmp(cmd, "playlist") != 0)				{return PN_NONE;}
+	if (p == NULL)									{return PN_STALE;}
+
+	if ((strcmp(sub, "newsong") == 0) || ((strcmp(sub, "pause") == 0) && (strcmp(arg, "0") == 0))) {
+		p->playing   = true;
+		p->startedAt = ++noteSeq;
+		*player      = p;
+		return PN_STARTED;
+	}
+
+	if ((strcmp(sub, "stop") == 0) || ((strcmp(sub, "pause") == 0) && (strcmp(arg, "1") == 0))) {
+		p->playing = false;
+	}
+	*player = p;
+	return PN_CHANGED;
+}
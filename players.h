@@ -0,0 +1,51 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef PLAYERS_H
+#define PLAYERS_H 1
+
+#define MAXPLAYERS		32
+#define PLAYER_HASH		64			// must be a power of 2, > 2 * MAXPLAYERS
+#define PLAYER_IDLEN	32
+#define PLAYER_NAMELEN	64
+
+typedef enum {PN_NONE, PN_STALE, PN_STARTED, PN_CHANGED} playernote_t;
+
+typedef struct LMSPlayer {
+	char	id[PLAYER_IDLEN];
+	char	name[PLAYER_NAMELEN];
+	char	model[PLAYER_NAMELEN];
+	int		playing;
+	int		present;
+	long	startedAt;			// notification sequence of the last start
+} lmsplayer;
+
+const char  *playersQuery(void);
+int          parsePlayers(char *answer);
+void         stagePlayers(void);
+lmsplayer   *stagePlayer(int index);
+int          commitPlayers(void);
+lmsplayer   *findPlayerByName(const char *name);
+lmsplayer   *findPlayerByID(const char *id);
+lmsplayer   *activePlayer(void);
+int          playerCountKnown(void);
+playernote_t playerNotification(char *line, lmsplayer **player);
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ *	playlist.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The up next list without the whole playlist: what the screen shows,
+ *	plus a few entries ahead, is fetched in windows of PL_WINDOW entries
+ *	with status <start> <count> and at most PL_WINDOWS of them are kept,
+ *	the least recently shown goes first. A window is good for the
+ *	playlist_timestamp it was fetched at. A playlist notification of the
+ *	player drops the windows it touches, the others take the timestamp of
+ *	the next status answer; a new timestamp without a notification drops
+ *	them all. Over JSON-RPC a window is scanned straight into a slot held
+ *	aside, it is taken when the timestamp of the answer is the current one.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "cliengine.h"
+#include "tagUtils.h"
+#include "pollsched.h"
+#include "playlist.h"
+
+#define PL_INDEX	" playlist%20index%3A"
+#define PL_FILLING	(-2)			// start of a window a JSON-RPC answer is written to
+
+typedef struct {
+	int		start;					// first index, -1 free, PL_FILLING
+	char	stamp[PL_STAMPLEN];		// playlist_timestamp of the fetch
+	unsigned have;					// bit per entry the server sent
+	long	used;					// last shown
+	plentry	entry[PL_WINDOW];
+} plwindow;
+
+plwindow	plWindow[PL_WINDOWS];
+char		plStamp[PL_STAMPLEN] = {0};
+int			plCarry   = false;		// windows kept through a notification take the next timestamp
+int			plCurrent = -1;
+int			plTracks  = 0;
+long		plClock   = 0;
+plstats		plStats;
+
+int			plWant[PL_FETCH];		// window starts missing on the screen
+int			nWant = 0;
+
+char		fetchAnswer[PL_FETCH][CLI_RXSIZE];
+int			fetchStart[PL_FETCH];
+int			rFetch[PL_FETCH] = {-1, -1};
+int			nFetch = 0;
+
+typedef struct {
+	int			start;
+	plwindow	*w;					// claimed at the first entry of the answer
+	char		stamp[PL_STAMPLEN];	// playlist_timestamp of the answer
+} plfetch;
+
+plfetch		fetchJSON[PL_FETCH];
+
+// notifications that leave the entries where they are
+static const char *samePlaylist[] = {"newsong", "pause", "stop", "play", "jump", "index", "open", "sync", "cant_open", NULL};
+
+int playlistCurrent(void) {
+	return plCurrent;
+}
+
+int playlistTracks(void) {
+	return plTracks;
+}
+
+const plstats *playlistStats(void) {
+	return &plStats;
+}
+
+void playlistReset(void) {
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plWindow[i].start = -1;
+	}
+	plStamp[0] = 0;
+	plCarry    = false;
+	plCurrent  = -1;
+	plTracks   = 0;
+	nWant      = 0;
+}
+
+/*******************************************************************************
+ * Windows
+ ******************************************************************************/
+plwindow *findWindow(int start) {
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plwindow *w = &plWindow[i];
+		if ((w->start == start) && (strcmp(w->stamp, plStamp) == 0))	{return w;}
+	}
+	return NULL;
+}
+
+// the windows overlapping from..to are gone, the others stay
+void dropWindows(int from, int to) {
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plwindow *w = &plWindow[i];
+		if ((w->start >= 0) && (w->start <= to) && (w->start + PL_WINDOW > from)) {
+			w->start = -1;
+			plStats.dropped++;
+		}
+	}
+	plCarry = true;
+}
+
+void dropAll(void) {
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plWindow[i].start = -1;
+	}
+	plCarry = false;
+	plStats.flushed++;
+}
+
+const plentry *playlistEntry(int index) {
+	if ((index < 0) || (index >= plTracks))		{return NULL;}
+
+	plwindow *w = findWindow(index - index % PL_WINDOW);
+	if ((w == NULL) || !(w->have & (1u << (index % PL_WINDOW))))	{return NULL;}
+
+	w->used = ++plClock;
+	return &w->entry[index % PL_WINDOW];
+}
+
+/*
+ * The screen shows first..first+count-1: the windows missing for them and
+ * the prefetch are fetched with the next poll, which is made due now when
+ * a new one is missing
+ */
+void playlistShow(int first, int count) {
+	int want[PL_FETCH];
+	int n    = 0;
+	int last = first + count + PL_PREFETCH;
+
+	if (first < 0)			{first = 0;}
+	if (last > plTracks)	{last  = plTracks;}
+
+	for (int start = first - first % PL_WINDOW; (start < last) && (n < PL_FETCH); start += PL_WINDOW) {
+		plwindow *w = findWindow(start);
+		if (w != NULL) {
+			w->used = ++plClock;
+		} else {
+			want[n++] = start;
+		}
+	}
+
+	if ((n > 0) && ((n != nWant) || (memcmp(want, plWant, n * sizeof(int)) != 0))) {
+		schedNow();
+	}
+	memcpy(plWant, want, n * sizeof(int));
+	nWant = n;
+}
+
+// the slot for a window: its own, a free one or the least recently shown
+plwindow *windowSlot(int start) {
+	plwindow *w = NULL;
+
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plwindow *c = &plWindow[i];
+		if (c->start == PL_FILLING)	{continue;}
+		if ((c->start == start) || (c->start < 0)) {
+			w = c;
+			break;
+		}
+		if ((w == NULL) || (c->used < w->used))	{w = c;}
+	}
+	return w;
+}
+
+/*******************************************************************************
+ * Answers
+ ******************************************************************************/
+
+/*
+ * The current index, the length and the timestamp of a status answer;
+ * -1 and NULL for the ones it did not have
+ */
+void playlistSetStatus(int current, int tracks, const char *stamp) {
+	if (current >= 0)	{plCurrent = current;}
+	if (tracks >= 0)	{plTracks  = tracks;}
+
+	if ((stamp == NULL) || (strlen(stamp) >= PL_STAMPLEN) || (strcmp(stamp, plStamp) == 0))	{return;}
+	const char *value = stamp;
+
+	for (int i = 0; i < PL_WINDOWS; i++) {
+		plwindow *w = &plWindow[i];
+		if (w->start < 0)	{continue;}
+		if (plCarry && (strcmp(w->stamp, plStamp) == 0)) {
+			strcpy(w->stamp, value);
+		} else {
+			w->start = -1;
+		}
+	}
+	if (!plCarry && (plStamp[0] != 0)) {
+		plStats.flushed++;
+	}
+	strcpy(plStamp, value);
+	plCarry = false;
+}
+
+void playlistStatus(char *answer) {
+	char value[PL_STAMPLEN];
+	const char *raw;
+	int  len;
+	int  current = -1;
+	int  tracks  = -1;
+
+	if ((raw = findTag("playlist_cur_index", answer, &len)) != NULL)	{current = atoi(raw);}
+	if ((raw = findTag("playlist_tracks",    answer, &len)) != NULL)	{tracks  = atoi(raw);}
+
+	if (((raw = findTag("playlist_timestamp", answer, &len)) == NULL) || (len >= PL_STAMPLEN)) {
+		playlistSetStatus(current, tracks, NULL);
+		return;
+	}
+	memcpy(value, raw, len);
+	value[len] = 0;
+	playlistSetStatus(current, tracks, value);
+}
+
+// decoded, cut at a character boundary to fit
+void copyField(const char *name, const char *entry, char *out) {
+	char value[MAXTAG_DATA + 1];
+	const char *raw;
+	int  len;
+
+	out[0] = 0;
+	if (((raw = findTag(name, entry, &len)) == NULL) || (len > MAXTAG_DATA))	{return;}
+	if ((len = decode(raw, value)) < 0)	{return;}
+
+	if (len >= PL_TEXT) {
+		len = PL_TEXT - 1;
+		while ((len > 0) && ((value[len] & 0xC0) == 0x80))	{len--;}
+	}
+	memcpy(out, value, len);
+	out[len] = 0;
+}
+
+void storeWindow(int start, char *answer) {
+	const char *raw;
+	int  len;
+
+	// an answer from before the playlist changed, asked again next poll
+	if ((raw = findTag("playlist_timestamp", answer, &len)) == NULL)	{raw = ""; len = 0;}
+	if ((len != (int)strlen(plStamp)) || (memcmp(raw, plStamp, len) != 0)) {
+		logMSG(LS_SLIM, LL_DEBUG, "Playlist window %d of another timestamp\n", start);
+		return;
+	}
+
+	plwindow *w = windowSlot(start);
+	w->start = start;
+	w->have  = 0;
+	w->used  = ++plClock;
+	strcpy(w->stamp, plStamp);
+
+	for (char *p = strstr(answer, PL_INDEX), *next; p != NULL; p = next) {
+		int index = atoi(p + strlen(PL_INDEX));
+		char save = 0;
+
+		// the fields of an entry run up to the next one
+		if ((next = strstr(p + 1, PL_INDEX)) != NULL) {
+			save  = *next;
+			*next = 0;
+		}
+		if ((index >= start) && (index < start + PL_WINDOW)) {
+			copyField("title",  p, w->entry[index - start].title);
+			copyField("artist", p, w->entry[index - start].artist);
+			w->have |= 1u << (index - start);
+			plStats.entries++;
+			metricsCount(MC_PLAYLIST_ENTRIES, 1);
+		}
+		if (next != NULL) {
+			*next = save;
+		}
+	}
+	logMSG(LS_SLIM, LL_DEBUG, "Playlist window %d: %08x\n", start, w->have);
+}
+
+/*
+ * JSON-RPC: result.playlist_loop[k].title and .artist go to the entries
+ * of a claimed slot, result.playlist_timestamp to the fetch
+ */
+char *windowField(jsonscan *js, int *size) {
+	plfetch *f = (plfetch *)js->ctx;
+	int k = jsonIndex(js, 2);
+
+	if (strcmp(jsonKey(js, 0), "result") != 0)	{return NULL;}
+
+	if ((js->depth == 2) && (strcmp(jsonKey(js, 1), "playlist_timestamp") == 0)) {
+		*size = PL_STAMPLEN;
+		return f->stamp;
+	}
+	if ((js->depth != 4) || (strcmp(jsonKey(js, 1), "playlist_loop") != 0) || (k < 0) || (k >= PL_WINDOW))	{return NULL;}
+
+	const char *key = jsonKey(js, 3);
+	int title = (strcmp(key, "title") == 0);
+	if (!title && (strcmp(key, "artist") != 0))	{return NULL;}
+
+	if (f->w == NULL) {
+		f->w = windowSlot(f->start);
+		f->w->start = PL_FILLING;
+		f->w->have  = 0;
+		memset(f->w->entry, 0, sizeof(f->w->entry));
+	}
+	*size = PL_TEXT;
+	return title ? f->w->entry[k].title : f->w->entry[k].artist;
+}
+
+void windowValue(jsonscan *js, char *value, int len) {
+	plfetch *f = (plfetch *)js->ctx;
+	int k = jsonIndex(js, 2);
+
+	if ((f->w == NULL) || (js->depth != 4) || (k < 0) || (k >= PL_WINDOW))	{return;}
+	if ((value != f->w->entry[k].title) && (value != f->w->entry[k].artist))	{return;}
+
+	if (!(f->w->have & (1u << k))) {
+		f->w->have |= 1u << k;
+		plStats.entries++;
+		metricsCount(MC_PLAYLIST_ENTRIES, 1);
+	}
+}
+
+int playlistQueue(const char *playerID) {
+	char cmd[CLI_CMDLEN];
+
+	nFetch = 0;
+	for (int i = 0; i < nWant; i++) {
+		if (cliIsJSON()) {
+			plfetch *f = &fetchJSON[nFetch];
+			f->start    = plWant[i];
+			f->w        = NULL;
+			f->stamp[0] = 0;
+			snprintf(cmd, sizeof(cmd), "status %d %d tags:a", plWant[i], PL_WINDOW);
+			rFetch[nFetch] = cliQueueJSON(playerID, cmd, windowField, windowValue, f, CLI_DEADLINE);
+		} else {
+			snprintf(cmd, sizeof(cmd), "%s status %d %d tags:a\n", playerID, plWant[i], PL_WINDOW);
+			rFetch[nFetch] = cliQueue(cmd, fetchAnswer[nFetch], CLI_RXSIZE, CLI_DEADLINE);
+		}
+		if (rFetch[nFetch] < 0)	{break;}
+		fetchStart[nFetch++] = plWant[i];
+		plStats.fetches++;
+	}
+	return nFetch;
+}
+
+// a scanned window is good for the timestamp it came with
+void takeWindow(plfetch *f, int store) {
+	plwindow *w = f->w;
+
+	if (w == NULL)	{return;}
+	f->w = NULL;
+
+	if (!store || (strcmp(f->stamp, plStamp) != 0)) {
+		logMSG(LS_SLIM, LL_DEBUG, "Playlist window %d of another timestamp\n", f->start);
+		w->start = -1;
+		return;
+	}
+	w->start = f->start;
+	w->used  = ++plClock;
+	strcpy(w->stamp, plStamp);
+	logMSG(LS_SLIM, LL_DEBUG, "Playlist window %d: %08x\n", f->start, w->have);
+}
+
+// store: the answers are for the player still selected
+void playlistComplete(int store) {
+	for (int i = 0; i < nFetch; i++) {
+		int done = (cliState(rFetch[i]) == CR_DONE);
+
+		if (cliIsJSON()) {
+			takeWindow(&fetchJSON[i], store && done);
+		} else if (store && done) {
+			storeWindow(fetchStart[i], fetchAnswer[i]);
+		}
+		cliRelease(rFetch[i]);
+		rFetch[i] = -1;
+	}
+	nFetch = 0;
+}
+
+/*
+ * A playlist notification of our player: the windows it can have moved
+ * are dropped, unknown changes drop them all
+ */
+void playlistNotify(char *line) {
+	char sub[16];
+	int  a, b;
+	int  n = sscanf(line, "%*s %*s %15s %d %d", sub, &a, &b);
+
+	if (n < 1)	{return;}
+
+	for (const char **s = samePlaylist; *s != NULL; s++) {
+		if (strcmp(sub, *s) == 0)	{return;}
+	}
+
+	if ((strcmp(sub, "move") == 0) && (n == 3)) {
+		dropWindows((a < b) ? a : b, (a < b) ? b : a);
+	} else if (((strcmp(sub, "delete") == 0) || (strcmp(sub, "deleteitem") == 0) || (strcmp(sub, "zap") == 0)) && (n >= 2)) {
+		dropWindows(a, INT_MAX);
+	} else if ((strcmp(sub, "add") == 0) || (strcmp(sub, "addtracks") == 0) || (strcmp(sub, "append") == 0)) {
+		dropWindows(plTracks, INT_MAX);
+	} else if ((strcmp(sub, "insert") == 0) || (strcmp(sub, "inserttracks") == 0)) {
+		dropWindows(plCurrent + 1, INT_MAX);
+	} else {
+		dropAll();
+	}
+	logMSG(LS_SLIM, LL_DEBUG, "Playlist %s: windows dropped\n", sub);
+}
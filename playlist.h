@@ -0,0 +1,55 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef PLAYLIST_H
+#define PLAYLIST_H 1
+
+#define PL_WINDOW		8			// entries per status <start> <count>
+#define PL_WINDOWS		6			// windows held, the rest of the playlist is not
+#define PL_PREFETCH		4			// entries fetched beyond the shown ones
+#define PL_FETCH		2			// windows asked for in one poll cycle
+#define PL_TEXT			64
+#define PL_STAMPLEN		32
+
+typedef struct {
+	char	title[PL_TEXT];
+	char	artist[PL_TEXT];
+} plentry;
+
+typedef struct {
+	unsigned long	fetches;		// windows asked for
+	unsigned long	entries;		// entries received
+	unsigned long	dropped;		// windows invalidated by a notification
+	unsigned long	flushed;		// all windows, new playlist
+} plstats;
+
+void  playlistReset(void);
+void  playlistStatus(char *answer);
+void  playlistSetStatus(int current, int tracks, const char *stamp);
+void  playlistNotify(char *line);
+void  playlistShow(int first, int count);
+const plentry *playlistEntry(int index);
+int   playlistCurrent(void);
+int   playlistTracks(void);
+int   playlistQueue(const char *playerID);
+void  playlistComplete(int store);
+const plstats *playlistStats(void);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ *	pollsched.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	When to poll the status next. The track end is predicted from the
+ *	duration and the elapsed time of the last answer: in the middle of a
+ *	track the polls are far apart, from POLL_NEAR before the end they
+ *	come every POLL_DENSE until the new track is seen. Stopped, the gap
+ *	doubles from POLL_IDLE. The gaps are a pollpolicy, the POLL_ values
+ *	unless set otherwise. schedNow() asks for a poll at once, after a
+ *	user action or a notification of the player.
+ *
+ *	All times are CLOCK_MONOTONIC ns, except the ms of the track.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include "pollsched.h"
+
+long	schedDueAt = 0;				// next poll, 0 at once
+pollpolicy	pollPolicy = {POLL_SPARSE, POLL_NEAR, POLL_DENSE, POLL_STREAM, POLL_IDLE, POLL_IDLE_MAX, POLL_UNNOTIFIED};
+
+long	idleGap    = POLL_IDLE;	// ms
+long	pollCount  = 0;
+long	schedSince = 0;
+int		unnotified = false;		// no notification tells of a skip or a pause
+
+void setPollPolicy(const pollpolicy *p) {
+	pollPolicy = *p;
+	idleGap    = pollPolicy.idle;
+}
+
+const pollpolicy *getPollPolicy(void) {
+	return &pollPolicy;
+}
+
+void schedReset(long now) {
+	__atomic_store_n(&schedDueAt, 0, __ATOMIC_RELAXED);
+	idleGap    = pollPolicy.idle;
+	pollCount  = 0;
+	schedSince = now;
+}
+
+void schedUnnotified(int on) {
+	unnotified = on;
+}
+
+// gap to the next poll after an answer, ms
+long policyGap(int playing, long elapsed, long duration) {
+	if (!playing) {
+		long gap = idleGap;
+		idleGap  = (idleGap * 2 < pollPolicy.idleMax) ? idleGap * 2 : pollPolicy.idleMax;
+		return gap;
+	}
+
+	idleGap = pollPolicy.idle;
+	if (duration <= 0)	{return pollPolicy.stream;}
+
+	long left = duration - elapsed;
+	if (left <= pollPolicy.near)					{return pollPolicy.dense;}
+	if (left - pollPolicy.near < pollPolicy.sparse)	{return left - pollPolicy.near;}
+	return pollPolicy.sparse;
+}
+
+// a change from another client shows at the next poll only when nothing notifies us
+long nextGap(int playing, long elapsed, long duration) {
+	long gap = policyGap(playing, elapsed, duration);
+
+	return (unnotified && (gap > pollPolicy.unnotified)) ? pollPolicy.unnotified : gap;
+}
+
+// a status answer is in, returns when the next poll is due
+long schedPolled(long now, int playing, long elapsed, long duration) {
+	long due = now + nextGap(playing, elapsed, duration) * 1000000L;
+
+	pollCount++;
+	__atomic_store_n(&schedDueAt, due, __ATOMIC_RELAXED);
+	return due;
+}
+
+void schedNow(void) {
+	__atomic_store_n(&schedDueAt, 0, __ATOMIC_RELAXED);
+	idleGap = pollPolicy.idle;
+}
+
+void schedRetry(long now) {
+	__atomic_store_n(&schedDueAt, now + POLL_RETRY * 1000000L, __ATOMIC_RELAXED);
+}
+
+int schedDue(long now) {
+	return now >= __atomic_load_n(&schedDueAt, __ATOMIC_RELAXED);
+}
+
+long schedNext(void) {
+	return __atomic_load_n(&schedDueAt, __ATOMIC_RELAXED);
+}
+
+long schedPolls(void) {
+	return pollCount;
+}
+
+double schedPerHour(long now) {
+	double hours = (now - schedSince) / 3.6e12;
+	return (hours > 0) ? pollCount / hours : 0.0;
+}
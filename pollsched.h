@@ -0,0 +1,56 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef POLLSCHED_H
+#define POLLSCHED_H 1
+
+#define POLL_SPARSE		15000		// ms, longest gap in the middle of a track
+#define POLL_NEAR		5000		// ms before the predicted end the polls get dense
+#define POLL_DENSE		500			// ms between the polls around a track change
+#define POLL_STREAM		5000		// ms, playing without a duration (radio)
+#define POLL_IDLE		2000		// ms, first gap when stopped, doubles up to
+#define POLL_IDLE_MAX	30000
+#define POLL_RETRY		1000		// ms after a failed poll
+#define POLL_UNNOTIFIED	1000		// ms, longest gap without notifications (JSON-RPC)
+
+// the gaps above, ms; a config file can change them while running
+typedef struct {
+	long	sparse;
+	long	near;
+	long	dense;
+	long	stream;
+	long	idle;
+	long	idleMax;
+	long	unnotified;
+} pollpolicy;
+
+void   schedReset(long now);
+long   schedPolled(long now, int playing, long elapsed, long duration);
+void   schedNow(void);
+void   schedUnnotified(int on);
+void   schedRetry(long now);
+int    schedDue(long now);
+long   schedNext(void);
+long   schedPolls(void);
+double schedPerHour(long now);
+void   setPollPolicy(const pollpolicy *policy);
+const pollpolicy *getPollPolicy(void);
+
+#endif
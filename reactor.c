@@ -0,0 +1,330 @@
+/*
+ *	reactor.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Single thread event loop (-r): the CLI socket, the ALSA mixer poll
+ *	descriptors, a timerfd for the poll and request deadlines and a
+ *	signalfd are all waited for in one epoll_wait(). No busy polling, no
+ *	shared state between threads. A reconnect does not block the loop
+ *	either: the discovery socket and the connect are watched in the same
+ *	set (connectStep()), the backoff is a deadline of the timerfd.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "common.h"
+#include "logger.h"
+#include "cliengine.h"
+#include "sliminfo.h"
+#include "pollsched.h"
+#include "mixermon.h"
+#include "reactor.h"
+
+#define EV_CLI		0
+#define EV_TIMER	1
+#define EV_SIGNAL	2
+#define EV_CONNECT	3		// discovery or connect of a reconnect
+#define EV_MIXER	4		// EV_MIXER + index of the mixer descriptor
+
+int		epFD     = -1;
+int		timerFD  = -1;
+int		signalFD = -1;
+int		cliReg   = -1;		// CLI descriptor registered in epoll
+int		cliRegOut = false;
+int		cliRegConn = 0;		// its connection, the number can be taken again by a reconnect
+int		connReg  = -1;		// reconnect descriptor registered in epoll
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long reactorNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+int watchFD(int fd, uint32_t events, uint32_t id) {
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = events;
+	ev.data.u32 = id;
+	return epoll_ctl(epFD, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * The CLI descriptor changes on every reconnect, and we only want
+ * EPOLLOUT while a short write is pending.
+ */
+void syncCliFD(void) {
+	struct epoll_event ev;
+	int fd   = cliFD();
+	int out  = cliWantWrite();
+	int conn = cliConnection();
+
+	if ((fd == cliReg) && (conn == cliRegConn) && (out == cliRegOut))	{return;}
+
+	if ((cliReg >= 0) && (fd == cliReg) && (conn == cliRegConn)) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events   = EPOLLIN | (out ? EPOLLOUT : 0);
+		ev.data.u32 = EV_CLI;
+		epoll_ctl(epFD, EPOLL_CTL_MOD, fd, &ev);
+	} else {
+		// a closed descriptor left the epoll set by itself, the same number reconnected too
+		if (fd >= 0) {
+			watchFD(fd, EPOLLIN | (out ? EPOLLOUT : 0), EV_CLI);
+		}
+	}
+	cliReg     = fd;
+	cliRegOut  = out;
+	cliRegConn = conn;
+}
+
+/*
+ * A step of the reconnect, its descriptor watched under id in between. It
+ * leaves the set before the step: a connect that is through goes on as
+ * the CLI descriptor. The broker loop takes it too.
+ */
+int reconnectStep(int ep, uint32_t id, long now) {
+	struct epoll_event ev;
+
+	if ((connReg >= 0) && (connReg == connectFD())) {
+		epoll_ctl(ep, EPOLL_CTL_DEL, connReg, NULL);
+	}
+	int rc = connectStep(now);
+
+	if ((connReg = connectFD()) >= 0) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events   = connectWantWrite() ? EPOLLOUT : EPOLLIN;
+		ev.data.u32 = id;
+		epoll_ctl(ep, EPOLL_CTL_ADD, connReg, &ev);
+	}
+	return rc;
+}
+
+void armTimer(long when) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (when > 0) {
+		its.it_value.tv_sec  = when / 1000000000L;
+		its.it_value.tv_nsec = when % 1000000000L;
+	}
+	timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * Must run before the first thread is started: threads inherit the mask,
+ * and a thread with the signals unblocked would get the default action.
+ */
+void reactorSignals(sigset_t *mask) {
+	sigemptyset(mask);
+	sigaddset(mask, SIGINT);
+	sigaddset(mask, SIGTERM);
+	sigaddset(mask, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, mask, NULL);
+}
+
+int openReactor(struct pollfd *mixFDs, int *mixCount) {
+	sigset_t mask;
+
+	reactorSignals(&mask);
+
+	if ((epFD     = epoll_create1(EPOLL_CLOEXEC)) < 0)								{return -1;}
+	if ((signalFD = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)			{return -1;}
+	if ((timerFD  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)	{return -1;}
+
+	watchFD(signalFD, EPOLLIN, EV_SIGNAL);
+	watchFD(timerFD,  EPOLLIN, EV_TIMER);
+
+	// poll and epoll event bits are the same on Linux
+	*mixCount = mimoPollFDs(mixFDs, MAXMIXERFDS);
+	for (int i = 0; i < *mixCount; i++) {
+		watchFD(mixFDs[i].fd, mixFDs[i].events, EV_MIXER + i);
+	}
+
+	return 0;
+}
+
+void closeReactor(void) {
+	if (timerFD  >= 0)	{close(timerFD);}
+	if (signalFD >= 0)	{close(signalFD);}
+	if (epFD     >= 0)	{close(epFD);}
+	timerFD = signalFD = epFD = cliReg = connReg = -1;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int runReactor(showvolume_t onVolume, showtags_t onTags) {
+	struct epoll_event events[16];
+	struct pollfd mixFDs[MAXMIXERFDS];
+	int  mixCount   = 0;
+	int  running    = true;
+	int  inCycle    = false;
+	int  backoff    = 1;
+	long lastVolume = 0;
+	long nextPoll   = reactorNow();
+
+	if (openReactor(mixFDs, &mixCount) < 0) {
+		logERR(LS_MAIN, "Reactor setup failed: %s\n", strerror(errno));
+		closeReactor();
+		return -1;
+	}
+	logMSG(LS_MAIN, LL_INFO, "Reactor running, %d mixer descriptor(s)\n", mixCount);
+
+	while (running) {
+		syncCliFD();
+		if (inCycle) {
+			armTimer(cliNextDeadline());
+		} else {
+			// the next refresh, or an earlier poll; 0 would disarm
+			long wake = (cliConnected() && (schedNext() < nextPoll)) ? schedNext() : nextPoll;
+			if (connectPending())	{wake = connectDeadline();}
+			armTimer((wake > 0) ? wake : 1);
+		}
+
+		int n = epoll_wait(epFD, events, 16, -1);
+		if ((n < 0) && (errno != EINTR)) {
+			logERR(LS_MAIN, "epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+
+		int mixerEvent = false;
+		for (int i = 0; i < mixCount; i++) {
+			mixFDs[i].revents = 0;
+		}
+
+		for (int i = 0; i < n; i++) {
+			uint32_t id = events[i].data.u32;
+			uint64_t expirations;
+			struct signalfd_siginfo si;
+
+			if (id == EV_SIGNAL) {
+				if (read(signalFD, &si, sizeof(si)) == sizeof(si)) {
+					logMSG(LS_MAIN, LL_INFO, "Signal %d, leaving\n", si.ssi_signo);
+					running = false;
+				}
+			} else if (id == EV_TIMER) {
+				if (read(timerFD, &expirations, sizeof(expirations)) < 0) {}
+			} else if (id == EV_CONNECT) {
+				// connectStep() below
+			} else if (id == EV_CLI) {
+				if (events[i].events & EPOLLOUT) {
+					cliFlush();
+				}
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					cliOnReadable();
+				}
+			} else if (id - EV_MIXER < (uint32_t)mixCount) {
+				mixFDs[id - EV_MIXER].revents = events[i].events;
+				mixerEvent = true;
+			}
+		}
+
+		if (mixerEvent) {
+			mimoHandleEvents(mixFDs, mixCount);
+		}
+		if (mimoSwitch()) {
+			// the old descriptors left the epoll set when they were closed
+			mixCount = mimoPollFDs(mixFDs, MAXMIXERFDS);
+			for (int i = 0; i < mixCount; i++) {
+				watchFD(mixFDs[i].fd, mixFDs[i].events, EV_MIXER + i);
+			}
+			logMSG(LS_MAIN, LL_INFO, "Mixer switched, %d mixer descriptor(s)\n", mixCount);
+		}
+
+		long now = reactorNow();
+		cliExpire(now);
+
+		if (inCycle && (cliPending() == 0)) {
+			inCycle = false;
+			switch (pollComplete()) {
+				case PS_DONE:
+					onTags(lastVolume);
+					nextPoll = now + getRefreshInterval() * 1000000L;
+					break;
+				case PS_AGAIN:
+					nextPoll = now;
+					break;
+				default:
+					schedRetry(now);
+					nextPoll = now + getRefreshInterval() * 1000000L;
+					break;
+			}
+		}
+
+		if (!inCycle && cliConnected() && isPlayerSwitched()) {
+			nextPoll = now;
+		}
+
+		int reconnect = 0;
+		if (!inCycle && !cliConnected() && !connectPending() && (now >= nextPoll)) {
+			logMSG(LS_SLIM, LL_INFO, "Reconnecting to server\n");
+			reconnect = connectBegin(now);
+		}
+		if (connectPending()) {
+			reconnect = reconnectStep(epFD, EV_CONNECT, now);
+		}
+		if (reconnect > 0) {
+			backoff  = 1;
+			nextPoll = now;
+			schedNow();
+		} else if (reconnect < 0) {
+			nextPoll = now + backoff * 1000000000L;
+			backoff  = (backoff < 30) ? backoff * 2 : 30;
+		}
+
+		if (!inCycle && cliConnected() && !connectPending() && ((now >= nextPoll) || schedDue(now))) {
+			if (!schedDue(now)) {
+				// no poll due: the clock of the track ticks on
+				tickTags(now);
+				onTags(lastVolume);
+				nextPoll = now + getRefreshInterval() * 1000000L;
+			} else {
+				pollQueue();
+				cliFlush();
+				if (!(inCycle = (cliPending() > 0))) {
+					nextPoll = now + getRefreshInterval() * 1000000L;
+				}
+			}
+		}
+
+		long volume = getActVolume();
+		if (volume != lastVolume) {
+			onVolume(volume);
+			lastVolume = volume;
+		}
+	}
+
+	closeReactor();
+	closeMimo();
+	return 0;
+}
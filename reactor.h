@@ -0,0 +1,36 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H 1
+
+#define MAXMIXERFDS		8
+
+typedef void (*showvolume_t)(long volume);
+typedef void (*showtags_t)(long volume);
+
+#include <signal.h>
+#include <stdint.h>
+
+void  reactorSignals(sigset_t *mask);
+int   reconnectStep(int ep, uint32_t id, long now);
+int   runReactor(showvolume_t onVolume, showtags_t onTags);
+
+#endif
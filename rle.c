@@ -0,0 +1,77 @@
+/*
+ *	rle.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	PackBits run length coding, used by the glyph atlas and the frame
+ *	stream. No dependencies, the tools link it on its own.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <string.h>
+
+#include "rle.h"
+
+/*******************************************************************************
+ * n >= 0 copy n + 1 bytes, n < 0 repeat the next byte 1 - n times.
+ * The output needs len + (len + 127) / 128 bytes at most.
+ ******************************************************************************/
+int packBits(const uint8_t *in, int len, uint8_t *out) {
+	uint8_t *o = out;
+	int i = 0;
+
+	while (i < len) {
+		int run = 1;
+		while ((i + run < len) && (run < 128) && (in[i + run] == in[i]))	{run++;}
+
+		if (run > 1) {
+			*o++ = (uint8_t)(1 - run);
+			*o++ = in[i];
+			i += run;
+		} else {
+			int lit = 1;
+			while ((i + lit < len) && (lit < 128) &&
+				   !((i + lit + 1 < len) && (in[i + lit] == in[i + lit + 1]))) {
+				lit++;
+			}
+			*o++ = (uint8_t)(lit - 1);
+			memcpy(o, in + i, lit);
+			o += lit;
+			i += lit;
+		}
+	}
+	return o - out;
+}
+
+int unpackBits(const uint8_t *in, int len, uint8_t *out, int outSize) {
+	const uint8_t *end = in + len;
+	int n = 0;
+
+	while (in < end) {
+		int8_t c = (int8_t)*in++;
+		if (c >= 0) {
+			if ((in + c + 1 > end) || (n + c + 1 > outSize))	{return -1;}
+			memcpy(out + n, in, c + 1);
+			in += c + 1;
+			n  += c + 1;
+		} else if (c != -128) {
+			if ((in >= end) || (n + 1 - c > outSize))			{return -1;}
+			memset(out + n, *in++, 1 - c);
+			n += 1 - c;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,31 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef RLE_H
+#define RLE_H 1
+
+#include <stdint.h>
+
+#define PACKBITS_MAX(len)	((len) + ((len) + 127) / 128)
+
+int   packBits(const uint8_t *in, int len, uint8_t *out);
+int   unpackBits(const uint8_t *in, int len, uint8_t *out, int outSize);
+
+#endif
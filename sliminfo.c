@@ -3,7 +3,7 @@
  *
  *	(c) 2015 László TÓTH
  *
- *	Todo:	Reconect to server
+ *	Todo:
  *
  *	This program is free software: you can redistribute it and/or modify
  *	it under the terms of the GNU General Public License as published by
@@ -34,116 +34,231 @@
 #include <pthread.h>
 
 #include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "cliengine.h"
+#include "discovery.h"
+#include "players.h"
 #include "tagUtils.h"
 #include "sliminfo.h"
+#include "trace.h"
+#include "pollsched.h"
+#include "playlist.h"
 
 int   LMSPort;
 char *LMSHost  = NULL;
+const char *serverSelector = NULL;
+const char *serverHost     = NULL;	// the selector without http://
+int         useJSON        = false;	// http://: JSON-RPC instead of the CLI
 
 char playerID[BSIZE] = {0};
 char query[BSIZE]    = {0};
-char stb[BSIZE];
+char volQuery[BSIZE] = {0};
 
-int sockFD = 0;
 struct sockaddr_in  serv_addr;
 
+char *serverField(jsonscan *js, int *size);
+void  serverValue(jsonscan *js, char *value, int len);
+
+long        playerVolume = -1;
+int         playerCount  = 0;
+char        serverVersion[MAXTAG_DATA] = {0};
+int         autoFollow     = false;
+int         directoryStale = true;
+int         viaBroker      = false;		// the server is an lmsmonitor -B
+int         playerSwitched = false;
+long        refreshInterval = REFRESH_INTERVAL;	// ms
+
+// the clock of the last status answer, the time runs on between polls
+int         clockPlaying  = false;
+long        clockElapsed  = 0;		// ms
+long        clockDuration = 0;		// ms, 0 unknown
+long        clockStamp    = 0;		// ns
+
 tag 	    tagStore[MAXTAG_TYPES];
 int         refreshRequ;
 pthread_t   sliminfoThread;
 
-int discoverPlayer(char *playerName) {
-	char qBuffer[BSIZE];
-	char aBuffer[BSIZE];
-	int  bytes;
+/*******************************************************************************
+ * Player selection through the player directory
+ ******************************************************************************/
+void buildQueries(void) {
+	// a broker answers with the changed fields only
+	sprintf(query, "%s status - 1 tags:aAlCIT%s\n", playerID, viaBroker ? " delta:1" : ""); // alrTy
+	sprintf(volQuery, "%s mixer volume ?\n", playerID);
+}
+
+void selectPlayer(const char *id) {
+	strncpy(playerID, id, PLAYER_IDLEN);
+	buildQueries();
+	playlistReset();
+	playerSwitched = true;
+	schedNow();
+	traceRecord(TR_PLAYER, playerID, strlen(playerID));
+}
 
-	// I've not found this feature in the CLI spec,
-	//	but if you send the player name, the server answer with the player ID.
-	if (playerName != NULL) {
-		if(strlen(playerName) > (BSIZE/3))					 { abort("ERROR too long player name!"); }
+int isPlayerSwitched(void) {
+	return playerSwitched;
+}
 
-		encode(playerName, aBuffer);
-		sprintf(qBuffer, "%s\n", aBuffer);
-		if (write(sockFD, qBuffer, strlen(qBuffer)) < 0)	 { abort("ERROR writing to socket!"); }
-		if ((bytes = read(sockFD, aBuffer, BSIZE-1)) < 0)	 { abort("ERROR reading from socket!"); }
-		aBuffer[bytes] = 0;
+void setAutoFollow(int follow) {
+	autoFollow = follow;
+}
 
-		if (strncmp(qBuffer, aBuffer, strlen(aBuffer)) == 0) { abort("Player not found!"); }
-		decode(aBuffer, playerID);
+int loadPlayers(void) {
+	char answer[CLI_RXSIZE];
 
-	} else {
-		return -1;
+	if (useJSON) {
+		stagePlayers();
+		if (cliRequestJSON("", SERVER_JSON, serverField, serverValue, NULL, CLI_DEADLINE) < 0)	{return -1;}
+		directoryStale = false;
+		return commitPlayers();
 	}
 
-	sprintf (stb, "PlayerName: %s, PlayerID: %s\n", playerName, playerID);
-	putMSG  (stb, LL_INFO);
-
-	return 0;
+	if (cliRequest(playersQuery(), answer, sizeof(answer), CLI_DEADLINE) < 0)	{return -1;}
+	directoryStale = false;
+	return parsePlayers(answer);
 }
 
-int setStaticServer(void) {
-	LMSPort = 9090;
-	LMSHost = NULL;		// autodiscovery
-//	LMSHost = (char *)"127.0.0.1";
-//	LMSHost = (char *)"192.168.1.252";
-	return 0;
-}
 /*
- * LMS server discover
- *
- * code from: https://code.google.com/p/squeezelite/source/browse/slimproto.c
- *
+ * Unsolicited lines of the CLI connection (subscribe client,playlist)
  */
-in_addr_t getServerAddress(void) {
-	#define PORT 3483
+void slimNotify(char *line, int len) {
+	lmsplayer *player;
+
+	// a player list nobody waits for (late answer, or replay) is still good
+	if (strncmp(line, "players ", 8) == 0) {
+		parsePlayers(line);
+		directoryStale = false;
+		return;
+	}
 
-	struct sockaddr_in d;
-	struct sockaddr_in s;
-	char   *buf;
-	struct pollfd pollinfo;
+	switch (playerNotification(line, &player)) {
+		case PN_STALE:
+			directoryStale = true;
+			break;
 
-	if (LMSHost != NULL) {
-		// Static server address
-		memset(&s, 0, sizeof(s));
-		inet_pton(AF_INET, LMSHost, &(s.sin_addr));
+		case PN_STARTED:
+			if (autoFollow && (strcmp(player->id, playerID) != 0)) {
+				logMSG(LS_SLIM, LL_INFO, "Following player %s (%s)\n", player->name, player->id);
+				selectPlayer(player->id);
+			}
+			break;
 
-	} else {
-		// Discover server address
-		int disc_sock = socket(AF_INET, SOCK_DGRAM, 0);
+		default:
+			break;
+	}
 
-		socklen_t enable = 1;
-		setsockopt(disc_sock, SOL_SOCKET, SO_BROADCAST, (const void *)&enable, sizeof(enable));
+	// new song, pause or stop of ours: poll now, not when the track should end
+	if ((player != NULL) && (strcmp(player->id, playerID) == 0)) {
+		playlistNotify(line);
+		schedNow();
+	}
+}
 
-		buf = (char *)"e";
+int discoverPlayer(char *playerName) {
+	lmsplayer *player;
 
-		memset(&d, 0, sizeof(d));
-		d.sin_family = AF_INET;
-		d.sin_port = htons(PORT);
-		d.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+	if ((playerName != NULL) && (strlen(playerName) >= PLAYER_NAMELEN))	{ abort("ERROR too long player name!"); }
 
-		pollinfo.fd = disc_sock;
-		pollinfo.events = POLLIN;
+	while (true) {
+		if (loadPlayers() < 0)	{ abort("ERROR reading player list!"); }
 
-		do {
-			putMSG ("Sending discovery...\n", LL_INFO);
-			memset(&s, 0, sizeof(s));
+		if (playerName != NULL) {
+			if ((player = findPlayerByName(playerName)) == NULL)		{ abort("Player not found!"); }
+			break;
+		}
 
-			if (sendto(disc_sock, buf, 1, 0, (struct sockaddr *)&d, sizeof(d)) < 0) {
-				putMSG ("Error sending disovery\n", LL_INFO);
-			}
+		// no name given: follow whichever player is active
+		autoFollow = true;
+		if ((player = activePlayer()) != NULL)	{break;}
+
+		logMSG(LS_SLIM, LL_INFO, "No player connected, waiting...\n");
+		sleep(2);
+	}
 
-			if (poll(&pollinfo, 1, 5000) == 1) {
-				char readbuf[10];
-				socklen_t slen = sizeof(s);
-				recvfrom(disc_sock, readbuf, 10, 0, (struct sockaddr *)&s, &slen);
-				sprintf(stb, "Got response from: %s:%d\n", inet_ntoa(s.sin_addr), ntohs(s.sin_port));
-				putMSG (stb, LL_INFO);
+	selectPlayer(player->id);
+	logMSG(LS_SLIM, LL_INFO, "PlayerName: %s, PlayerID: %s%s\n", player->name, playerID, autoFollow ? " (auto-follow)" : "");
+
+	return 0;
+}
+
+/*
+ * -s selector: an IP address[:port] is a static server, anything else is
+ * the name or UUID of the server to pick from the discovery answers.
+ * With http:// in front the server is asked over JSON-RPC on its web port.
+ */
+void setServerSelector(const char *selector) {
+	serverSelector = selector;
+}
+
+// another server while running: the pollers reconnect to it
+void switchServer(const char *selector) {
+	serverSelector = selector;
+	cliClose();
+}
+
+int setStaticServer(void) {
+	static char host[INET_ADDRSTRLEN];
+	struct in_addr addr;
+
+	serverHost = serverSelector;
+	useJSON    = (serverHost != NULL) && (strncmp(serverHost, RPC_SCHEME, strlen(RPC_SCHEME)) == 0);
+	if (useJSON) {
+		serverHost += strlen(RPC_SCHEME);
+		if (*serverHost == 0)	{serverHost = NULL;}
+	}
+	cliSetJSON(useJSON);
+	schedUnnotified(useJSON);
+
+	LMSPort = useJSON ? DEFAULT_JSONPORT : DEFAULT_CLIPORT;
+	LMSHost = NULL;		// autodiscovery
+
+	if (serverHost != NULL) {
+		const char *port = strchr(serverHost, ':');
+		int len = (port == NULL) ? (int)strlen(serverHost) : port - serverHost;
+
+		if (len < INET_ADDRSTRLEN) {
+			memcpy(host, serverHost, len);
+			host[len] = 0;
+			if (inet_pton(AF_INET, host, &addr) == 1) {
+				LMSHost = host;
+				if (port != NULL) {LMSPort = atoi(port + 1);}
 			}
-		} while (s.sin_addr.s_addr == 0);
+		}
+	}
+	return 0;
+}
+
+/*
+ * The server discovery found, on the port of the wire we use
+ */
+in_addr_t useServer(const lmsserver *server) {
+	if (useJSON) {
+		LMSPort = (server->jsonPort > 0) ? server->jsonPort : DEFAULT_JSONPORT;
+	} else {
+		LMSPort = server->cliPort;
+	}
+	logMSG(LS_SLIM, LL_INFO, "Using server %s (%s) %s port %d\n", server->name, server->uuid, useJSON ? "JSON-RPC" : "CLI", LMSPort);
+
+	return server->addr;
+}
 
-		close(disc_sock);
+/*
+ * LMS server discover - static address, or the TLV discovery
+ */
+in_addr_t getServerAddress(void) {
+	struct in_addr addr;
+	lmsserver server;
+
+	if (LMSHost != NULL) {
+		// Static server address
+		inet_pton(AF_INET, LMSHost, &addr);
+		return addr.s_addr;
 	}
 
-	return s.sin_addr.s_addr;
+	findServer(serverHost, &server);
+	return useServer(&server);
 }
 
 /*******************************************************************************
@@ -170,6 +285,18 @@ void refreshed(void) {
 /*******************************************************************************
  *
  ******************************************************************************/
+void serverConnected(void) {
+	static int connects = 0;
+
+	metricsCount(MC_CONNECTS, 1);
+	if (connects++ > 0) {
+		metricsCount(MC_RECONNECTS, 1);
+	}
+	directoryStale = true;
+	viaBroker      = false;
+	buildQueries();
+}
+
 int connectServer(void) {
 	int sfd;
 
@@ -177,10 +304,6 @@ int connectServer(void) {
 		abort("Failed to find LMS server!");
 	}
 
-	if ((sfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		abort("Failed to opening socket!");
-	}
-
 	memset(&serv_addr, 0, sizeof(serv_addr));
 
 //	memcpy(&serv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
@@ -189,22 +312,176 @@ int connectServer(void) {
 	serv_addr.sin_addr.s_addr = getServerAddress();
 	serv_addr.sin_port 		  = htons(LMSPort);
 
-	if (connect(sfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-		fprintf(stderr, "No such host: %s\n", inet_ntoa(serv_addr.sin_addr));
-		close(sfd);
+	if ((sfd = cliConnect(serv_addr.sin_addr.s_addr, LMSPort, CLI_DEADLINE)) < 0) {
+		logERR(LS_SLIM, "No such host: %s\n", inet_ntoa(serv_addr.sin_addr));
 		return -1;
 	}
+	serverConnected();
+
+	// player add/remove and playback start notifications for the directory
+	if (useJSON) {
+		logMSG(LS_SLIM, LL_INFO, "JSON-RPC: no notifications, the player list comes with every poll\n");
+	} else if (cliRequest(SUBSCRIBE_CLI, NULL, 0, CLI_DEADLINE) < 0) {
+		logMSG(LS_SLIM, LL_INFO, "Subscribe failed, no player notifications\n");
+	}
 
 	return sfd;
 }
 
+/*******************************************************************************
+ * connectServer() in steps, for the event loops: the discovery, the connect
+ * and the subscribe each wait on a descriptor of the loop, not in a call
+ ******************************************************************************/
+typedef enum {SC_IDLE, SC_DISCOVER, SC_CONNECT, SC_SUBSCRIBE} connstate_t;
+
+connstate_t connState    = SC_IDLE;
+int         discSock     = -1;
+int         discWindow   = DISC_WINDOW;	// ms, grows as in findServer()
+long        connDeadline = 0;			// ns, end of the discovery window or the connect
+int         rSubscribe   = -1;
+
+int discoveryStart(long now) {
+	logMSG(LS_SLIM, LL_INFO, "Sending discovery...\n");
+	if ((discSock = discoverySend()) < 0) {
+		connState = SC_IDLE;
+		return -1;
+	}
+	connState    = SC_DISCOVER;
+	connDeadline = now + discWindow * 1000000L;
+	return 0;
+}
+
+int connectTo(in_addr_t addr, long now) {
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sin_family	  = AF_INET;
+	serv_addr.sin_addr.s_addr = addr;
+	serv_addr.sin_port 		  = htons(LMSPort);
+
+	if (cliConnectStart(addr, LMSPort) < 0) {
+		logERR(LS_SLIM, "No such host: %s\n", inet_ntoa(serv_addr.sin_addr));
+		connState = SC_IDLE;
+		return -1;
+	}
+	connState    = SC_CONNECT;
+	connDeadline = now + CLI_DEADLINE * 1000000L;
+	return 0;
+}
+
+/*
+ * 0 under way, -1 failed at once
+ */
+int connectBegin(long now) {
+	struct in_addr addr;
+
+	setStaticServer();
+	if (LMSHost == NULL) {
+		discWindow = DISC_WINDOW;
+		return discoveryStart(now);
+	}
+	inet_pton(AF_INET, LMSHost, &addr);
+	return connectTo(addr.s_addr, now);
+}
+
+int connectPending(void) {
+	return (connState != SC_IDLE);
+}
+
+// to watch: readable while discovering, writable while connecting
+int connectFD(void) {
+	if (connState == SC_DISCOVER)	{return discSock;}
+	if (connState == SC_CONNECT)	{return cliConnectFD();}
+	return -1;
+}
+
+int connectWantWrite(void) {
+	return (connState == SC_CONNECT);
+}
+
+long connectDeadline(void) {
+	if (connState == SC_SUBSCRIBE)	{return cliNextDeadline();}
+	return (connState == SC_IDLE) ? 0 : connDeadline;
+}
+
+/*
+ * On every wake up while connectPending(): 1 connected, 0 still under way,
+ * -1 failed - the loop tries again later
+ */
+int connectStep(long now) {
+	lmsserver server;
+
+	switch (connState) {
+		case SC_DISCOVER:
+			while (discoveryAnswer(discSock, &server) == 0) {
+				if (serverMatches(serverHost, &server)) {
+					close(discSock);
+					discSock = -1;
+					return connectTo(useServer(&server), now);
+				}
+			}
+			if (now >= connDeadline) {
+				// nobody answered in the window: ask again with a longer one
+				close(discSock);
+				discSock   = -1;
+				discWindow = (discWindow * 2 > DISC_MAXWINDOW) ? DISC_MAXWINDOW : discWindow * 2;
+				return discoveryStart(now);
+			}
+			return 0;
+
+		case SC_CONNECT:
+			switch (cliConnectDone()) {
+				case 0:
+					if (now < connDeadline)	{return 0;}
+					logMSG(LS_SLIM, LL_INFO, "Connect to %s:%d failed: timeout\n", inet_ntoa(serv_addr.sin_addr), LMSPort);
+					cliClose();
+					// fall through
+				case -1:
+					logERR(LS_SLIM, "No such host: %s\n", inet_ntoa(serv_addr.sin_addr));
+					connState = SC_IDLE;
+					return -1;
+			}
+			serverConnected();
+
+			if (useJSON) {
+				logMSG(LS_SLIM, LL_INFO, "JSON-RPC: no notifications, the player list comes with every poll\n");
+				connState = SC_IDLE;
+				return 1;
+			}
+			rSubscribe = cliQueue(SUBSCRIBE_CLI, NULL, 0, CLI_DEADLINE);
+			cliFlush();
+			connState  = SC_SUBSCRIBE;
+			// fall through
+
+		case SC_SUBSCRIBE: {
+			clistate_t st = cliState(rSubscribe);
+			if ((st == CR_QUEUED) || (st == CR_SENT))	{return 0;}
+
+			cliRelease(rSubscribe);
+			rSubscribe = -1;
+			connState  = SC_IDLE;
+			if (cliFD() < 0)	{return -1;}		// a timeout drops the connection
+
+			if (st != CR_DONE) {
+				logMSG(LS_SLIM, LL_INFO, "Subscribe failed, no player notifications\n");
+			}
+			return 1;
+		}
+
+		default:
+			return -1;
+	}
+}
+
 /*******************************************************************************
  *
  ******************************************************************************/
 void closeSliminfo(void) {
-	if (sockFD > 0) {
-		close(sockFD);
+	long now = metricsNow();
+
+	if (schedPolls() > 0) {
+		logMSG(LS_SLIM, LL_INFO, "Polls: %ld, %.0f per hour against %d at a fixed 1 Hz\n",
+			schedPolls(), schedPerHour(now), 3600);
 	}
+	cliClose();
 
 	for(int i = 0; i < MAXTAG_TYPES; i++) {
 		if(tagStore[i].tagData != NULL) {
@@ -242,38 +519,428 @@ tag *initTagStore(void) {
 	return tagStore;
 }
 
-void *serverPolling(void *x_voidptr){
-	char buffer[BSIZE];
+/*******************************************************************************
+ *
+ ******************************************************************************/
+/*
+ * A delta answer of the broker lists the changed fields only; a field
+ * not in it keeps its value unless it is named in gone:
+ */
+int isGone(const char *gone, const char *name) {
+	int len = strlen(name);
+
+	for (const char *g = gone; (g = strstr(g, name)) != NULL; g += len) {
+		if (((g == gone) || (g[-1] == ',')) && ((g[len] == ',') || (g[len] == 0)))	{return true;}
+	}
+	return false;
+}
+
+void parseStatus(char *buffer) {
 	char tagData[BSIZE];
-	int  rbytes;
+	char gone[BSIZE] = {0};
+	int  delta = (getTag("delta", buffer, tagData, BSIZE) != NULL);
 
-	while (true) {
-		if (!isRefreshed()) {
-			if (write(sockFD, query, strlen(query)) < 0)		{ abort("ERROR writing to socket"); }
-			if ((rbytes = read(sockFD, buffer, BSIZE-1)) < 0)	{ abort("ERROR reading from socket"); }
-			buffer[rbytes] = 0;
-
-			for(int i = 0; i < MAXTAG_TYPES; i++) {
-				if ((getTag((char *)tagStore[i].name, buffer, tagData, BSIZE)) != NULL) {
-					if (strcmp(tagData, tagStore[i].tagData) != 0) {
-						strncpy(tagStore[i].tagData, tagData, MAXTAG_DATA);
-						tagStore[i].changed = true;
-					}
-					tagStore[i].valid = true;
-				} else {
-					tagStore[i].valid = false;
-				}
+	if (delta) {
+		getTag("gone", buffer, gone, BSIZE);
+	}
+
+	for(int i = 0; i < MAXTAG_TYPES; i++) {
+		const char *raw;
+		int  len;
+
+		if ((raw = findTag(tagStore[i].name, buffer, &len)) != NULL) {
+			uint64_t h = tagHash(raw, len);
+			if (tagStore[i].valid && (h == tagStore[i].rawHash)) {
+				decodeSkipped();
+				continue;
+			}
+			if (decodeCached(raw, len, h, tagData, BSIZE) < 0)	{continue;}
+
+			if (strcmp(tagData, tagStore[i].tagData) != 0) {
+				strncpy(tagStore[i].tagData, tagData, MAXTAG_DATA);
+				tagStore[i].changed = true;
 			}
+			tagStore[i].valid   = true;
+			tagStore[i].rawHash = h;
+		} else if (!delta || isGone(gone, tagStore[i].name)) {
+			tagStore[i].valid   = false;
+			tagStore[i].rawHash = 0;
+		}
+	}
+}
+
+void parseMixer(char *buffer) {
+	char *vol = strrchr(buffer, ' ');
+	if (vol != NULL) {
+		playerVolume = strtol(vol + 1, NULL, 10);
+	}
+}
+
+void setServerVersion(const char *version) {
+	if (strcmp(version, serverVersion) != 0) {
+		int len = strnlen(version, sizeof(serverVersion) - 1);
+		memcpy(serverVersion, version, len);
+		serverVersion[len] = 0;
+		logMSG(LS_SLIM, LL_INFO, "Server version: %s\n", serverVersion);
+	}
+}
+
+void setPlayerCount(int count) {
+	if (count != playerCount) {
+		logMSG(LS_SLIM, LL_INFO, "Player count: %d\n", count);
+		playerCount = count;
+	}
+}
+
+void parseServerStatus(char *buffer) {
+	char tagData[BSIZE];
+
+	if (getTag("version", buffer, tagData, BSIZE) != NULL) {
+		setServerVersion(tagData);
+	}
+	if ((getTag("broker", buffer, tagData, BSIZE) != NULL) && !viaBroker) {
+		logMSG(LS_SLIM, LL_INFO, "Server is a broker, asking for changed fields only\n");
+		viaBroker = true;
+		buildQueries();
+	}
+	if (getTag("player%20count", buffer, tagData, BSIZE) != NULL) {
+		setPlayerCount(strtol(tagData, NULL, 10));
+	}
+}
+
+/*******************************************************************************
+ * JSON-RPC answers - scanned while they arrive, the tags into a stage taken
+ * by a complete poll only, as the CLI answer is
+ ******************************************************************************/
+char jsonVolume[16];
+char jsonCurrent[16];
+char jsonTracks[16];
+char jsonStamp[PL_STAMPLEN];
+char jsonVersion[MAXTAG_DATA];
+char jsonCount[16];
+char jsonFlag[8];
+char tagStage[MAXTAG_TYPES][MAXTAG_DATA];
+int  stageValid[MAXTAG_TYPES];		// in the answer and not null
+
+// result.<name> of the status, or result.playlist_loop[0].<name> for the song tags
+const char *statusKey(const jsonscan *js) {
+	if (strcmp(jsonKey(js, 0), "result") != 0)	{return NULL;}
+	if (js->depth == 2)							{return jsonKey(js, 1);}
+	if ((js->depth == 4) && (strcmp(jsonKey(js, 1), "playlist_loop") == 0) && (jsonIndex(js, 2) == 0))	{return jsonKey(js, 3);}
+	return NULL;
+}
+
+char *statusField(jsonscan *js, int *size) {
+	const char *key = statusKey(js);
+
+	if (key == NULL)	{return NULL;}
+
+	for (int i = 0; i < MAXTAG_TYPES; i++) {
+		if (strcmp(key, tagStore[i].name) == 0) {
+			*size = MAXTAG_DATA;
+			return tagStage[i];
+		}
+	}
+	if (js->depth != 2)	{return NULL;}
+
+	*size = sizeof(jsonVolume);
+	if (strcmp(key, "mixer volume") == 0)		{return jsonVolume;}
+	if (strcmp(key, "playlist_cur_index") == 0)	{return jsonCurrent;}
+	if (strcmp(key, "playlist_tracks") == 0)	{return jsonTracks;}
+
+	*size = sizeof(jsonStamp);
+	if (strcmp(key, "playlist_timestamp") == 0)	{return jsonStamp;}
+	return NULL;
+}
 
-//		pTime	= getMinute("time", buffer);
-//		duration = getMinute("duration", buffer);
+void statusValue(jsonscan *js, char *value, int len) {
+	for (int i = 0; i < MAXTAG_TYPES; i++) {
+		if (value == tagStage[i]) {
+			stageValid[i] = (js->type != JT_NULL);
+			return;
+		}
+	}
+}
 
-//		printf("%3ld:%02ld %s %ld:%02ld\n", pTime/60, pTime%60, isPlaying(buffer) ? ">" : "II",  duration/60, duration%60);
+// result.version, result."player count" and result.players_loop[k] to the staged directory
+char *serverField(jsonscan *js, int *size) {
+	if (strcmp(jsonKey(js, 0), "result") != 0)	{return NULL;}
 
-//		printf("\n");
-			refreshed();
-			sleep(1);
+	const char *key = jsonKey(js, 1);
+	if (js->depth == 2) {
+		if (strcmp(key, "version") == 0) {
+			*size = sizeof(jsonVersion);
+			return jsonVersion;
 		}
+		if (strcmp(key, "player count") == 0) {
+			*size = sizeof(jsonCount);
+			return jsonCount;
+		}
+		return NULL;
+	}
+	if ((js->depth != 4) || (strcmp(key, "players_loop") != 0))	{return NULL;}
+
+	lmsplayer *p = stagePlayer(jsonIndex(js, 2));
+	if (p == NULL)	{return NULL;}
+
+	key = jsonKey(js, 3);
+	if (strcmp(key, "playerid") == 0) {
+		*size = PLAYER_IDLEN;
+		return p->id;
+	}
+	*size = PLAYER_NAMELEN;
+	if (strcmp(key, "name") == 0)	{return p->name;}
+	if (strcmp(key, "model") == 0)	{return p->model;}
+	if (strcmp(key, "isplaying") == 0) {
+		*size = sizeof(jsonFlag);
+		return jsonFlag;
+	}
+	return NULL;
+}
+
+void serverValue(jsonscan *js, char *value, int len) {
+	if (value != jsonFlag)	{return;}
+
+	lmsplayer *p = stagePlayer(jsonIndex(js, 2));
+	if (p != NULL)	{p->playing = (js->type == JT_TRUE) || (atoi(value) != 0);}
+}
+
+/*
+ * No notifications: follow the player that plays when ours does not,
+ * the directory of the poll knows which one started last
+ */
+void followActive(void) {
+	lmsplayer *active = activePlayer();
+	lmsplayer *ours   = findPlayerByID(playerID);
+
+	if (!autoFollow || (active == NULL) || !active->playing)	{return;}
+	if ((ours != NULL) && ours->playing)					{return;}
+	if (strcmp(active->id, playerID) == 0)					{return;}
+
+	logMSG(LS_SLIM, LL_INFO, "Following player %s (%s)\n", active->name, active->id);
+	selectPlayer(active->id);
+}
+
+// the staged tags of a status of our player; one the answer did not have is gone, as with the CLI
+void parseStatusJSON(void) {
+	for (int i = 0; i < MAXTAG_TYPES; i++) {
+		if (stageValid[i] && (strcmp(tagStage[i], tagStore[i].tagData) != 0)) {
+			strcpy(tagStore[i].tagData, tagStage[i]);
+			tagStore[i].changed = true;
+		}
+		tagStore[i].valid   = stageValid[i];
+		tagStore[i].rawHash = 0;
+	}
+	if (jsonVolume[0] != 0)	{playerVolume = strtol(jsonVolume, NULL, 10);}
+
+	playlistSetStatus((jsonCurrent[0] != 0) ? atoi(jsonCurrent) : -1, (jsonTracks[0] != 0) ? atoi(jsonTracks) : -1,
+		(jsonStamp[0] != 0) ? jsonStamp : NULL);
+}
+
+void parseServerJSON(void) {
+	commitPlayers();
+	directoryStale = false;
+
+	if (jsonVersion[0] != 0)	{setServerVersion(jsonVersion);}
+	if (jsonCount[0] != 0)		{setPlayerCount(atoi(jsonCount));}
+	followActive();
+}
+
+/*
+ * The playback clock of a status answer, and the next poll planned from
+ * it
+ */
+void noteClock(long now) {
+	clockPlaying  = tagStore[MODE].valid && (strcmp(tagStore[MODE].tagData, "play") == 0);
+	clockElapsed  = tagStore[TIME].valid     ? (long)(strtod(tagStore[TIME].tagData, NULL) * 1000)     : 0;
+	clockDuration = tagStore[DURATION].valid ? (long)(strtod(tagStore[DURATION].tagData, NULL) * 1000) : 0;
+	clockStamp    = now;
+
+	schedPolled(now, clockPlaying, clockElapsed, clockDuration);
+}
+
+/*
+ * A refresh without a poll: the time of a playing track moves on from
+ * the last answer, up to the duration
+ */
+void tickTags(long now) {
+	char elapsed[32];
+
+	if (!clockPlaying || !tagStore[TIME].valid)	{return;}
+
+	long ms = clockElapsed + (now - clockStamp) / 1000000L;
+	if ((clockDuration > 0) && (ms > clockDuration))	{ms = clockDuration;}
+
+	snprintf(elapsed, sizeof(elapsed), "%ld.%03ld", ms / 1000, ms % 1000);
+	if (strcmp(elapsed, tagStore[TIME].tagData) != 0) {
+		strncpy(tagStore[TIME].tagData, elapsed, MAXTAG_DATA);
+		tagStore[TIME].changed = true;
+		tagStore[TIME].rawHash = 0;		// the next answer is news again
+	}
+}
+
+long getPlayerVolume(void) {
+	return playerVolume;
+}
+
+/*
+ * One poll cycle: status, mixer volume and server status (and the player
+ * list when it is stale, the playlist windows the screen misses) pipelined
+ * in one write, each with its own deadline. Split in a queue and a
+ * complete step for the event loop.
+ */
+char statusAnswer[CLI_RXSIZE];
+char mixerAnswer[BSIZE];
+char serverAnswer[BSIZE];
+char playersAnswer[CLI_RXSIZE];
+int  rStatus  = -1;
+int  rMixer   = -1;
+int  rServer  = -1;
+int  rPlayers = -1;
+long pollStart;
+
+/*
+ * JSON-RPC: the status has the volume, the server status the player list,
+ * two requests instead of four
+ */
+int pollQueueJSON(void) {
+	jsonVolume[0] = jsonCurrent[0] = jsonTracks[0] = jsonStamp[0] = 0;
+	jsonVersion[0] = jsonCount[0] = 0;
+	memset(stageValid, 0, sizeof(stageValid));
+	stagePlayers();
+
+	rServer = cliQueueJSON("", SERVER_JSON, serverField, serverValue, NULL, CLI_DEADLINE);
+	rStatus = cliQueueJSON(playerID, STATUS_JSON, statusField, statusValue, NULL, CLI_DEADLINE);
+	playlistQueue(playerID);
+
+	return (rStatus < 0) ? -1 : 0;
+}
+
+int pollQueue(void) {
+	pollStart      = metricsNow();
+	playerSwitched = false;
+
+	if (useJSON)	{return pollQueueJSON();}
+
+	rPlayers = directoryStale ? cliQueue(playersQuery(), playersAnswer, sizeof(playersAnswer), CLI_DEADLINE) : -1;
+	rStatus  = cliQueue(query,    statusAnswer, sizeof(statusAnswer), CLI_DEADLINE);
+	rMixer   = cliQueue(volQuery, mixerAnswer,  sizeof(mixerAnswer),  CLI_DEADLINE);
+	rServer  = cliQueue("serverstatus 0 0", serverAnswer, sizeof(serverAnswer), CLI_DEADLINE);
+	playlistQueue(playerID);
+
+	return (rStatus < 0) ? -1 : 0;
+}
+
+/*
+ * PS_DONE: tags updated, PS_AGAIN: player switched - queue a new cycle,
+ * PS_FAILED: no status answer
+ */
+pollstate_t pollComplete(void) {
+	metricsTime(MT_POLL, pollStart);
+	metricsCount(MC_POLLS, 1);
+
+	pollstate_t rc = (cliState(rStatus) == CR_DONE) ? PS_DONE : PS_FAILED;
+
+	if (useJSON && (cliState(rServer) == CR_DONE)) {
+		parseServerJSON();
+	}
+	if ((rPlayers >= 0) && (cliState(rPlayers) == CR_DONE)) {
+		parsePlayers(playersAnswer);
+		directoryStale = false;
+	}
+
+	if (playerSwitched) {
+		// answers belong to the player we just left
+		rc = PS_AGAIN;
+	} else {
+		if ((rc == PS_DONE) && useJSON) {
+			long start = metricsNow();
+			parseStatusJSON();
+			metricsTime(MT_PARSE, start);
+			noteClock(start);
+		} else if (rc == PS_DONE) {
+			long start = metricsNow();
+			parseStatus(statusAnswer);
+			playlistStatus(statusAnswer);
+			metricsTime(MT_PARSE, start);
+			noteClock(start);
+		}
+		if (cliState(rMixer) == CR_DONE)				{parseMixer(mixerAnswer);}
+		if (!useJSON && (cliState(rServer) == CR_DONE))	{parseServerStatus(serverAnswer);}
+	}
+
+	playlistComplete(!playerSwitched);
+	cliRelease(rPlayers);
+	cliRelease(rStatus);
+	cliRelease(rMixer);
+	cliRelease(rServer);
+	rPlayers = rStatus = rMixer = rServer = -1;
+
+	return rc;
+}
+
+int pollServer(void) {
+	pollstate_t rc;
+
+	do {
+		pollQueue();
+		cliPump(CLI_DEADLINE);
+	} while ((rc = pollComplete()) == PS_AGAIN);
+
+	return (rc == PS_DONE) ? 0 : -1;
+}
+
+void setRefreshInterval(long ms) {
+	__atomic_store_n(&refreshInterval, ms, __ATOMIC_RELAXED);
+}
+
+long getRefreshInterval(void) {
+	return __atomic_load_n(&refreshInterval, __ATOMIC_RELAXED);
+}
+
+/*
+ * A refresh every refresh interval, with a poll only when the scheduler
+ * has one due, else the clock ticks on
+ */
+void *serverPolling(void *x_voidptr){
+	int  backoff     = 1;
+	long lastRefresh = 0;
+	long now;
+
+	metricsThread("poll");
+
+	while (true) {
+		if (isRefreshed()) {
+			usleep(REFRESH_STEP * 1000);
+			continue;
+		}
+
+		if (!cliConnected()) {
+			logMSG(LS_SLIM, LL_INFO, "Reconnecting to server in %ds\n", backoff);
+			sleep(backoff);
+			if (connectServer() < 0) {
+				backoff = (backoff < 30) ? backoff * 2 : 30;
+				continue;
+			}
+			backoff = 1;
+			schedNow();
+		}
+
+		while (((now = metricsNow()) < lastRefresh + getRefreshInterval() * 1000000L) && !schedDue(now)) {
+			usleep(REFRESH_STEP * 1000);
+		}
+
+		if (schedDue(now)) {
+			if (pollServer() < 0) {
+				schedRetry(metricsNow());
+				continue;
+			}
+		} else {
+			tickTags(now);
+		}
+
+		lastRefresh = now;
+		refreshed();
 	}
 	return NULL;
 }
@@ -281,19 +948,41 @@ void *serverPolling(void *x_voidptr){
 
 tag *initSliminfo(char *playerName) {
 	if (setStaticServer() < 0)			{ return NULL; }
-	if ((sockFD = connectServer()) < 0)	{ return NULL; }
+	cliSetNotify(slimNotify);
+	if (connectServer() < 0)			{ return NULL; }
 	if (discoverPlayer(playerName) < 0)	{ return NULL; }
 
-	sprintf(query, "%s status - 1 tags:aAlCIT\n", playerID); // alrTy
-	int x = 0;
+	if (initTagStore() == NULL)			{ return NULL; }
 
-	if (initTagStore() != NULL) {
- 		askRefresh();
-	   	if (pthread_create(&sliminfoThread, NULL, serverPolling, &x) != 0) {
-			closeSliminfo();
-			abort("Failed to create sliminfo thread!");
-		}
-	} else {return NULL;}
+	schedReset(metricsNow());
+	return tagStore;
+}
+
+/*
+ * Replay: no server, the answers come from the trace. Player changes are
+ * in the trace too, the notifications must not switch on their own.
+ */
+tag *replaySliminfo(void) {
+	cliSetNotify(slimNotify);
+	cliSetOffline();
+	autoFollow     = false;
+	directoryStale = false;
+
+	if (initTagStore() == NULL)			{ return NULL; }
 
 	return tagStore;
 }
+
+/*
+ * Thread mode: a poller thread driven by askRefresh() / isRefreshed()
+ */
+int startSliminfo(void) {
+	int x = 0;
+
+	askRefresh();
+	if (pthread_create(&sliminfoThread, NULL, serverPolling, &x) != 0) {
+		closeSliminfo();
+		abort("Failed to create sliminfo thread!");
+	}
+	return 0;
+}
@@ -21,23 +21,56 @@
 #ifndef SLIMINFO_H
 #define SLIMINFO_H
 
+#include <stdint.h>
+
 #define MAXTAG_DN	16
 #define MAXTAG_DATA	255
 
+#define REFRESH_INTERVAL	1000	// ms between two screen refreshes, polled or ticked (default)
+#define REFRESH_STEP		20		// ms, poller thread wake ups while waiting
+
+#define RPC_SCHEME		"http://"	// -s prefix of a JSON-RPC server
+#define STATUS_JSON		"status - 1 tags:aAlCIT"
+#define SERVER_JSON		"serverstatus 0 32"		// with the players, MAXPLAYERS
+#define SUBSCRIBE_CLI	"subscribe client,playlist"	// player add/remove and playback start notifications
+
 typedef struct Tag {
 	const char *name;
 	const char *displayName;
 	char *tagData;
 	int  valid;
 	int  changed;
+	uint64_t rawHash;		// of the encoded value in the last answer, 0 none
 } tag;
 
+typedef enum {PS_DONE, PS_AGAIN, PS_FAILED} pollstate_t;
+
 typedef enum {SAMPLESIZE, SAMPLERATE, TIME, DURATION, TITLE, ALBUM, ARTIST, ALBUMARTIST, COMPOSER, CONDUCTOR, MODE, MAXTAG_TYPES} tagtypes_t;
 
+void  setServerSelector(const char *selector);
+void  switchServer(const char *selector);
+void  setAutoFollow(int follow);
 void  closeSliminfo(void);
 tag  *initSliminfo(char *playerName);
+tag  *replaySliminfo(void);
+void  selectPlayer(const char *id);
+int   startSliminfo(void);
+int   connectServer(void);
+int   connectBegin(long now);
+int   connectPending(void);
+int   connectFD(void);
+int   connectWantWrite(void);
+long  connectDeadline(void);
+int   connectStep(long now);
+int   pollQueue(void);
+int   isPlayerSwitched(void);
+pollstate_t pollComplete(void);
+void  tickTags(long now);
 void  error(const char *msg);
 void  askRefresh(void);
 int   isRefreshed(void);
+long  getPlayerVolume(void);
+void  setRefreshInterval(long ms);
+long  getRefreshInterval(void);
 
 #endif
@@ -0,0 +1,149 @@
+/*
+ *	snapshot.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Publishes the tags, the volume and the playback clock in a POSIX
+ *	shared memory segment, so the other programs on the Pi can read them
+ *	without a CLI connection of their own. One writer, a seqlock: readers
+ *	(lmssnap.h) never block the monitor and the monitor never waits for
+ *	them.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logger.h"
+#include "snapshot.h"
+
+static_assert(MAXTAG_TYPES <= LMSSNAP_TAGS, "lmssnap has no room for every tag");
+static_assert(MAXTAG_DATA < LMSSNAP_DATALEN, "lmssnap tag data too short");
+
+lmssnap	*snap = NULL;
+char	snapName[64];
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+// name: "lmsmonitor" or "/lmsmonitor", the segment is /dev/shm/lmsmonitor
+int initSnapshot(const char *name) {
+	snprintf(snapName, sizeof(snapName), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+	int fd = shm_open(snapName, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		logERR(LS_MAIN, "Cannot create shared memory %s: %s\n", snapName, strerror(errno));
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(lmssnap)) < 0) {
+		logERR(LS_MAIN, "Cannot size shared memory %s: %s\n", snapName, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, sizeof(lmssnap), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		logERR(LS_MAIN, "Cannot map shared memory %s: %s\n", snapName, strerror(errno));
+		return -1;
+	}
+
+	// the segment of a previous run may still have readers
+	snap = (lmssnap *)map;
+	uint32_t seq = (snap->seq | 1) + 1;
+	__atomic_store_n(&snap->seq, seq - 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memset(&snap->pid, 0, sizeof(lmssnap) - offsetof(lmssnap, pid));
+	snap->magic   = LMSSNAP_MAGIC;
+	snap->version = LMSSNAP_VERSION;
+	snap->size    = sizeof(lmssnap);
+	snap->pid     = getpid();
+	snap->volume  = -1;
+	snap->stamp   = lmsSnapNow();
+
+	__atomic_store_n(&snap->seq, seq, __ATOMIC_RELEASE);
+
+	logMSG(LS_MAIN, LL_INFO, "Publishing the track snapshot in %s\n", snapName);
+	return 0;
+}
+
+/*
+ * The segment stays, a reader that keeps it mapped goes on working after
+ * a restart of the monitor; pid 0 tells it the monitor is gone.
+ */
+void closeSnapshot(void) {
+	if (snap == NULL)	{return;}
+
+	uint32_t seq = snap->seq;
+	__atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	snap->pid     = 0;
+	snap->playing = false;
+	__atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+
+	munmap(snap, sizeof(lmssnap));
+	snap = NULL;
+}
+
+/*
+ * Called by the thread that draws, after every refresh; tags NULL
+ * updates the volume only.
+ */
+void publishSnapshot(tag *tags, long volume) {
+	if (snap == NULL)	{return;}
+
+	uint32_t seq = snap->seq;
+	__atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	int64_t now = lmsSnapNow();
+	if ((tags == NULL) && snap->playing) {
+		// volume only: move elapsed along to the new stamp
+		snap->elapsed += now - snap->stamp;
+	}
+	snap->volume = volume;
+	snap->stamp  = now;
+
+	if (tags != NULL) {
+		for (int i = 0; i < MAXTAG_TYPES; i++) {
+			lmssnaptag *t = &snap->tags[i];
+
+			if (t->name[0] == 0) {
+				strncpy(t->name, tags[i].name, LMSSNAP_NAMELEN - 1);
+			}
+			// the tag strings are the bulk of the segment, copy changes only
+			if (tags[i].changed || (t->valid != tags[i].valid)) {
+				strncpy(t->data, tags[i].valid ? tags[i].tagData : "", LMSSNAP_DATALEN - 1);
+				t->valid = tags[i].valid;
+			}
+		}
+		snap->tagCount = MAXTAG_TYPES;
+		snap->elapsed  = tags[TIME].valid     ? (int64_t)(strtod(tags[TIME].tagData, NULL) * 1000) : 0;
+		snap->duration = tags[DURATION].valid ? (int64_t)(strtod(tags[DURATION].tagData, NULL) * 1000) : 0;
+		snap->playing  = tags[MODE].valid && (strcmp(tags[MODE].tagData, "play") == 0);
+	}
+
+	__atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+}
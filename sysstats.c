@@ -0,0 +1,204 @@
+/*
+ *	sysstats.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	CPU load, SoC temperature, memory and Wi-Fi signal of the box for the
+ *	system page. The files stay open, a sample is a pread from the start
+ *	of each into one buffer and a few number scans - no open, no stdio and
+ *	no allocation per sample, at most one sample per rate.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "logger.h"
+#include "sysstats.h"
+
+typedef enum {SF_STAT, SF_MEMINFO, SF_THERMAL, SF_WIRELESS, SF_MAXFILES} sysfile_t;
+
+const char *sysPath[SF_MAXFILES] = {SYS_STAT, SYS_MEMINFO, SYS_THERMAL, SYS_WIRELESS};
+int         sysFD[SF_MAXFILES]   = {-1, -1, -1, -1};
+char        sysBuf[SYS_READ];
+
+sysstats    sysNow   = {-1, SYS_NOTEMP, 0, 0, false, 0, 0};
+long        sysRate  = SYS_RATE * 1000000L;		// ns
+long        sysLast  = 0;
+long        cpuTotal = 0;
+long        cpuIdle  = 0;
+
+const sysstats *systemStats(void) {
+	return &sysNow;
+}
+
+/*******************************************************************************
+ * Parsing - in place, the buffer ends with a 0
+ ******************************************************************************/
+
+// the start of file, NULL if it cannot be read
+const char *readFile(sysfile_t f) {
+	if (sysFD[f] < 0)	{return NULL;}
+
+	ssize_t n = pread(sysFD[f], sysBuf, sizeof(sysBuf) - 1, 0);
+	if (n <= 0)	{return NULL;}
+
+	sysBuf[n] = 0;
+	return sysBuf;
+}
+
+// a decimal number after blanks, the fraction is skipped; NULL if none
+const char *scanNumber(const char *p, long *value) {
+	long v   = 0;
+	int  neg = false;
+
+	while ((*p == ' ') || (*p == '\t'))	{p++;}
+	if (*p == '-') {
+		neg = true;
+		p++;
+	}
+	if ((*p < '0') || (*p > '9'))	{return NULL;}
+
+	while ((*p >= '0') && (*p <= '9'))	{v = v * 10 + (*p++ - '0');}
+	if (*p == '.') {
+		for (p++; (*p >= '0') && (*p <= '9'); p++);
+	}
+	*value = neg ? -v : v;
+	return p;
+}
+
+// the number after a label of /proc/meminfo, -1 if missing
+long scanLabel(const char *buf, const char *label) {
+	const char *p = strstr(buf, label);
+	long v;
+
+	if ((p == NULL) || (scanNumber(p + strlen(label), &v) == NULL))	{return -1;}
+	return v;
+}
+
+// cpu  user nice system idle iowait irq softirq steal ...
+void sampleCPU(void) {
+	const char *p = readFile(SF_STAT);
+	long field[8];
+	long total = 0;
+
+	if ((p == NULL) || (strncmp(p, "cpu ", 4) != 0))	{return;}
+
+	p += 4;
+	for (int i = 0; i < 8; i++) {
+		if ((p = scanNumber(p, &field[i])) == NULL)	{return;}
+		total += field[i];
+	}
+	long idle = field[3] + field[4];
+
+	if ((cpuTotal > 0) && (total > cpuTotal)) {
+		sysNow.cpu = (int)(100 - (idle - cpuIdle) * 100 / (total - cpuTotal));
+	}
+	cpuTotal = total;
+	cpuIdle  = idle;
+}
+
+void sampleMemory(void) {
+	const char *p = readFile(SF_MEMINFO);
+
+	if (p == NULL)	{return;}
+
+	long total = scanLabel(p, "MemTotal:");
+	long avail = scanLabel(p, "MemAvailable:");
+	if ((total > 0) && (avail >= 0)) {
+		sysNow.memTotal     = total;
+		sysNow.memAvailable = avail;
+	}
+}
+
+void sampleThermal(void) {
+	const char *p = readFile(SF_THERMAL);
+	long t;
+
+	if ((p != NULL) && (scanNumber(p, &t) != NULL)) {
+		sysNow.temp = t;
+	}
+}
+
+// two header lines, then: wlan0: 0000   49.  -61.  -256 ...
+void sampleWireless(void) {
+	const char *p = readFile(SF_WIRELESS);
+	long link, level;
+
+	sysNow.wifi = false;
+	if (p == NULL)	{return;}
+
+	for (int i = 0; (i < 2) && (p != NULL); i++) {
+		if ((p = strchr(p, '\n')) != NULL)	{p++;}
+	}
+	if ((p == NULL) || ((p = strchr(p, ':')) == NULL))	{return;}
+
+	// the status word is hex
+	for (p++; *p == ' '; p++);
+	while ((*p != ' ') && (*p != 0))	{p++;}
+
+	if (((p = scanNumber(p, &link)) == NULL) || (scanNumber(p, &level) == NULL))	{return;}
+	sysNow.wifi      = true;
+	sysNow.wifiLink  = (int)link;
+	sysNow.wifiLevel = (int)level;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int openSystemStats(int rateMS) {
+	int opened = 0;
+
+	if (rateMS > 0)	{sysRate = rateMS * 1000000L;}
+
+	for (int i = 0; i < SF_MAXFILES; i++) {
+		if (sysFD[i] >= 0) {
+			opened++;
+		} else if ((sysFD[i] = open(sysPath[i], O_RDONLY | O_CLOEXEC)) >= 0) {
+			opened++;
+		} else {
+			logMSG(LS_MAIN, LL_INFO, "No %s, not shown\n", sysPath[i]);
+		}
+	}
+	// the first CPU load shown is since now
+	sampleCPU();
+	return (opened > 0) ? 0 : -1;
+}
+
+void closeSystemStats(void) {
+	for (int i = 0; i < SF_MAXFILES; i++) {
+		if (sysFD[i] >= 0) {
+			close(sysFD[i]);
+			sysFD[i] = -1;
+		}
+	}
+}
+
+// true when a new sample was taken
+int sampleSystemStats(long now) {
+	if ((sysLast != 0) && (now - sysLast < sysRate))	{return false;}
+
+	sysLast = now;
+	sampleCPU();
+	sampleMemory();
+	sampleThermal();
+	sampleWireless();
+	return true;
+}
@@ -0,0 +1,47 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef SYSSTATS_H
+#define SYSSTATS_H 1
+
+#define SYS_STAT		"/proc/stat"
+#define SYS_MEMINFO		"/proc/meminfo"
+#define SYS_THERMAL		"/sys/class/thermal/thermal_zone0/temp"
+#define SYS_WIRELESS	"/proc/net/wireless"
+#define SYS_RATE		2000		// ms between samples
+#define SYS_READ		512			// bytes read of a file, the fields are at the top
+#define SYS_NOTEMP		(-273150)	// m°C, no thermal zone
+
+typedef struct {
+	int		cpu;					// %, -1 unknown
+	long	temp;					// m°C, SYS_NOTEMP unknown
+	long	memTotal;				// kB, 0 unknown
+	long	memAvailable;			// kB
+	int		wifi;					// an interface in /proc/net/wireless
+	int		wifiLink;				// link quality
+	int		wifiLevel;				// dBm
+} sysstats;
+
+int   openSystemStats(int rateMS);
+void  closeSystemStats(void);
+int   sampleSystemStats(long now);
+const sysstats *systemStats(void);
+
+#endif
@@ -23,10 +23,25 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
 #include "sliminfo.h"
+#include "tagUtils.h"
+#include "kernels.h"
 
 #define MAXTAGLEN 255
 
+typedef struct {
+	uint64_t	hash;
+	int			rawLen;
+	char		*raw;
+	char		*dec;
+} decodeentry;
+
+decodeentry	decodeCache[DECODE_CACHE];
+decodestats	decodeStats;
+
 /*
  *  Based of: URL decoding function from http://rosettacode.org/wiki/URL_encoding
  *
@@ -93,88 +108,53 @@ char getASCII(int utf8) {
     if ((utf8 >= 0x00C0) && (utf8 <= 0x022F)) {
         ascii = mainMap[utf8 - 0x00C0];
     } else {
-        for (i = 0; (extraUtfMap[i] != utf8) && (extraUtfMap[i] != 0); i++) {
-            if (extraUtfMap[i] == 0) {
-                printf("Unhandled UTF-8 code! %d\n", utf8);
-            }
-            ascii = extraChrMap[i];
+        for (i = 0; (extraUtfMap[i] != utf8) && (extraUtfMap[i] != 0); i++) {}
+        if (extraUtfMap[i] == 0) {
+            logMSG(LS_SLIM, LL_DEBUG, "Unhandled UTF-8 code! %d\n", utf8);
         }
+        ascii = extraChrMap[i];
     }
     return ascii;
 }
 
+// up to a space or \n, with the decoder picked for the CPU; UTF-8 is kept, the renderer decodes the code points
 int decode(const char *s, char *dec)
 {
-    char *o;
-    const char *end;
-    int c;
-    int utfC = 0;
-    int mb   = 0;
-
 	if ((s == NULL)&& (dec == NULL)) {return -1;}
 
-	if ((end = strchr(s, ' ')) == NULL) {
-		if ((end = strchr(s, '\n')) == NULL) {
-			end = s + strlen(s);
-		}
-	}
-	end--;
-
-    for (o = dec; s <= end;) {
-        c = *s++;
-        if (c == '+') c = ' ';
-        else if (c == '%' && (  !ishex(*s++)    ||
-                                !ishex(*s++)    ||
-                                !sscanf(s - 2, "%2x", &c)))
-            return -1;
-
-            if ((c & 0b10000000) != 0) {
-                //UTF-8 handling
-                if ((c & 0b01000000) != 0) {
-                    // the first byte of UTF-8 character)
-                    utfC = c &  0b00111111;
-                    char mask = 0b00100000;
-                    mb = 1;
-                    while ((c & mask) != 0) {
-                        utfC = utfC & (!mask);
-                        mask = mask >> 1;
-                        mb++;
-                    }
-                } else {
-                    // next bytes of UTF-8 character
-                    utfC = (utfC << 6) | (c & 0b00111111);
-                    if (--mb == 0) {
-                        *(o++) = getASCII(utfC);
-                    }
-                }
-            } else {
-                *(o++) = c;
-            }
-        }
-
-	*o = 0;
-
-    return o - dec;
+	return kern.pctDecode(s, strcspn(s, " \n"), dec);
 }
 /***********************************************************************/
 
-char *getTag(const char *tag, char *input, char*output, int outSize) {
+/*
+ * The still encoded value of a tag and its length, NULL if the answer
+ * has no such tag
+ */
+const char *findTag(const char *tag, const char *input, int *length) {
 	char  exactTag[MAXTAGLEN];
-	char *foundT;
-	char *lastCHR;
-	int   tagLength;
+	const char *foundT;
+	const char *lastCHR;
 
-	if ((tag == NULL) || (input == NULL) || (output == NULL))  {return NULL;}
+	if ((tag == NULL) || (input == NULL))                      {return NULL;}
 
 	sprintf(exactTag, " %s%%3A", tag);
 	if ((foundT = strstr(input, exactTag)) == NULL)            {return NULL;}
 
 	foundT = strstr(foundT, "%3A") + (3 * sizeof(char));
 	if((lastCHR = strchr(foundT, ' ')) != NULL) {
-		tagLength = lastCHR - foundT;
+		*length = lastCHR - foundT;
 	} else {
-		tagLength = strlen(foundT);
+		*length = strlen(foundT);
 	}
+	return foundT;
+}
+
+char *getTag(const char *tag, char *input, char*output, int outSize) {
+	const char *foundT;
+	int   tagLength;
+
+	if (output == NULL)                                        {return NULL;}
+	if ((foundT = findTag(tag, input, &tagLength)) == NULL)    {return NULL;}
 
 	if (tagLength < outSize) {
 		decode(foundT, output);
@@ -183,20 +163,79 @@ char *getTag(const char *tag, char *input, char*output, int outSize) {
 	return output;
 }
 
-char *getQuality(char *input, char*output, int outSize) {
+// FNV-1a, 64 bits: equal hashes are taken for equal values
+uint64_t tagHash(const char *raw, int length) {
+	uint64_t h = 14695981039346656037ull;
+
+	for (int i = 0; i < length; i++) {
+		h ^= (unsigned char)raw[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/*
+ * Decode through a small direct mapped cache keyed by the encoded value:
+ * artist, album and the like come back unchanged poll after poll, and
+ * again after a player switch. -1 if the value does not fit output.
+ */
+int decodeCached(const char *raw, int length, uint64_t hash, char *output, int outSize) {
+	if (length >= outSize)	{return -1;}
+
+	decodeentry *e = &decodeCache[hash & (DECODE_CACHE - 1)];
+	if ((e->raw != NULL) && (e->hash == hash) && (e->rawLen == length) && (memcmp(e->raw, raw, length) == 0)) {
+		strcpy(output, e->dec);
+		decodeStats.hits++;
+		metricsCount(MC_DECODE_HITS, 1);
+		return 0;
+	}
+
+	decodeStats.misses++;
+	metricsCount(MC_DECODE_MISSES, 1);
+	if (decode(raw, output) < 0)	{return -1;}
+
+	char *key = (char *)malloc(length + 1);
+	char *dec = strdup(output);
+	if ((key == NULL) || (dec == NULL)) {
+		free(key);
+		free(dec);
+		return 0;
+	}
+	memcpy(key, raw, length);
+	key[length] = 0;
+
+	free(e->raw);
+	free(e->dec);
+	e->hash   = hash;
+	e->rawLen = length;
+	e->raw    = key;
+	e->dec    = dec;
+	return 0;
+}
+
+// a tag whose hash matched the last one, nothing decoded
+void decodeSkipped(void) {
+	decodeStats.unchanged++;
+	metricsCount(MC_TAGS_UNCHANGED, 1);
+}
+
+const decodestats *getDecodeStats(void) {
+	return &decodeStats;
+}
+
+// sample size/kHz of the tags, eg. 16/44; NULL if the answer had none
+char *getQuality(tag *tags, char *output, int outSize) {
 	long sampleSize;
 	long sampleRate;
-	char tagData[MAXTAGLEN];
 
-	if ((input == NULL) || (output == NULL))			               {return NULL;}
+	if ((tags == NULL) || (output == NULL))									{return NULL;}
 
-	if (outSize < (7 * (int)sizeof(char)))				               {return NULL;}
-        if ((getTag("samplesize", input, tagData, MAXTAGLEN)) == NULL) {return NULL;}
-	if ((sampleSize = strtol(tagData, NULL, 10)) == 0)		           {return NULL;}
-        if ((getTag("samplerate", input, tagData, MAXTAGLEN)) == NULL) {return NULL;}
-	if ((sampleRate = strtol(tagData, NULL, 10)) == 0)                 {return NULL;}
+	if (outSize < (7 * (int)sizeof(char)))									{return NULL;}
+	if (!tags[SAMPLESIZE].valid || !tags[SAMPLERATE].valid)					{return NULL;}
+	if ((sampleSize = strtol(tags[SAMPLESIZE].tagData, NULL, 10)) == 0)		{return NULL;}
+	if ((sampleRate = strtol(tags[SAMPLERATE].tagData, NULL, 10)) == 0)		{return NULL;}
 
-	sprintf(output, "%ld/%ld", sampleSize, sampleRate/1000);
+	snprintf(output, outSize, "%ld/%ld", sampleSize, sampleRate/1000);
 
 	return output;
 }
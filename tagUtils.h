@@ -21,13 +21,29 @@
 #ifndef TAGUTILS_H
 #define TAGUTILS_H
 
+#include <stdint.h>
+
 #include "sliminfo.h"
 
+#define DECODE_CACHE	64			// decoded tag values kept, must be a power of 2
+
+typedef struct {
+	unsigned long	unchanged;		// same hash as the last value, not decoded
+	unsigned long	hits;
+	unsigned long	misses;
+} decodestats;
+
+const char *findTag(const char *tag, const char *input, int *length);
 char *getTag(const char *tag, char *input, char*output, int outSize);
-char *getQuality(char *input, char*output, int outSize);
+uint64_t tagHash(const char *raw, int length);
+int   decodeCached(const char *raw, int length, uint64_t hash, char *output, int outSize);
+void  decodeSkipped(void);
+const decodestats *getDecodeStats(void);
+char *getQuality(tag *tags, char *output, int outSize);
 int   isPlaying(char *input);
 long  getMinute(tag *timeTag);
 void  encode(const char *s, char *enc);
 int   decode(const char *s, char *dec);
+char  getASCII(int utf8);
 
 #endif
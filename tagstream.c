@@ -0,0 +1,263 @@
+/*
+ *	tagstream.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Machine readable output: one JSON object per line, carrying only the
+ *	fields that changed since the previous record.
+ *
+ *	{"seq":0,"ts":1203,"full":true,"title":"...","artist":"...","volume":40}
+ *	{"seq":1,"ts":2210,"time":"13.5"}
+ *	{"seq":2,"ts":2730,"conductor":null}
+ *
+ *	A record that could not be delivered forces the next one to be a full
+ *	snapshot, so the consumer never keeps a stale field.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "logger.h"
+#include "tagstream.h"
+
+typedef enum {ST_NONE, ST_STDOUT, ST_FIFO, ST_UNIX} streamtype_t;
+
+streamtype_t	streamType = ST_NONE;
+char			streamPath[108];
+int				streamFD   = -1;
+time_t			lastOpen   = 0;
+
+unsigned long	streamSeq  = 0;
+long			streamDropped = 0;
+int				needFull   = true;
+int				lastValid[MAXTAG_TYPES];
+long			lastVolume = -1;
+
+char			record[STREAM_RECORD];
+char			pending[STREAM_RECORD];
+int				pendingLen = 0;
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int openStream(void) {
+	time_t now = time(NULL);
+
+	if (streamFD >= 0)		{return streamFD;}
+	if (now == lastOpen)	{return -1;}		// retry at most once per second
+	lastOpen = now;
+
+	if (streamType == ST_UNIX) {
+		struct sockaddr_un addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", streamPath);
+
+		if ((streamFD = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {return -1;}
+		if (connect(streamFD, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			close(streamFD);
+			streamFD = -1;
+			return -1;
+		}
+	} else {
+		// O_NONBLOCK open of a FIFO fails with ENXIO until a reader is there
+		if ((streamFD = open(streamPath, O_WRONLY | O_NONBLOCK)) < 0) {return -1;}
+	}
+
+	logMSG(LS_MAIN, LL_INFO, "Tag stream connected: %s\n", streamPath);
+	pendingLen = 0;
+	needFull   = true;
+	return streamFD;
+}
+
+void dropStream(void) {
+	if (streamFD >= 0) {
+		close(streamFD);
+		streamFD = -1;
+	}
+	pendingLen = 0;
+	needFull   = true;
+}
+
+/*
+ * Non-blocking delivery, a partially written record is finished before the
+ * next one is started.
+ */
+int sendStream(const char *buf, int len) {
+	if (streamType == ST_STDOUT) {
+		return logRaw(buf) ? len : -1;
+	}
+
+	if (openStream() < 0)	{return -1;}
+
+	if (pendingLen > 0) {
+		int sent = write(streamFD, pending, pendingLen);
+		if (sent < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {dropStream();}
+			return -1;
+		}
+		memmove(pending, pending + sent, pendingLen - sent);
+		pendingLen -= sent;
+		if (pendingLen > 0)	{return -1;}
+	}
+
+	int sent = write(streamFD, buf, len);
+	if (sent < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {dropStream();}
+		return -1;
+	}
+	if (sent < len) {
+		memcpy(pending, buf + sent, len - sent);
+		pendingLen = len - sent;
+	}
+	return len;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+char *putJSONString(char *o, const char *s) {
+	*o++ = '"';
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if ((c == '"') || (c == '\\')) {
+			*o++ = '\\';
+			*o++ = c;
+		} else if (c < 0x20) {
+			o += sprintf(o, "\\u%04x", c);
+		} else {
+			*o++ = c;
+		}
+	}
+	*o++ = '"';
+	return o;
+}
+
+/*
+ * tags == NULL: volume only record, the tag changed flags belong to the
+ *               refresh cycle of the main loop.
+ */
+int streamTags(tag *tags, long volume) {
+	struct timespec ts;
+	char *o;
+	int   fields = 0;
+	int   full   = needFull;
+
+	if (streamType == ST_NONE)	{return 0;}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	o  = record;
+	o += sprintf(o, "{\"seq\":%lu,\"ts\":%ld%s", streamSeq,
+		ts.tv_sec * 1000L + ts.tv_nsec / 1000000L, full ? ",\"full\":true" : "");
+
+	if (tags != NULL) {
+		for (int i = 0; i < MAXTAG_TYPES; i++) {
+			if (!full && !tags[i].changed && (tags[i].valid == lastValid[i])) {continue;}
+
+			o += sprintf(o, ",\"%s\":", tags[i].name);
+			if (tags[i].valid) {
+				o = putJSONString(o, tags[i].tagData);
+			} else {
+				o += sprintf(o, "null");
+			}
+			lastValid[i] = tags[i].valid;
+			fields++;
+		}
+	}
+
+	if (full || (volume != lastVolume)) {
+		o += sprintf(o, ",\"volume\":%ld", volume);
+		lastVolume = volume;
+		fields++;
+	}
+
+	if ((fields == 0) || (full && (tags == NULL))) {return 0;}
+
+	*o++ = '}';
+	*o++ = '\n';
+	*o   = 0;
+
+	if (sendStream(record, o - record) < 0) {
+		streamDropped++;
+		needFull = true;
+		return -1;
+	}
+
+	streamSeq++;
+	needFull = false;
+	return fields;
+}
+
+long getStreamDropped(void) {
+	return streamDropped;
+}
+
+/*******************************************************************************
+ * target: "-" stdout, "unix:/path" Unix stream socket, otherwise FIFO path
+ ******************************************************************************/
+int initTagStream(const char *target) {
+	if (target == NULL)	{return -1;}
+
+	if (strcmp(target, "-") == 0) {
+		streamType = ST_STDOUT;
+		setLogOutput(STDERR_FILENO);
+		return 0;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	int isUnix = (strncmp(target, "unix:", 5) == 0);
+	if (isUnix)	{target += 5;}
+
+	// as long as sun_path: a cut path would name an other file
+	if (strlen(target) >= sizeof(streamPath)) {
+		logERR(LS_MAIN, "Tag stream path too long: %s\n", target);
+		return -1;
+	}
+
+	if (isUnix) {
+		streamType = ST_UNIX;
+	} else {
+		streamType = ST_FIFO;
+		if ((mkfifo(target, 0644) < 0) && (errno != EEXIST)) {
+			logERR(LS_MAIN, "Failed to create FIFO %s: %s\n", target, strerror(errno));
+			streamType = ST_NONE;
+			return -1;
+		}
+	}
+
+	snprintf(streamPath, sizeof(streamPath), "%s", target);
+	openStream();
+	return 0;
+}
+
+void closeTagStream(void) {
+	dropStream();
+	streamType = ST_NONE;
+}
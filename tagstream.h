@@ -0,0 +1,33 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef TAGSTREAM_H
+#define TAGSTREAM_H 1
+
+#include "sliminfo.h"
+
+#define STREAM_RECORD	(MAXTAG_TYPES * (6 * MAXTAG_DATA + 32) + 128)
+
+int   initTagStream(const char *target);
+void  closeTagStream(void);
+int   streamTags(tag *tags, long volume);
+long  getStreamDropped(void);
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ *	termscreen.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	The screen on a terminal (-t on a tty): the OLED laid out in fixed
+ *	font cells at the top, the log lines scroll in the region below it.
+ *	The pages draw into a grid of cells, an update compares it with the
+ *	cells on the terminal and writes only the runs that changed, each
+ *	after a cursor move, between a cursor save and restore - a new second
+ *	of the play time is a dozen bytes instead of seven lines. It goes out
+ *	through the logger, so it cannot land in the middle of a log line.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#include "common.h"
+#include "logger.h"
+#include "fonts.h"
+#include "termscreen.h"
+
+#define CELL_WIDE	0xFFFFFFFEu		// right half of a double width character
+#define CELL_NONE	0xFFFFFFFFu		// not known, written by the next update
+#define BLOCK_FULL	0x2588
+#define BLOCK_LEFT	0x2590			// minus 1 to 7: the left eighths of a cell
+#define BLOCK_EMPTY	0x2591
+#define RULE		0x2500
+
+uint32_t termCells[TERM_ROWS][TERM_COLS];	// drawn by the pages
+uint32_t (*termWant)[TERM_COLS] = termCells;	// or the cells of a page, see termInto()
+uint32_t termShown[TERM_ROWS][TERM_COLS];	// on the terminal
+int      termOn    = false;
+int      termLines = 0;						// height of the terminal at the last setup
+
+// scroll region off, cursor back, below everything
+static const char termReset[] = "\033[r\033[?25h\033[999;1H\n";
+
+int termScreenOn(void) {
+	return termOn;
+}
+
+// the cells drawn to and shown from now on, NULL the own ones
+void termInto(uint32_t *cells) {
+	termWant = (cells != NULL) ? (uint32_t (*)[TERM_COLS])cells : termCells;
+}
+
+/*******************************************************************************
+ * Cells
+ ******************************************************************************/
+
+// combining marks take no cell, the East Asian wide ranges two
+int cellWidth(int cp) {
+	if (((cp >= 0x0300) && (cp <= 0x036F)) || ((cp >= 0x200B) && (cp <= 0x200F)) ||
+		((cp >= 0xFE00) && (cp <= 0xFE0F)))	{return 0;}
+
+	if (((cp >= 0x1100) && (cp <= 0x115F)) || ((cp >= 0x2E80) && (cp <= 0xA4CF)) ||
+		((cp >= 0xAC00) && (cp <= 0xD7A3)) || ((cp >= 0xF900) && (cp <= 0xFAFF)) ||
+		((cp >= 0xFE30) && (cp <= 0xFE4F)) || ((cp >= 0xFF00) && (cp <= 0xFF60)) ||
+		((cp >= 0xFFE0) && (cp <= 0xFFE6)) || ((cp >= 0x1F300) && (cp <= 0x1F64F)) ||
+		((cp >= 0x20000) && (cp <= 0x3FFFD)))	{return 2;}
+
+	return 1;
+}
+
+int termWidth(const char *text) {
+	int width = 0;
+	int cp;
+
+	while ((cp = nextCodepoint(&text)) >= 0) {
+		width += (cp < ' ') ? 1 : cellWidth(cp);
+	}
+	return width;
+}
+
+// the text from its skip-th cell on, at col; the column after it
+int putCells(int row, int col, const char *text, int skip) {
+	int cp;
+
+	while ((col < TERM_COLS) && ((cp = nextCodepoint(&text)) >= 0)) {
+		if ((cp < ' ') || (cp == 0x7F))	{cp = '?';}
+
+		int width = cellWidth(cp);
+		if (width == 0)	{continue;}
+
+		if (skip > 0) {
+			// half of a wide character scrolled off
+			if ((skip -= width) < 0)	{termWant[row][col++] = ' ';}
+			continue;
+		}
+		if ((width == 2) && (col + 1 == TERM_COLS)) {
+			termWant[row][col++] = ' ';
+			break;
+		}
+		termWant[row][col++] = cp;
+		if (width == 2)	{termWant[row][col++] = CELL_WIDE;}
+	}
+	return col;
+}
+
+void clearCells(int row, int col) {
+	for (; col < TERM_COLS; col++) {
+		termWant[row][col] = ' ';
+	}
+}
+
+void termClear(void) {
+	for (int row = 0; row < TERM_ROWS; row++) {
+		clearCells(row, 0);
+	}
+}
+
+// text at col, blanks after it to the end of the row
+void termText(int row, int col, const char *text) {
+	if (!termOn || (row < 0) || (row >= TERM_ROWS) || (col < 0))	{return;}
+	clearCells(row, putCells(row, col, text, 0));
+}
+
+void termCenter(int row, const char *text) {
+	if (!termOn || (row < 0) || (row >= TERM_ROWS))	{return;}
+
+	int width = termWidth(text);
+	clearCells(row, 0);
+	putCells(row, (width < TERM_COLS) ? (TERM_COLS - width) / 2 : 0, text, 0);
+}
+
+// a line too long for the row, offset cells scrolled, starting again after a gap
+void termMarquee(int row, const char *text, int offset) {
+	if (!termOn || (row < 0) || (row >= TERM_ROWS))	{return;}
+
+	int width = termWidth(text);
+	offset %= width + TERM_MARQUEE;
+
+	int col = putCells(row, 0, text, offset);
+	for (int gap = (offset > width) ? width + TERM_MARQUEE - offset : TERM_MARQUEE; (gap > 0) && (col < TERM_COLS); gap--) {
+		termWant[row][col++] = ' ';
+	}
+	clearCells(row, putCells(row, col, text, 0));
+}
+
+// percent of width cells in block characters, to an eighth of a cell
+void termBar(int row, int col, int width, int percent) {
+	if (!termOn || (row < 0) || (row >= TERM_ROWS) || (col < 0))	{return;}
+
+	if (percent > 100)	{percent = 100;}
+	if (percent < 0)	{percent = 0;}
+
+	int eighths = width * 8 * percent / 100;
+	for (int i = 0; (i < width) && (col + i < TERM_COLS); i++) {
+		int fill = eighths - i * 8;
+		termWant[row][col + i] = (fill >= 8) ? BLOCK_FULL : (fill > 0) ? BLOCK_LEFT - fill : BLOCK_EMPTY;
+	}
+}
+
+/*******************************************************************************
+ * Output
+ ******************************************************************************/
+int putUTF8(char *out, uint32_t cp) {
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		out[0] = 0xC0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	}
+	if (cp < 0x10000) {
+		out[0] = 0xE0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3F);
+		out[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	out[0] = 0xF0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3F);
+	out[2] = 0x80 | ((cp >> 6) & 0x3F);
+	out[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+/*
+ * The region on top, a rule under it and the log lines scrolling below.
+ * Everything on the terminal is unknown after it.
+ */
+void termSetup(int lines) {
+	char out[TERM_OUT];
+	int  len;
+
+	len = snprintf(out, sizeof(out), "\033[?25l\033[H\033[2J\033[%d;1H", TERM_ROWS + 1);
+	for (int col = 0; col < TERM_COLS; col++) {
+		len += putUTF8(out + len, RULE);
+	}
+	snprintf(out + len, sizeof(out) - len, "\033[%d;%dr\033[%d;1H", TERM_ROWS + 2, lines, TERM_ROWS + 2);
+	logRaw(out);
+
+	for (int row = 0; row < TERM_ROWS; row++) {
+		for (int col = 0; col < TERM_COLS; col++) {
+			termShown[row][col] = CELL_NONE;
+		}
+	}
+	termLines = lines;
+}
+
+int termHeight(void) {
+	struct winsize ws;
+
+	if ((ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0) || (ws.ws_row == 0))	{return -1;}
+	return ws.ws_row;
+}
+
+/*
+ * The runs of changed cells, unchanged stretches shorter than TERM_GAP
+ * are written over rather than jumped. A full screen is 8 moves and 21
+ * cells of at most 4 bytes a row, well within TERM_OUT.
+ */
+int termFlush(void) {
+	char out[TERM_OUT];
+	int  len;
+
+	if (!termOn)	{return 0;}
+
+	// a resized terminal drops the scroll region, all of it again
+	int lines = termHeight();
+	if ((lines > 0) && (lines != termLines))	{termSetup(lines);}
+
+	len = sprintf(out, "\0337");
+	int empty = len;
+
+	for (int row = 0; row < TERM_ROWS; row++) {
+		uint32_t *want = termWant[row], *shown = termShown[row];
+
+		for (int col = 0; col < TERM_COLS; ) {
+			if (want[col] == shown[col]) {
+				col++;
+				continue;
+			}
+
+			int first = (want[col] == CELL_WIDE) ? col - 1 : col;
+			int last  = col;
+			for (int same = 0; (++col < TERM_COLS) && (same < TERM_GAP); ) {
+				if (want[col] != shown[col]) {
+					last = col;
+					same = 0;
+				} else {
+					same++;
+				}
+			}
+			if ((last + 1 < TERM_COLS) && (want[last + 1] == CELL_WIDE))	{last++;}
+			col = last + 1;
+
+			len += sprintf(out + len, "\033[%d;%dH", row + 1, first + 1);
+			for (int c = first; c <= last; c++) {
+				if (want[c] != CELL_WIDE)	{len += putUTF8(out + len, want[c]);}
+				shown[c] = want[c];
+			}
+		}
+	}
+	if (len == empty)	{return 0;}
+
+	len += sprintf(out + len, "\0338");
+	logRaw(out);
+	return len;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+
+// thread mode dies of these, the terminal is given back first
+void termSignal(int sig) {
+	if (write(STDOUT_FILENO, termReset, sizeof(termReset) - 1) < 0) {}
+	raise(sig);
+}
+
+int initTermScreen(void) {
+	const char *term = getenv("TERM");
+	int lines;
+
+	if (!isatty(STDOUT_FILENO) || (term == NULL) || (strcmp(term, "dumb") == 0))	{return -1;}
+	if (((lines = termHeight()) < 0) || (lines < TERM_ROWS + 3)) {
+		logMSG(LS_MAIN, LL_INFO, "Terminal too small, plain text\n");
+		return -1;
+	}
+
+	termOn = true;
+	termClear();
+	termSetup(lines);
+
+	// the reactor has them blocked and reads them from a signalfd
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = termSignal;
+	sa.sa_flags   = SA_RESETHAND;
+	int sigs[] = {SIGINT, SIGTERM, SIGHUP};
+	for (unsigned i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+		struct sigaction old;
+		if ((sigaction(sigs[i], NULL, &old) == 0) && (old.sa_handler == SIG_DFL)) {
+			sigaction(sigs[i], &sa, NULL);
+		}
+	}
+	// exit() and abort() anywhere
+	atexit(closeTermScreen);
+	return 0;
+}
+
+// straight to the terminal: the logger can be gone already
+void closeTermScreen(void) {
+	if (!termOn)	{return;}
+
+	termOn = false;
+	if (write(STDOUT_FILENO, termReset, sizeof(termReset) - 1) < 0) {}
+}
@@ -0,0 +1,47 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef TERMSCREEN_H
+#define TERMSCREEN_H 1
+
+#include <stdint.h>
+
+#include "display.h"
+
+#define TERM_COLS		(DISPLAY_WIDTH / CHAR_WIDTH)	// the OLED in fixed font cells
+#define TERM_ROWS		DISPLAY_PAGES
+#define TERM_GAP		6			// unchanged cells worth skipping with a cursor move
+#define TERM_MARQUEE	3			// blanks between the end and the restart of a scrolled line
+#define TERM_OUT		2048		// bytes of one update
+#define TERM_CELLS		(TERM_ROWS * TERM_COLS)
+
+int  initTermScreen(void);
+void closeTermScreen(void);
+int  termScreenOn(void);
+void termInto(uint32_t *cells);
+void termClear(void);
+void termText(int row, int col, const char *text);
+void termCenter(int row, const char *text);
+void termMarquee(int row, const char *text, int offset);
+void termBar(int row, int col, int width, int percent);
+int  termWidth(const char *text);
+int  termFlush(void);
+
+#endif
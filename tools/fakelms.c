@@ -0,0 +1,374 @@
+/*
+ *	fakelms.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	A stand in for LMS on the development box: answers the discovery and
+ *	the handful of CLI commands the monitor sends, for two fixed players.
+ *	-l adds latency to every answer to look like a busy server. Used by
+ *	tools/startbench.sh. The playlist has -t tracks, status <start> <count>
+ *	answers the entries of the window asked for and counts them. -j also
+ *	serves the same over JSON-RPC (POST /jsonrpc.js, kept alive), the
+ *	answers in turn with a length and in small chunks, the keys not in
+ *	the order the monitor reads them.
+ *
+ *	Usage: fakelms [-p cliport] [-j jsonport] [-n name] [-l latency ms] [-t tracks] [-D]
+ *	       -D: no discovery answers
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DISC_PORT	3483
+
+const char	*serverName = "fakelms";
+int			cliPort  = 9090;
+int			jsonPort = 0;			// 0: no JSON-RPC
+int			latency  = 0;			// ms
+int			tracks   = 1000;
+long		entriesSent = 0;
+time_t		started;
+
+const char *playerList =
+	"count%3A2"
+	" playerindex%3A0 playerid%3A00%3A11%3A22%3A33%3A44%3A55 name%3ATest%20Player isplaying%3A1"
+	" playerindex%3A1 playerid%3Aaa%3Abb%3Acc%3Add%3Aee%3Aff name%3AKitchen isplaying%3A0";
+
+// the CLI echoes the command percent encoded, the spaces stay
+void encodeLine(const char *in, char *out) {
+	for (; *in; in++) {
+		if ((*in == ' ') || (*in == '-') || (*in == '?') || (*in == '_') || (*in == '.') ||
+			((*in >= '0') && (*in <= '9')) || ((*in >= 'A') && (*in <= 'Z')) || ((*in >= 'a') && (*in <= 'z'))) {
+			*out++ = *in;
+		} else {
+			out += sprintf(out, "%%%02X", (unsigned char)*in);
+		}
+	}
+	*out = 0;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+void *discovery(void *x) {
+	unsigned char buf[512], resp[512];
+	struct sockaddr_in addr;
+	socklen_t alen;
+	int enable = 1;
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port   = htons(DISC_PORT);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("discovery bind");
+		return NULL;
+	}
+
+	while (true) {
+		alen = sizeof(addr);
+		int n = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&addr, &alen);
+		if ((n < 1) || (buf[0] != 'e'))	{continue;}
+
+		char port[12], json[12];
+		sprintf(port, "%d", cliPort);
+		sprintf(json, "%d", (jsonPort > 0) ? jsonPort : 9000);
+		const char *tlv[][2] = {{"NAME", serverName}, {"JSON", json}, {"VERS", "8.3.0"}, {"UUID", "fake-uuid"}, {"CLIP", port}};
+
+		int len = 0;
+		resp[len++] = 'E';
+		for (unsigned i = 0; i < sizeof(tlv) / sizeof(tlv[0]); i++) {
+			int vlen = strlen(tlv[i][1]);
+			memcpy(resp + len, tlv[i][0], 4);
+			resp[len + 4] = vlen;
+			memcpy(resp + len + 5, tlv[i][1], vlen);
+			len += 5 + vlen;
+		}
+		usleep(latency * 1000);
+		sendto(sock, resp, len, 0, (struct sockaddr *)&addr, alen);
+	}
+	return NULL;
+}
+
+// the entries start..start+count-1 of the playlist, as LMS lists them
+int playlistWindow(char *out, int size, int start, int count) {
+	int len = 0;
+
+	for (int i = start; (i < start + count) && (i < tracks) && (len < size - 128); i++) {
+		len += snprintf(out + len, size - len, " playlist%%20index%%3A%d id%%3A%d title%%3ATrack%%20%d artist%%3AArtist%%20%d",
+			i, 1000 + i, i + 1, i % 7);
+		__atomic_add_fetch(&entriesSent, 1, __ATOMIC_RELAXED);
+	}
+	return len;
+}
+
+void answer(int fd, char *line) {
+	char echo[1024], out[8192], window[4096] = "";
+	char id[64] = "", cmd[64] = "", start[16] = "";
+	int  count = 0;
+
+	encodeLine(line, echo);
+	sscanf(echo, "%63s %63s", id, cmd);
+
+	if (strncmp(line, "players", 7) == 0) {
+		snprintf(out, sizeof(out), "%s %s\n", echo, playerList);
+	} else if (strncmp(line, "serverstatus", 12) == 0) {
+		snprintf(out, sizeof(out), "%s version%%3A8.3.0 player%%20count%%3A2\n", echo);
+	} else if (strcmp(cmd, "status") == 0) {
+		long played = time(NULL) - started;
+		if ((sscanf(line, "%*s %*s %15s %d", start, &count) == 2) && (start[0] != '-')) {
+			playlistWindow(window, sizeof(window), atoi(start), count);
+			printf("window %s+%d, %ld entries sent\n", start, count, entriesSent);
+			fflush(stdout);
+		}
+		snprintf(out, sizeof(out), "%s player_name%%3ATest mode%%3Aplay time%%3A%ld duration%%3A200"
+			" playlist_cur_index%%3A%ld playlist_timestamp%%3A%ld.5 playlist_tracks%%3A%d"
+			" title%%3AHello%%20W%%C3%%B6rld artist%%3AMe album%%3AAlbum"
+			" samplesize%%3A16 samplerate%%3A44100%s\n", echo, played % 200, (played / 200) % tracks,
+			(long)started, tracks, window);
+	} else if (strcmp(cmd, "mixer") == 0) {
+		snprintf(out, sizeof(out), "%s mixer volume 42\n", id);
+	} else {
+		snprintf(out, sizeof(out), "%s\n", echo);
+	}
+
+	usleep(latency * 1000);
+	if (write(fd, out, strlen(out)) < 0) {}
+}
+
+void *connection(void *arg) {
+	char buf[4096], line[1024];
+	int  fd  = (int)(long)arg;
+	int  len = 0;
+	int  n;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (int i = 0; i < n; i++) {
+			if (buf[i] == '\n') {
+				line[len] = 0;
+				if (len > 0)	{answer(fd, line);}
+				len = 0;
+			} else if (len < (int)sizeof(line) - 1) {
+				line[len++] = buf[i];
+			}
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+/*******************************************************************************
+ * JSON-RPC
+ ******************************************************************************/
+
+// params of {"id":1,"method":"slim.request","params":["player",["term",...]]}, terms joined by blanks
+int rpcParams(const char *body, char *player, int size, char *cmd, int cmdSize) {
+	const char *p = strstr(body, "\"params\":[\"");
+	const char *q;
+	int len = 0;
+
+	if (p == NULL)	{return -1;}
+	p += 11;
+	if (((q = strchr(p, '"')) == NULL) || (q - p >= size))	{return -1;}
+	memcpy(player, p, q - p);
+	player[q - p] = 0;
+
+	if ((p = strstr(q, "[\"")) == NULL)	{return -1;}
+	for (p += 2; (*p != 0) && (*p != ']') && (len < cmdSize - 1); p++) {
+		if (*p == '"')	{continue;}
+		cmd[len++] = (*p == ',') ? ' ' : *p;
+	}
+	cmd[len] = 0;
+	return 0;
+}
+
+// the answer to one request, the playlist timestamp after the loop as LMS may put it
+int rpcAnswer(const char *player, const char *cmd, char *out, int size) {
+	char start[16] = "";
+	int  count = 0;
+	int  len = snprintf(out, size, "{\"id\":1,\"method\":\"slim.request\",\"result\":{");
+
+	if (strncmp(cmd, "serverstatus", 12) == 0) {
+		len += snprintf(out + len, size - len, "\"player count\":2,\"players_loop\":["
+			"{\"model\":\"squeezelite\",\"isplaying\":1,\"name\":\"Test Player\",\"playerid\":\"00:11:22:33:44:55\"},"
+			"{\"playerid\":\"aa:bb:cc:dd:ee:ff\",\"name\":\"Kitchen\",\"model\":\"receiver\",\"isplaying\":0}],"
+			"\"version\":\"8.3.0\"");
+	} else if (strncmp(cmd, "status", 6) == 0) {
+		long played = time(NULL) - started;
+
+		len += snprintf(out + len, size - len, "\"mode\":\"play\",\"time\":%ld,\"duration\":200,\"mixer volume\":42,"
+			"\"playlist_cur_index\":\"%ld\",\"playlist_tracks\":%d,\"playlist_loop\":[",
+			played % 200, (played / 200) % tracks, tracks);
+
+		if ((sscanf(cmd, "%*s %15s %d", start, &count) == 2) && (start[0] != '-')) {
+			for (int i = atoi(start); (i < atoi(start) + count) && (i < tracks) && (len < size - 256); i++) {
+				len += snprintf(out + len, size - len, "%s{\"playlist index\":%d,\"id\":%d,\"title\":\"Track %d\",\"artist\":\"Artist %d\"}",
+					(i > atoi(start)) ? "," : "", i, 1000 + i, i + 1, i % 7);
+				__atomic_add_fetch(&entriesSent, 1, __ATOMIC_RELAXED);
+			}
+			printf("json window %s+%d, %ld entries sent\n", start, count, entriesSent);
+			fflush(stdout);
+		} else {
+			len += snprintf(out + len, size - len, "{\"samplerate\":\"44100\",\"title\":\"Hello W\\u00f6rld\",\"artist\":\"Me\","
+				"\"album\":\"Album\",\"samplesize\":16,\"composer\":null}");
+		}
+		len += snprintf(out + len, size - len, "],\"playlist_timestamp\":%ld.5", (long)started);
+	}
+	len += snprintf(out + len, size - len, "},\"params\":[\"%s\",[]]}", player);
+	return len;
+}
+
+// every other answer in chunks of 61 bytes
+void rpcSend(int fd, const char *body, int len, int chunked) {
+	char out[16384];
+	int  n;
+
+	if (!chunked) {
+		n = snprintf(out, sizeof(out), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s", len, body);
+	} else {
+		n = snprintf(out, sizeof(out), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n");
+		for (int i = 0; i < len; i += 61) {
+			int c = (len - i < 61) ? len - i : 61;
+			n += snprintf(out + n, sizeof(out) - n, "%x\r\n%.*s\r\n", c, c, body + i);
+		}
+		n += snprintf(out + n, sizeof(out) - n, "0\r\n\r\n");
+	}
+	usleep(latency * 1000);
+	if (write(fd, out, n) < 0) {}
+}
+
+void *rpcConnection(void *arg) {
+	char buf[16384], body[12288], player[64], cmd[256];
+	int  fd  = (int)(long)arg;
+	int  len = 0;
+	int  answers = 0;
+	int  n;
+
+	while ((n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+		len += n;
+		buf[len] = 0;
+
+		// pipelined: every complete request in the buffer
+		char *end;
+		while ((end = strstr(buf, "\r\n\r\n")) != NULL) {
+			const char *cl = strstr(buf, "Content-Length: ");
+			int clen = ((cl != NULL) && (cl < end)) ? atoi(cl + 16) : 0;
+			int used = end + 4 - buf + clen;
+			if (used > len)	{break;}
+
+			char save = buf[used];
+			buf[used] = 0;
+			if (rpcParams(end + 4, player, sizeof(player), cmd, sizeof(cmd)) == 0) {
+				int blen = rpcAnswer(player, cmd, body, sizeof(body));
+				rpcSend(fd, body, blen, answers++ % 2);
+			} else if (write(fd, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", 47) < 0) {}
+			buf[used] = save;
+
+			memmove(buf, buf + used, len - used);
+			len -= used;
+			buf[len] = 0;
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+void *rpcListener(void *x) {
+	struct sockaddr_in addr;
+	pthread_t th;
+	int enable = 1;
+
+	int lsock = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port   = htons(jsonPort);
+	if ((bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(lsock, 16) < 0)) {
+		perror("json bind");
+		return NULL;
+	}
+
+	for (int fd; (fd = accept(lsock, NULL, NULL)) >= 0; ) {
+		pthread_create(&th, NULL, rpcConnection, (void *)(long)fd);
+		pthread_detach(th);
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int main(int argc, char *argv[]) {
+	struct sockaddr_in addr;
+	pthread_t th;
+	int enable = 1;
+	int discover = true;
+	int aName;
+
+	while ((aName = getopt(argc, argv, "p:j:n:l:t:D")) != -1) {
+		switch (aName) {
+			case 'p':	cliPort = atoi(optarg);		break;
+			case 'j':	jsonPort = atoi(optarg);	break;
+			case 'n':	serverName = optarg;		break;
+			case 'l':	latency = atoi(optarg);		break;
+			case 't':	tracks = atoi(optarg);		break;
+			case 'D':	discover = false;			break;
+			default:
+				printf("Usage: %s [-p cliport] [-j jsonport] [-n name] [-l latency ms] [-t tracks] [-D]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	started = time(NULL);
+
+	int lsock = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port   = htons(cliPort);
+	if ((bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(lsock, 16) < 0)) {
+		perror("cli bind");
+		exit(1);
+	}
+
+	if (discover) {
+		pthread_create(&th, NULL, discovery, NULL);
+		pthread_detach(th);
+	}
+	if (jsonPort > 0) {
+		pthread_create(&th, NULL, rpcListener, NULL);
+		pthread_detach(th);
+	}
+
+	for (int fd; (fd = accept(lsock, NULL, NULL)) >= 0; ) {
+		pthread_create(&th, NULL, connection, (void *)(long)fd);
+		pthread_detach(th);
+	}
+	return 0;
+}
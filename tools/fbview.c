@@ -0,0 +1,219 @@
+/*
+ *	fbview.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Terminal viewer for the screen stream of lmsmonitor -d. Two pixel rows
+ *	make one line of half block characters. After a lost UDP packet the
+ *	picture is held until the next keyframe.
+ *
+ *	Usage: fbview [-n frames] [-o last.pbm] [-q] udp:port | tcp:host:port
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "fbstream.h"
+
+#define HEIGHT	(DISPLAY_PAGES * 8)
+
+uint8_t		frame[FBS_FRAME];
+uint8_t		packet[FBS_PACKET];
+
+long		packets = 0, keyframes = 0, bytes = 0, lost = 0, shown = 0;
+
+int openSource(const char *source) {
+	struct addrinfo hints, *res;
+	char host[256];
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+
+	if (strncmp(source, "udp:", 4) == 0) {
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_flags    = AI_PASSIVE;
+		if (getaddrinfo(NULL, source + 4, &hints, &res) != 0)	{return -1;}
+
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if ((fd >= 0) && (bind(fd, res->ai_addr, res->ai_addrlen) < 0)) {
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(res);
+		return fd;
+	}
+
+	const char *port = strrchr(source, ':');
+	if ((strncmp(source, "tcp:", 4) != 0) || (port == source + 3) || (port - source - 4 >= (int)sizeof(host))) {
+		return -1;
+	}
+	memcpy(host, source + 4, port - source - 4);
+	host[port - source - 4] = 0;
+
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port + 1, &hints, &res) != 0)	{return -1;}
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd >= 0) && (connect(fd, res->ai_addr, res->ai_addrlen) < 0)) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+int readFull(int fd, uint8_t *buf, int len) {
+	for (int got = 0; got < len; ) {
+		int n = read(fd, buf + got, len - got);
+		if (n <= 0)	{return -1;}
+		got += n;
+	}
+	return len;
+}
+
+// one packet, header included; 0 at the end of the stream
+int nextPacket(int fd, int stream) {
+	if (!stream) {
+		int n = recv(fd, packet, sizeof(packet), 0);
+		return (n < 0) ? -1 : n;
+	}
+
+	if (readFull(fd, packet, FBS_HEADER) < 0)	{return 0;}
+	int len = (packet[10] << 8) | packet[11];
+	if ((len > FBS_PACKET - FBS_HEADER) || (readFull(fd, packet + FBS_HEADER, len) < 0))	{return 0;}
+	return FBS_HEADER + len;
+}
+
+int pixel(int x, int y) {
+	return (frame[(y / 8) * DISPLAY_WIDTH + x] >> (y & 7)) & 1;
+}
+
+void render(void) {
+	static const char *block[4] = {" ", "▀", "▄", "█"};
+
+	printf("\033[H");
+	for (int y = 0; y < HEIGHT; y += 2) {
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
+			fputs(block[pixel(x, y) | (pixel(x, y + 1) << 1)], stdout);
+		}
+		putchar('\n');
+	}
+	fflush(stdout);
+}
+
+int writePBM(const char *path) {
+	FILE *out = fopen(path, "w");
+	if (out == NULL)	{return -1;}
+
+	fprintf(out, "P1\n%d %d\n", DISPLAY_WIDTH, HEIGHT);
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
+			putc(pixel(x, y) ? '1' : '0', out);
+		}
+		putc('\n', out);
+	}
+	return fclose(out);
+}
+
+int main(int argc, char *argv[]) {
+	uint8_t		delta[FBS_FRAME];
+	long		maxFrames = -1;
+	const char	*pbmFile  = NULL;
+	int			quiet     = false;
+	int			haveFrame = false;
+	uint32_t	seq = 0;
+	int			aName;
+
+	while ((aName = getopt(argc, argv, "n:o:q")) != -1) {
+		switch (aName) {
+			case 'n':	maxFrames = atol(optarg);	break;
+			case 'o':	pbmFile = optarg;			break;
+			case 'q':	quiet = true;				break;
+			default:	optind = argc;				break;
+		}
+	}
+	if (optind != argc - 1) {
+		printf("Usage: %s [-n frames] [-o last.pbm] [-q] udp:port | tcp:host:port\n", argv[0]);
+		exit(1);
+	}
+
+	int fd = openSource(argv[optind]);
+	if (fd < 0) {
+		printf("%s: cannot open: %s\n", argv[optind], strerror(errno));
+		exit(1);
+	}
+	int stream = (strncmp(argv[optind], "tcp:", 4) == 0);
+
+	if (!quiet)	{printf("\033[2J");}
+
+	while ((maxFrames < 0) || (shown < maxFrames)) {
+		int n = nextPacket(fd, stream);
+		if (n <= 0)	{break;}
+
+		int len = (packet[10] << 8) | packet[11];
+		if ((n < FBS_HEADER) || (packet[0] != 'L') || (packet[1] != 'F') || (FBS_HEADER + len != n) ||
+			(packet[3] != DISPLAY_PAGES) || (((packet[4] << 8) | packet[5]) != DISPLAY_WIDTH)) {
+			fprintf(stderr, "Bad packet of %d bytes\n", n);
+			continue;
+		}
+		packets++;
+		bytes += n;
+
+		uint32_t s = ((uint32_t)packet[6] << 24) | (packet[7] << 16) | (packet[8] << 8) | packet[9];
+		int key = packet[2] & FBS_KEYFRAME;
+
+		if (!key && (!haveFrame || (s != seq + 1))) {
+			// a delta needs the frame before it, wait for a keyframe
+			if (haveFrame)	{lost += s - seq - 1;}
+			haveFrame = false;
+			continue;
+		}
+		if (unpackBits(packet + FBS_HEADER, len, key ? frame : delta, FBS_FRAME) != FBS_FRAME) {
+			fprintf(stderr, "Broken frame %u\n", s);
+			haveFrame = false;
+			continue;
+		}
+
+		if (key) {
+			keyframes++;
+		} else {
+			for (int i = 0; i < FBS_FRAME; i++) {
+				frame[i] ^= delta[i];
+			}
+		}
+		haveFrame = true;
+		seq = s;
+		shown++;
+
+		if (!quiet)	{render();}
+	}
+
+	close(fd);
+	if ((pbmFile != NULL) && (writePBM(pbmFile) != 0)) {
+		perror(pbmFile);
+	}
+	fprintf(stderr, "%ld frames, %ld packets, %ld keyframes, %ld bytes (%.1f per packet), %ld lost\n",
+		shown, packets, keyframes, bytes, packets ? (double)bytes / packets : 0.0, lost);
+	return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ *	mkatlas.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Builds a glyph atlas for lmsmonitor -f from a BDF font. ASCII is left
+ *	out, the monitor has its own glyphs for it. The atlas is written in
+ *	the byte order of the host, both the Pi and x86 are little endian.
+ *
+ *	Usage: mkatlas font.bdf glyphs.atlas
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rle.h"
+#include "atlas.h"
+
+#define MAXGLYPHS	65536
+
+typedef struct {
+	uint32_t	codepoint;
+	int			width;
+	uint16_t	cols[ATLAS_MAXWIDTH];
+} bdfglyph;
+
+bdfglyph	*glyphs;
+int			glyphNum = 0;
+int			ascent   = -1;
+int			descent  = -1;
+
+int byCodepoint(const void *a, const void *b) {
+	uint32_t ca = ((const bdfglyph *)a)->codepoint;
+	uint32_t cb = ((const bdfglyph *)b)->codepoint;
+	return (ca > cb) - (ca < cb);
+}
+
+/*
+ * Reads the glyphs into column major bitmaps: bit 0 of a column is the
+ * top row of the character cell, the baseline is ascent rows down.
+ */
+int readBDF(FILE *in) {
+	char line[1024];
+	int  encoding = -1, dwidth = 0;
+	int  bw = 0, bh = 0, bx = 0, by = 0;
+	int  row = -1;
+	bdfglyph g;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		if (sscanf(line, "FONT_ASCENT %d", &ascent) == 1)		{continue;}
+		if (sscanf(line, "FONT_DESCENT %d", &descent) == 1)	{continue;}
+		if (strncmp(line, "STARTCHAR", 9) == 0) {
+			encoding = -1;
+			dwidth   = 0;
+			row      = -1;
+			memset(&g, 0, sizeof(g));
+			continue;
+		}
+		if (sscanf(line, "ENCODING %d", &encoding) == 1)	{continue;}
+		if (sscanf(line, "DWIDTH %d", &dwidth) == 1)		{continue;}
+		if (sscanf(line, "BBX %d %d %d %d", &bw, &bh, &bx, &by) == 4)	{continue;}
+		if (strncmp(line, "BITMAP", 6) == 0) {
+			row = 0;
+			continue;
+		}
+
+		if (strncmp(line, "ENDCHAR", 7) == 0) {
+			if ((encoding <= '~') || (glyphNum == MAXGLYPHS))	{row = -1; continue;}
+
+			g.codepoint = encoding;
+			g.width     = 0;
+			for (int c = 0; c < ATLAS_MAXWIDTH; c++) {
+				if (g.cols[c])	{g.width = c + 1;}
+			}
+			// blank glyphs (spaces) keep half of their advance
+			if (g.width == 0)	{g.width = (dwidth > 1) ? dwidth / 2 : 1;}
+			if (g.width > ATLAS_MAXWIDTH)	{g.width = ATLAS_MAXWIDTH;}
+
+			glyphs[glyphNum++] = g;
+			row = -1;
+			continue;
+		}
+
+		if ((row >= 0) && (row < bh)) {
+			unsigned long bits = strtoul(line, NULL, 16);
+			int bytes = (bw + 7) / 8;
+			int y = ascent - (by + bh) + row;
+
+			for (int c = 0; c < bw; c++) {
+				int x = bx + c;
+				if ((x < 0) || (x >= ATLAS_MAXWIDTH) || (y < 0) || (y >= ATLAS_MAXHEIGHT))	{continue;}
+				if (bits & (1UL << (bytes * 8 - 1 - c))) {
+					g.cols[x] |= 1 << y;
+				}
+			}
+			row++;
+		}
+	}
+	return glyphNum;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		printf("Usage: %s font.bdf glyphs.atlas\n", argv[0]);
+		exit(1);
+	}
+
+	FILE *in = fopen(argv[1], "r");
+	if (in == NULL) {
+		perror(argv[1]);
+		exit(1);
+	}
+
+	glyphs = (bdfglyph *)calloc(MAXGLYPHS, sizeof(bdfglyph));
+	if (glyphs == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	readBDF(in);
+	fclose(in);
+
+	if ((ascent < 0) || (descent < 0) || (ascent + descent > ATLAS_MAXHEIGHT)) {
+		printf("%s: need FONT_ASCENT and FONT_DESCENT, at most %d pixel together\n", argv[1], ATLAS_MAXHEIGHT);
+		exit(1);
+	}
+	qsort(glyphs, glyphNum, sizeof(bdfglyph), byCodepoint);
+
+	atlasheader h;
+	memcpy(h.magic, ATLAS_MAGIC, 4);
+	h.version     = ATLAS_VERSION;
+	h.height      = ascent + descent;
+	h.pages       = (h.height + 7) / 8;
+	h.count       = glyphNum;
+	h.indexOffset = sizeof(atlasheader);
+	h.dataOffset  = h.indexOffset + glyphNum * sizeof(atlasentry);
+
+	atlasentry *index = (atlasentry *)calloc(glyphNum + 1, sizeof(atlasentry));
+	uint8_t    *data  = (uint8_t *)malloc((size_t)glyphNum * ATLAS_MAXWIDTH * 3 + 1);
+	uint32_t    dataLen = 0;
+
+	if ((index == NULL) || (data == NULL)) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < glyphNum; i++) {
+		uint8_t raw[ATLAS_MAXWIDTH * 2];
+		int n = 0;
+
+		for (int c = 0; c < glyphs[i].width; c++) {
+			raw[n++] = glyphs[i].cols[c] & 0xFF;
+			if (h.pages > 1)	{raw[n++] = glyphs[i].cols[c] >> 8;}
+		}
+
+		index[i].codepoint = glyphs[i].codepoint;
+		index[i].offset    = dataLen;
+		index[i].width     = glyphs[i].width;
+		index[i].length    = packBits(raw, n, data + dataLen);
+		dataLen += index[i].length;
+	}
+
+	FILE *out = fopen(argv[2], "wb");
+	if ((out == NULL) ||
+		(fwrite(&h, sizeof(h), 1, out) != 1) ||
+		(fwrite(index, sizeof(atlasentry), glyphNum, out) != (size_t)glyphNum) ||
+		(fwrite(data, 1, dataLen, out) != dataLen) ||
+		(fclose(out) != 0)) {
+		perror(argv[2]);
+		exit(1);
+	}
+
+	printf("%s: %d glyphs, %d pixel high, %u bytes of glyph data\n", argv[2], glyphNum, h.height, dataLen);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ *	pollsim.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Runs the poll scheduler of the monitor (pollsched.c) against a made
+ *	up hour: tracks of about -t seconds back to back for -p minutes, then
+ *	stopped. The elapsed time of an answer is off by up to -j ms, like a
+ *	late answer or a track starting late. Prints the polls of the hour
+ *	and how late a track change was seen, next to the fixed 1 Hz polling
+ *	it replaces. -n: the server notifies the track changes, like with
+ *	subscribe.
+ *
+ *	Usage: pollsim [-t track s] [-p playing min] [-j jitter ms] [-n]
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pollsched.h"
+
+#define MS		1000000L			// ns
+#define HOUR	(3600 * 1000L)		// ms
+#define TRACKS	256
+
+long trackEnd[TRACKS];				// ms into the hour
+int  tracks = 0;
+
+// the track playing at t, -1 stopped
+int trackAt(long t) {
+	for (int i = 0; i < tracks; i++) {
+		if (t < trackEnd[i])	{return i;}
+	}
+	return -1;
+}
+
+int main(int argc, char *argv[]) {
+	long trackLen = 240;			// s
+	long playing  = 45;				// min
+	long jitter   = 800;			// ms
+	int  notify   = false;
+	int  aName;
+
+	while ((aName = getopt(argc, argv, "t:p:j:n")) != -1) {
+		switch (aName) {
+			case 't':	trackLen = atol(optarg);	break;
+			case 'p':	playing  = atol(optarg);	break;
+			case 'j':	jitter   = atol(optarg);	break;
+			case 'n':	notify   = true;			break;
+			default:
+				printf("Usage: %s [-t track s] [-p playing min] [-j jitter ms] [-n]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if ((trackLen < 10) || (playing < 0) || (playing > 60) || (jitter < 0)) {
+		printf("Tracks of 10s or more, playing 0 to 60 minutes, jitter 0 or more\n");
+		exit(1);
+	}
+
+	// lengths within +-30% of -t
+	srand(1);
+	for (long t = 0; (t < playing * 60000L) && (tracks < TRACKS); tracks++) {
+		long len = trackLen * 1000 * (70 + rand() % 61) / 100;
+		if (t + len > playing * 60000L)	{len = playing * 60000L - t;}
+		trackEnd[tracks] = (t += len);
+	}
+
+	long lagTotal = 0, lagMax = 0, changes = 0;
+	int  seen = trackAt(0);
+	int  next = 0;					// next track change to notify
+
+	schedReset(0);
+	for (long t = 0; t < HOUR; ) {
+		// a notification makes the poll due at the change
+		long due = schedNext() / MS;
+		while ((next < tracks) && (trackEnd[next] <= t))	{next++;}
+		if (notify && (next < tracks) && (trackEnd[next] <= due)) {
+			t = trackEnd[next++];
+			schedNow();
+		} else {
+			t = (due > t) ? due : t;
+		}
+		if (t >= HOUR)	{break;}
+
+		int  track = trackAt(t);
+		long start = (track > 0) ? trackEnd[track - 1] : 0;
+		long end   = (track >= 0) ? trackEnd[track] : 0;
+
+		if (track != seen) {
+			long lag = t - ((seen >= 0) ? trackEnd[seen] : 0);
+			lagTotal += lag;
+			if (lag > lagMax)	{lagMax = lag;}
+			changes++;
+			seen = track;
+		}
+		long off = jitter ? rand() % (2 * jitter + 1) - jitter : 0;
+		schedPolled(t * MS, track >= 0, t - start + off, end - start);
+	}
+
+	printf("%d tracks of ~%lds in %ld minutes playing%s\n", tracks, trackLen, playing, notify ? ", notified" : "");
+	printf("scheduled: %ld polls/hour, track change seen after %.0fms avg, %ldms max\n",
+		schedPolls(), changes ? (double)lagTotal / changes : 0.0, lagMax);
+	printf("fixed 1 Hz: 3600 polls/hour, track change seen after 500ms avg, 1000ms max\n");
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ *	snapcat.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Prints the shared memory snapshot of lmsmonitor -k, an example for
+ *	the lmssnap.h reader. With -w it polls the sequence number and prints
+ *	the snapshot whenever it changes.
+ *
+ *	Usage: snapcat [-w] [name]
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lmssnap.h"
+
+void printSnapshot(const lmssnap *s) {
+	int64_t pos = lmsSnapElapsed(s);
+
+	printf("seq %u, pid %d, volume %d%%, %s %lld:%02lld / %lld:%02lld\n",
+		s->seq, s->pid, s->volume, s->playing ? "playing" : "stopped",
+		(long long)(pos / 60000), (long long)(pos / 1000 % 60),
+		(long long)(s->duration / 60000), (long long)(s->duration / 1000 % 60));
+
+	for (int i = 0; (i < s->tagCount) && (i < LMSSNAP_TAGS); i++) {
+		if (s->tags[i].valid) {
+			printf("  %-12s %s\n", s->tags[i].name, s->tags[i].data);
+		}
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	const char	*name  = LMSSNAP_NAME;
+	int			watch  = 0;
+	uint32_t	last   = 0;
+	lmssnap		copy;
+	int			aName;
+
+	while ((aName = getopt(argc, argv, "w")) != -1) {
+		if (aName == 'w')	{watch = 1;}
+		else				{optind = argc + 1;}
+	}
+	if (optind > argc) {
+		printf("Usage: %s [-w] [name]\n", argv[0]);
+		exit(1);
+	}
+	if (optind < argc)	{name = argv[optind];}
+
+	const lmssnap *shm = lmsSnapOpen(name);
+	if (shm == NULL) {
+		printf("%s: no lmsmonitor snapshot\n", name);
+		exit(1);
+	}
+
+	do {
+		if ((lmsSnapSeq(shm) != last) && (lmsSnapRead(shm, &copy) == 0)) {
+			printSnapshot(&copy);
+			last = copy.seq;
+		}
+		if (watch)	{usleep(100000);}
+	} while (watch);
+
+	lmsSnapClose(shm);
+	return 0;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+#	startbench.sh
+#
+#	(c) 2015 László TÓTH
+#
+#	Startup benchmark: time to the first pixel and to the first metadata
+#	of lmsmonitor -b against tools/fakelms, with a static server address
+#	and with discovery. Build with make and make tools first.
+#
+#	Usage: tools/startbench.sh [runs] [latency ms]
+#
+
+RUNS=${1:-10}
+LATENCY=${2:-0}
+MONITOR=${MONITOR:-./bin/lmsmonitor}
+PORT=19090
+
+./tools/fakelms -p $PORT -n benchlms -l $LATENCY &
+FAKE=$!
+trap 'kill $FAKE 2>/dev/null' EXIT INT TERM
+sleep 0.5
+
+bench() {
+	label=$1
+	shift
+	i=0
+	while [ $i -lt $RUNS ]; do
+		timeout 30 $MONITOR -b -n "Test Player" "$@" 2>/dev/null | grep '^startup'
+		i=$((i + 1))
+	done | awk -v label="$label" '
+		{
+			split($2, p, "="); split($3, m, "=");
+			n++; ps += p[2]; ms += m[2];
+			if (n == 1 || p[2] < pmin) pmin = p[2]; if (p[2] > pmax) pmax = p[2];
+			if (n == 1 || m[2] < mmin) mmin = m[2]; if (m[2] > mmax) mmax = m[2];
+		}
+		END {
+			if (n == 0) { printf("%-10s no run reached the first metadata\n", label); exit }
+			printf("%-10s %2d runs  first pixel %6.1f ms (%.1f-%.1f)  first metadata %6.1f ms (%.1f-%.1f)\n",
+				label, n, ps / n, pmin, pmax, ms / n, mmin, mmax)
+		}'
+}
+
+echo "lmsmonitor startup, fakelms latency ${LATENCY}ms"
+bench static    -s 127.0.0.1:$PORT
+bench discovery -s benchlms
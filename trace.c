@@ -0,0 +1,302 @@
+/*
+ *	trace.c
+ *
+ *	(c) 2015 László TÓTH
+ *
+ *	Record and replay: -R writes every byte received on the CLI connection,
+ *	the mixer volume changes and the player selections to a compact binary
+ *	trace; -P feeds a trace back through sliminfo, the mixer volume and the
+ *	screen updates without server or sound card, in real time or (-x) as
+ *	fast as possible, and reports the CPU time and frame statistics.
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "logger.h"
+#include "metrics.h"
+#include "cliengine.h"
+#include "sliminfo.h"
+#include "mixermon.h"
+#include "i2cbus.h"
+#include "tagUtils.h"
+#include "carousel.h"
+#include "trace.h"
+
+FILE			*traceFile = NULL;
+pthread_mutex_t	traceLock  = PTHREAD_MUTEX_INITIALIZER;
+long			traceLast  = 0;		// ns, time of the previous record
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+long traceNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void putVarint(unsigned long v, FILE *f) {
+	while (v >= 0x80) {
+		putc((int)(v & 0x7F) | 0x80, f);
+		v >>= 7;
+	}
+	putc((int)v, f);
+}
+
+int getVarint(FILE *f, unsigned long *v) {
+	int c;
+	*v = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		if ((c = getc(f)) == EOF)	{return -1;}
+		*v |= (unsigned long)(c & 0x7F) << shift;
+		if (!(c & 0x80))			{return 0;}
+	}
+	return -1;
+}
+
+/*******************************************************************************
+ * Record
+ ******************************************************************************/
+int initTrace(const char *path) {
+	if ((traceFile = fopen(path, "wb")) == NULL) {
+		logERR(LS_MAIN, "Cannot create trace %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fwrite(TRACE_MAGIC, 1, 4, traceFile);
+	putc(TRACE_VERSION, traceFile);
+	traceLast = traceNow();
+
+	logMSG(LS_MAIN, LL_INFO, "Recording trace to %s\n", path);
+	return 0;
+}
+
+void closeTrace(void) {
+	pthread_mutex_lock(&traceLock);
+	if (traceFile != NULL) {
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+	pthread_mutex_unlock(&traceLock);
+}
+
+int isTracing(void) {
+	return traceFile != NULL;
+}
+
+// CLI bytes come from the poller, volume from the mixer thread
+void traceRecord(tracetype_t type, const void *data, int len) {
+	if (traceFile == NULL)	{return;}
+
+	pthread_mutex_lock(&traceLock);
+	if (traceFile != NULL) {
+		long now = traceNow();
+
+		putc(type, traceFile);
+		putVarint((now - traceLast) / 1000, traceFile);
+		putVarint(len, traceFile);
+		fwrite(data, 1, len, traceFile);
+		// the thread mode main loop never returns, keep the file complete
+		fflush(traceFile);
+		traceLast = now;
+	}
+	pthread_mutex_unlock(&traceLock);
+}
+
+void traceVolume(long volume) {
+	char v[16];
+	int  len = sprintf(v, "%ld", volume);
+	traceRecord(TR_VOLUME, v, len);
+}
+
+/*******************************************************************************
+ * Replay
+ ******************************************************************************/
+typedef struct {
+	long	records;
+	long	cliBytes;
+	long	volumeEvents;
+	long	polls;
+	long	failedPolls;
+	long	switches;
+	long	frames;
+	long	frameTotal;		// ns
+	long	frameMax;
+	long	volumeFrames;
+} replaystats;
+
+void sleepUntil(long when) {
+	struct timespec ts;
+
+	ts.tv_sec  = when / 1000000000L;
+	ts.tv_nsec = when % 1000000000L;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+void printReplayStats(replaystats *st, long traceLen, long wall) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	double user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+	double sys  = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+	printf("Replay: %ld records, %ld CLI bytes, %ld volume events, trace %.3fs, replay %.3fs\n",
+		st->records, st->cliBytes, st->volumeEvents, traceLen / 1e9, wall / 1e9);
+	printf("CPU: user %.3fs, system %.3fs\n", user, sys);
+	printf("Polls: %ld complete, %ld failed, %ld dropped by player switch\n", st->polls, st->failedPolls, st->switches);
+	printf("Frames: %ld tag, %ld volume, tag frame avg %.1fus, max %.1fus\n",
+		st->frames, st->volumeFrames,
+		st->frames ? st->frameTotal / 1e3 / st->frames : 0.0, st->frameMax / 1e3);
+
+	const decodestats *ds = getDecodeStats();
+	unsigned long lookups = ds->hits + ds->misses;
+	printf("Tags: %lu unchanged by hash, decode cache %lu hits, %lu misses, hit rate %.1f%%\n",
+		ds->unchanged, ds->hits, ds->misses, lookups ? 100.0 * ds->hits / lookups : 0.0);
+
+	const carouselstats *cs = getCarouselStats();
+	if (cs->turns > 1) {
+		printf("Pages: %lu turns, %lu shown as they were left, %lu drawn in full\n", cs->turns, cs->kept, cs->drawn);
+	}
+
+	if (busOpen()) {
+		const i2cstats *bs = busStats();
+		printf("I2C: %lu transfers, %lu messages, %lu bytes, %.1fms on the wire\n",
+			bs->transfers, bs->messages, bs->bytes, bs->busSeconds * 1e3);
+	}
+}
+
+/*
+ * The trace drives the poll cycles: once a player is selected a cycle is
+ * queued before answers are fed, and completed as soon as the last answer
+ * is in. A player switch drops the cycle in flight, its answers are in the
+ * trace for the old player only. A cycle that sees no answer for
+ * CLI_DEADLINE of trace time fails like it would live.
+ */
+int replayTrace(const char *path, int fast, showvolume_t onVolume, showtags_t onTags) {
+	char			magic[5];
+	char			*data;
+	replaystats		st;
+	unsigned long	dt, len;
+	long			traceTime  = 0;
+	long			cycleStart = -1;
+	int				havePlayer = false;
+	long			lastVolume = getActVolume();
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		logERR(LS_MAIN, "Cannot open trace %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if ((fread(magic, 1, 5, f) != 5) || (memcmp(magic, TRACE_MAGIC, 4) != 0) || (magic[4] != TRACE_VERSION)) {
+		logERR(LS_MAIN, "%s is not a trace file\n", path);
+		fclose(f);
+		return -1;
+	}
+	if ((data = (char *)malloc(TRACE_MAXREC + 1)) == NULL) {
+		fclose(f);
+		return -1;
+	}
+
+	memset(&st, 0, sizeof(st));
+	long start = traceNow();
+
+	for (int type; (type = getc(f)) != EOF; st.records++) {
+		if ((getVarint(f, &dt) < 0) || (getVarint(f, &len) < 0) ||
+			(len > TRACE_MAXREC) || (fread(data, 1, len, f) != len)) {
+			logERR(LS_MAIN, "Trace %s truncated at record %ld\n", path, st.records);
+			break;
+		}
+		data[len]  = 0;
+		traceTime += dt * 1000;
+
+		if (!fast)	{sleepUntil(start + traceTime);}
+
+		switch (type) {
+			case TR_PLAYER:
+				selectPlayer(data);
+				havePlayer = true;
+				if (cycleStart >= 0) {
+					cliClose();
+				}
+				break;
+
+			case TR_VOLUME:
+				st.volumeEvents++;
+				setActVolume(strtol(data, NULL, 10));
+				break;
+
+			case TR_CLI:
+				st.cliBytes += len;
+				if (havePlayer && (cliPending() == 0)) {
+					pollQueue();
+					cliFlush();
+					cycleStart = traceTime;
+				}
+				cliFeed(data, len);
+				if ((cliPending() > 0) && (traceTime - cycleStart > CLI_DEADLINE * 1000000L)) {
+					cliExpire(LONG_MAX);
+				}
+				break;
+
+			default:
+				logMSG(LS_MAIN, LL_DEBUG, "Unknown trace record %d\n", type);
+				break;
+		}
+
+		if ((cycleStart >= 0) && (cliPending() == 0)) {
+			cycleStart = -1;
+			pollstate_t rc = pollComplete();
+			if (rc == PS_DONE) {
+				long frameStart = metricsNow();
+				onTags(lastVolume);
+				long frame = metricsNow() - frameStart;
+
+				st.polls++;
+				st.frames++;
+				st.frameTotal += frame;
+				if (frame > st.frameMax)	{st.frameMax = frame;}
+			} else if (rc == PS_AGAIN) {
+				st.switches++;
+			} else {
+				st.failedPolls++;
+			}
+		}
+
+		long volume = getActVolume();
+		if (volume != lastVolume) {
+			onVolume(volume);
+			lastVolume = volume;
+			st.volumeFrames++;
+		}
+	}
+
+	free(data);
+	fclose(f);
+
+	printReplayStats(&st, traceTime, traceNow() - start);
+	return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ *	(c) 2015 László TÓTH
+ *
+ *	Todo:
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	See <http://www.gnu.org/licenses/> to get a copy of the GNU General
+ *	Public License.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H 1
+
+#include "reactor.h"
+
+#define TRACE_MAGIC		"LMST"
+#define TRACE_VERSION	1
+#define TRACE_MAXREC	65536		// longest record payload
+
+/*
+ * File: magic, version byte, then records of
+ *   type (1 byte) | time since the previous record in us (varint) | length (varint) | payload
+ */
+typedef enum {TR_CLI = 1, TR_VOLUME, TR_PLAYER} tracetype_t;
+
+int   initTrace(const char *path);
+void  closeTrace(void);
+int   isTracing(void);
+void  traceRecord(tracetype_t type, const void *data, int len);
+void  traceVolume(long volume);
+int   replayTrace(const char *path, int fast, showvolume_t onVolume, showtags_t onTags);
+
+#endif